@@ -0,0 +1,47 @@
+"use strict";
+
+/*
+ * Feeds many interleaved hashes small chunks, the way a server with one hash
+ * per connection does, one update() at a time and with updateBatch().
+ *
+ *   node bench/batch.js [streams] [chunkBytes] [rounds]
+ */
+
+const blake2 = require('../index');
+
+const streams = Number(process.argv[2]) || 4096;
+const chunkBytes = Number(process.argv[3]) || 256;
+const rounds = Number(process.argv[4]) || 64;
+
+const chunks = [];
+for (let i = 0; i < streams; i++) {
+	chunks.push(Buffer.alloc(chunkBytes, i));
+}
+
+function run(algorithm, batch) {
+	const arena = blake2.createHashArena();
+	const handles = chunks.map(() => arena.create(algorithm));
+	const entries = handles.map((handle, i) => [handle, chunks[i]]);
+	const start = process.hrtime.bigint();
+	for (let round = 0; round < rounds; round++) {
+		if (batch) {
+			arena.updateBatch(entries);
+		} else {
+			for (let i = 0; i < streams; i++) {
+				arena.update(handles[i], chunks[i]);
+			}
+		}
+	}
+	const seconds = Number(process.hrtime.bigint() - start) / 1e9;
+	handles.forEach(handle => arena.digest(handle));
+	return streams * chunkBytes * rounds / seconds / 1e6;
+}
+
+// Untimed round so that both paths are optimized before they are measured
+run('blake2b', false);
+run('blake2b', true);
+for (const algorithm of ['blake2b', 'blake2s']) {
+	const serial = run(algorithm, false);
+	const batched = run(algorithm, true);
+	console.log(`${algorithm} ${streams} x ${chunkBytes} B: update ${serial.toFixed(0)} MB/s, updateBatch ${batched.toFixed(0)} MB/s (${(batched / serial).toFixed(2)}x)`);
+}
@@ -0,0 +1,95 @@
+"use strict";
+
+/*
+ * Helpers shared by the benchmarks: option parsing, timing and percentiles.
+ */
+
+// Ops are timed in batches of at least this many nanoseconds, so that timer
+// overhead stays out of the percentiles of sub-microsecond ops
+const MIN_SAMPLE_NS = 20000;
+
+// Every case is sampled at least this often, however long one op takes
+const MIN_SAMPLES = 5;
+
+// Largest batch the calibration grows to
+const MAX_BATCH = 1 << 20;
+
+/**
+ * Parses `--name value` pairs into a copy of `defaults`, converting values
+ * to the type of the default.  Unknown options throw.
+ */
+function parseArgs(argv, defaults) {
+	const options = Object.assign({}, defaults);
+	for (let i = 0; i < argv.length; i += 2) {
+		const match = /^--([a-z][a-zA-Z-]*)$/.exec(argv[i]);
+		const name = match && match[1].replace(/-([a-z])/g, (_, c) => c.toUpperCase());
+		if (!name || !(name in defaults) || i + 1 >= argv.length) {
+			throw new Error("Bad option " + argv[i] + "; options are " +
+				Object.keys(defaults).map(n => '--' + n.replace(/[A-Z]/g, c => '-' + c.toLowerCase())).join(' '));
+		}
+		options[name] = typeof defaults[name] === 'number' ? Number(argv[i + 1]) : argv[i + 1];
+	}
+	return options;
+}
+
+function percentile(sorted, p) {
+	return sorted[Math.min(sorted.length - 1, Math.floor(p * sorted.length))];
+}
+
+function timeSync(op, batch) {
+	const start = process.hrtime.bigint();
+	for (let i = 0; i < batch; i++) {
+		op();
+	}
+	return Number(process.hrtime.bigint() - start);
+}
+
+async function timeAsync(op, batch) {
+	const start = process.hrtime.bigint();
+	for (let i = 0; i < batch; i++) {
+		await op();
+	}
+	return Number(process.hrtime.bigint() - start);
+}
+
+/**
+ * Runs `op` (a function returning a promise when `async`) for about
+ * `seconds` after an untimed warmup and a batch size calibration.  Returns
+ * {ops, seconds, p50, p99} with the percentiles in nanoseconds per op.
+ */
+async function measure(op, seconds, async) {
+	const time = async ? timeAsync : timeSync;
+	await time(op, 1);
+
+	let batch = 1;
+	while (batch < MAX_BATCH && await time(op, batch) < MIN_SAMPLE_NS) {
+		batch *= 2;
+	}
+
+	const samples = [];
+	let elapsed = 0;
+	while (samples.length < MIN_SAMPLES || elapsed < seconds * 1e9) {
+		const ns = await time(op, batch);
+		samples.push(ns / batch);
+		elapsed += ns;
+	}
+	samples.sort((a, b) => a - b);
+	return {
+		ops: samples.length * batch,
+		seconds: elapsed / 1e9,
+		p50: percentile(samples, 0.5),
+		p99: percentile(samples, 0.99)
+	};
+}
+
+function formatSize(bytes) {
+	if (bytes >= 1024 * 1024) {
+		return (bytes / 1024 / 1024) + 'MiB';
+	}
+	if (bytes >= 1024) {
+		return (bytes / 1024) + 'KiB';
+	}
+	return bytes + 'B';
+}
+
+module.exports = {parseArgs, measure, percentile, formatSize};
@@ -0,0 +1,29 @@
+"use strict";
+
+/*
+ * Time to construct a hash object and hash a short input, with Hash (a
+ * lazy Transform) and with the plain Hasher.
+ *
+ *   node bench/hasher.js [iterations] [inputBytes]
+ */
+
+const blake2 = require('../index');
+
+const iterations = Number(process.argv[2]) || 1000000;
+const input = Buffer.alloc(Number(process.argv[3]) || 32, 1);
+
+function time(name, fn) {
+	// Untimed round so that fn is optimized before it is measured
+	for (let i = 0; i < iterations / 10; i++) {
+		fn();
+	}
+	const start = process.hrtime.bigint();
+	for (let i = 0; i < iterations; i++) {
+		fn();
+	}
+	const ns = Number(process.hrtime.bigint() - start) / iterations;
+	console.log(`${name}: ${ns.toFixed(0)} ns per ${input.length}-byte hash`);
+}
+
+time('createHash', () => blake2.createHash('blake2b').update(input).digest());
+time('createHasher', () => blake2.createHasher('blake2b').update(input).digest());
@@ -0,0 +1,157 @@
+"use strict";
+
+/*
+ * Memory cost of hashing: runs a fixed number of create/update/digest/copy
+ * cycles per algorithm and API, and reports heap, external and RSS growth
+ * and GC count and time per million hashes as JSON.  Exits with status 1
+ * when any of them is over its budget.
+ *
+ *   node bench/memory.js [--millions 1] [--filter regex]
+ *                        [--heap bytes] [--external bytes] [--rss bytes]
+ *                        [--gc-count n] [--gc-ms ms]
+ *
+ * Budgets are per million hashes.  Growth is measured between two full
+ * collections after a warmup, so anything left over was kept alive.
+ */
+
+const blake2 = require('../index');
+const v8 = require('v8');
+const vm = require('vm');
+const {PerformanceObserver} = require('perf_hooks');
+const {parseArgs} = require('./common');
+
+const options = parseArgs(process.argv.slice(2), {
+	millions: 1,
+	filter: '',
+	heap: 4 * 1024 * 1024,
+	external: 1024 * 1024,
+	rss: 16 * 1024 * 1024,
+	gcCount: 2000,
+	gcMs: 5000
+});
+
+v8.setFlagsFromString('--expose-gc');
+const gc = vm.runInNewContext('gc');
+
+const ALGORITHMS = ['blake2b', 'blake2bp', 'blake2s', 'blake2sp'];
+const WARMUP = 10000;
+
+// Hashes between turns of the event loop, so that weak callbacks freeing
+// native objects get to run
+const SLICE = 100000;
+
+const input = Buffer.alloc(100, 0x5a);
+const key = Buffer.alloc(32, 0x6b);
+
+function cases() {
+	const all = [];
+	for (const algorithm of ALGORITHMS) {
+		all.push({name: 'hash/' + algorithm, op: () => blake2.createHash(algorithm).update(input).digest()});
+		all.push({name: 'keyed/' + algorithm, op: () => blake2.createKeyedHash(algorithm, key).update(input).digest()});
+		all.push({name: 'copy/' + algorithm, op: () => {
+			const hash = blake2.createHash(algorithm).update(input);
+			hash.copy().digest();
+			return hash.digest('hex');
+		}});
+		all.push({name: 'hasher/' + algorithm, op: () => blake2.createHasher(algorithm).update(input).digest()});
+	}
+	all.push({name: 'hash64', op: () => blake2.hash64(key, input)});
+	return all;
+}
+
+function nextTurn() {
+	return new Promise(resolve => setImmediate(resolve));
+}
+
+async function settle() {
+	for (let i = 0; i < 3; i++) {
+		gc();
+		await nextTurn();
+	}
+	return process.memoryUsage();
+}
+
+async function run(op, count) {
+	for (let done = 0; done < count; done += SLICE) {
+		const slice = Math.min(SLICE, count - done);
+		for (let i = 0; i < slice; i++) {
+			op();
+		}
+		await nextTurn();
+	}
+}
+
+async function main() {
+	const filter = options.filter ? new RegExp(options.filter) : null;
+	const count = Math.round(options.millions * 1e6);
+	const budgets = {
+		heap: options.heap,
+		external: options.external,
+		rss: options.rss,
+		gcCount: options.gcCount,
+		gcMs: options.gcMs
+	};
+
+	let gcCount = 0;
+	let gcMs = 0;
+	const observer = new PerformanceObserver(function(list) {
+		for (const entry of list.getEntries()) {
+			gcCount++;
+			gcMs += entry.duration;
+		}
+	});
+	observer.observe({entryTypes: ['gc']});
+
+	const results = [];
+	const failures = [];
+	for (const c of cases()) {
+		if (filter && !filter.test(c.name)) {
+			continue;
+		}
+		await run(c.op, WARMUP);
+		const before = await settle();
+		gcCount = 0;
+		gcMs = 0;
+		const start = process.hrtime.bigint();
+		await run(c.op, count);
+		const seconds = Number(process.hrtime.bigint() - start) / 1e9;
+		// Count only the collections of the run itself
+		await nextTurn();
+		const used = {count: gcCount, ms: gcMs};
+		const after = await settle();
+
+		const result = {
+			name: c.name,
+			hashesPerSec: count / seconds,
+			heap: (after.heapUsed - before.heapUsed) / options.millions,
+			external: (after.external - before.external) / options.millions,
+			rss: (after.rss - before.rss) / options.millions,
+			gcCount: used.count / options.millions,
+			gcMs: used.ms / options.millions
+		};
+		results.push(result);
+		const over = Object.keys(budgets).filter(name => result[name] > budgets[name]);
+		if (over.length) {
+			failures.push(c.name + ' (' + over.join(', ') + ')');
+		}
+		process.stderr.write(c.name + ': rss ' + Math.round(result.rss / 1024) + ' KiB, ' + result.gcCount.toFixed(0) + ' GCs per million\n');
+	}
+	observer.disconnect();
+
+	process.stdout.write(JSON.stringify({
+		node: process.version,
+		millions: options.millions,
+		budgets,
+		failures,
+		results
+	}, null, '\t') + '\n');
+	if (failures.length) {
+		process.stderr.write('Over budget: ' + failures.join(', ') + '\n');
+		process.exitCode = 1;
+	}
+}
+
+main().catch(function(err) {
+	process.stderr.write(err.stack + '\n');
+	process.exitCode = 2;
+});
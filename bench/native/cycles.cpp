@@ -0,0 +1,250 @@
+/*
+ * Median cycles per byte of every hash kernel in one build of the addon's
+ * BLAKE2 sources, measured outside of V8 the way src/BLAKE2/bench does.
+ * Built once per kernel variant by the Makefile next to this file.
+ *
+ *   cycles-<variant> [core] [datadir]
+ *
+ * Pins itself to `core` (0 by default, Linux only), prints a JSON report
+ * to stdout and, with `datadir`, writes <variant>-<kernel>.data files for
+ * do.gplot.  On x86 the unit is TSC ticks, which only match core cycles
+ * with frequency scaling and turbo disabled.
+ */
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <vector>
+
+#if defined(__linux__)
+#include <sched.h>
+#endif
+
+// The lane compressors are file-local; including the source reaches them
+#include "blake2_lanes.cpp"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+static inline uint64_t Ticks() {
+	return __rdtsc();
+}
+static const char *TICK_UNIT = "cycles";
+#elif defined(__aarch64__)
+static inline uint64_t Ticks() {
+	uint64_t t;
+	__asm__ __volatile__("isb; mrs %0, cntvct_el0" : "=r"(t));
+	return t;
+}
+static const char *TICK_UNIT = "ticks";
+#else
+static inline uint64_t Ticks() {
+	return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+		std::chrono::steady_clock::now().time_since_epoch()).count());
+}
+static const char *TICK_UNIT = "ns";
+#endif
+
+#ifndef KERNEL_VARIANT
+#define KERNEL_VARIANT "unknown"
+#endif
+
+static const int TRIALS = 32;
+static const size_t MAX_LENGTH = 4096;
+
+// Long-message cost is the difference between these two lengths, so that
+// fixed per-message costs cancel out
+static const size_t LONG_SHORT = 8192;
+static const size_t LONG_LONG = 16384;
+
+// Compressions per timed call of the compress-only kernels
+static const int COMPRESS_BATCH = 256;
+
+static uint8_t input[BLAKE2S_LANES][LONG_LONG];
+static uint8_t output[BLAKE2S_LANES][BLAKE2B_OUTBYTES];
+
+struct Kernel {
+	const char *name;
+	size_t lanes;
+	void (*hash)(size_t length);
+};
+
+struct Compressor {
+	std::string name;
+	size_t lanes;
+	size_t block;
+	void (*compress)(size_t);
+};
+
+static blake2b_state lanes_b;
+static blake2s_state lanes_s;
+
+static void HashB(size_t length) {
+	blake2b(output[0], BLAKE2B_OUTBYTES, input[0], length, nullptr, 0);
+}
+
+static void HashBP(size_t length) {
+	blake2bp(output[0], BLAKE2B_OUTBYTES, input[0], length, nullptr, 0);
+}
+
+static void HashS(size_t length) {
+	blake2s(output[0], BLAKE2S_OUTBYTES, input[0], length, nullptr, 0);
+}
+
+static void HashSP(size_t length) {
+	blake2sp(output[0], BLAKE2S_OUTBYTES, input[0], length, nullptr, 0);
+}
+
+static void HashLanesB(size_t length) {
+	const uint8_t *in[BLAKE2B_LANES];
+	uint8_t *out[BLAKE2B_LANES];
+	for (int l = 0; l < BLAKE2B_LANES; l++) {
+		in[l] = input[l];
+		out[l] = output[l];
+	}
+	blake2b_hash_lanes(&lanes_b, in, length, out, BLAKE2B_LANES);
+}
+
+static void HashLanesS(size_t length) {
+	const uint8_t *in[BLAKE2S_LANES];
+	uint8_t *out[BLAKE2S_LANES];
+	for (int l = 0; l < BLAKE2S_LANES; l++) {
+		in[l] = input[l];
+		out[l] = output[l];
+	}
+	blake2s_hash_lanes(&lanes_s, in, length, out, BLAKE2S_LANES);
+}
+
+template<typename W, int N, void (*COMPRESS)(W h[8][N], const uint8_t *const blocks[N], const uint64_t t[N], const W f[N])>
+static void CompressOnly(size_t) {
+	W h[8][N] = {};
+	const uint8_t *blocks[N];
+	uint64_t t[N];
+	W f[N];
+	for (int l = 0; l < N; l++) {
+		blocks[l] = input[l];
+		t[l] = 0;
+		f[l] = 0;
+	}
+	for (int i = 0; i < COMPRESS_BATCH; i++) {
+		COMPRESS(h, blocks, t, f);
+	}
+	output[0][0] ^= static_cast<uint8_t>(h[0][0]);
+}
+
+/**
+ * Median ticks of one call of `hash` on `length` bytes, less the cost of
+ * reading the timer
+ */
+static double Median(void (*hash)(size_t), size_t length, uint64_t overhead) {
+	uint64_t ticks[TRIALS + 1];
+	hash(length);
+	for (int i = 0; i <= TRIALS; i++) {
+		ticks[i] = Ticks();
+		hash(length);
+	}
+	for (int i = 0; i < TRIALS; i++) {
+		ticks[i] = ticks[i + 1] - ticks[i];
+	}
+	std::sort(ticks, ticks + TRIALS);
+	const uint64_t median = ticks[TRIALS / 2];
+	return median > overhead ? static_cast<double>(median - overhead) : 0.0;
+}
+
+static void Nothing(size_t) {}
+
+static void Pin(int core) {
+#if defined(__linux__)
+	cpu_set_t set;
+	CPU_ZERO(&set);
+	CPU_SET(core, &set);
+	if (sched_setaffinity(0, sizeof(set), &set) != 0) {
+		fprintf(stderr, "Could not pin to core %d; results may be noisy\n", core);
+	}
+#else
+	fprintf(stderr, "Pinning is not supported here; results may be noisy\n");
+#endif
+}
+
+int main(int argc, char **argv) {
+	const int core = argc > 1 ? atoi(argv[1]) : 0;
+	const char *datadir = argc > 2 ? argv[2] : nullptr;
+	Pin(core);
+
+	for (int l = 0; l < BLAKE2S_LANES; l++) {
+		for (size_t i = 0; i < LONG_LONG; i++) {
+			input[l][i] = static_cast<uint8_t>(i * 7 + l);
+		}
+	}
+	blake2b_init(&lanes_b, BLAKE2B_OUTBYTES);
+	blake2s_init(&lanes_s, BLAKE2S_OUTBYTES);
+
+	std::vector<Kernel> kernels = {
+		{ "blake2b", 1, HashB },
+		{ "blake2bp", 1, HashBP },
+		{ "blake2s", 1, HashS },
+		{ "blake2sp", 1, HashSP },
+		{ blake2_lanes_accelerated() ? "lanes-b-avx2" : "lanes-b", BLAKE2B_LANES, HashLanesB },
+		{ blake2_lanes_accelerated() ? "lanes-s-avx2" : "lanes-s", BLAKE2S_LANES, HashLanesS }
+	};
+
+	// Compressors on their own, long messages only.  In an AVX2 build the
+	// generic ones are compiled for AVX2.
+#if defined(__AVX2__)
+	const std::string generic = "avx2";
+#else
+	const std::string generic = "generic";
+#endif
+	std::vector<Compressor> compressors = {
+		{ "compress-b-" + generic, BLAKE2B_LANES, BLAKE2B_BLOCKBYTES, CompressOnly<uint64_t, BLAKE2B_LANES, blake2b_compress_generic> },
+		{ "compress-s-" + generic, BLAKE2S_LANES, BLAKE2S_BLOCKBYTES, CompressOnly<uint32_t, BLAKE2S_LANES, blake2s_compress_generic> }
+	};
+#ifdef LANES_AVX2_DISPATCH
+	if (use_avx2) {
+		compressors.push_back({ "compress-b-avx2", BLAKE2B_LANES, BLAKE2B_BLOCKBYTES, CompressOnly<uint64_t, BLAKE2B_LANES, blake2b_compress_avx2> });
+		compressors.push_back({ "compress-s-avx2", BLAKE2S_LANES, BLAKE2S_BLOCKBYTES, CompressOnly<uint32_t, BLAKE2S_LANES, blake2s_compress_avx2> });
+	}
+#endif
+
+	const uint64_t overhead = static_cast<uint64_t>(Median(Nothing, 0, 0));
+
+	printf("{\n\t\"variant\": \"%s\",\n\t\"unit\": \"%s\",\n\t\"core\": %d,\n\t\"kernels\": [", KERNEL_VARIANT, TICK_UNIT, core);
+	bool first = true;
+	for (const Kernel &k : kernels) {
+		std::vector<double> perByte(MAX_LENGTH + 1);
+		for (size_t length = 1; length <= MAX_LENGTH; length++) {
+			perByte[length] = Median(k.hash, length, overhead) / static_cast<double>(length * k.lanes);
+		}
+		const double longPerByte = (Median(k.hash, LONG_LONG, overhead) - Median(k.hash, LONG_SHORT, overhead)) /
+			static_cast<double>((LONG_LONG - LONG_SHORT) * k.lanes);
+
+		printf("%s\n\t\t{\"name\": \"%s\", \"lanes\": %zu, \"long\": %.3f, \"perByte\": [", first ? "" : ",", k.name, k.lanes, longPerByte);
+		for (size_t length = 1; length <= MAX_LENGTH; length++) {
+			printf("%s%.3f", length > 1 ? ", " : "", perByte[length]);
+		}
+		printf("]}");
+		first = false;
+
+		if (datadir) {
+			const std::string path = std::string(datadir) + "/" + KERNEL_VARIANT + "-" + k.name + ".data";
+			FILE *data = fopen(path.c_str(), "w");
+			if (!data) {
+				perror(path.c_str());
+				return 1;
+			}
+			fprintf(data, "#bytes  per byte\n");
+			for (size_t length = 1; length <= MAX_LENGTH; length++) {
+				fprintf(data, "%5zu, %7.2f\n", length, perByte[length]);
+			}
+			fprintf(data, "#long     %7.2f\n", longPerByte);
+			fclose(data);
+		}
+	}
+	for (const Compressor &c : compressors) {
+		const double perByte = Median(c.compress, 0, overhead) / static_cast<double>(COMPRESS_BATCH * c.lanes * c.block);
+		printf(",\n\t\t{\"name\": \"%s\", \"lanes\": %zu, \"long\": %.3f, \"perByte\": null}", c.name.c_str(), c.lanes, perByte);
+	}
+	printf("\n\t]\n}\n");
+	return 0;
+}
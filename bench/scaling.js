@@ -0,0 +1,226 @@
+"use strict";
+
+/*
+ * How hashing throughput scales with cores, and how much it delays the
+ * event loop.  Every mode runs with 1 to --max-workers workers while
+ * monitorEventLoopDelay watches the main thread's loop:
+ *
+ *   main    synchronous hashing on the main thread, one buffer per turn
+ *   sync    synchronous hashing in n worker_threads
+ *   stream  piping 64 KiB chunks into hash streams in n worker_threads
+ *   async   n concurrent offloaded hashes, with UV_THREADPOOL_SIZE=n
+ *   file    n concurrent hashMulti() calls on a file, with UV_THREADPOOL_SIZE=n
+ *
+ *   node bench/scaling.js [--modes main,sync,stream,async,file]
+ *                         [--max-workers cpus] [--seconds 2] [--size bytes]
+ *
+ * Prints one curve per mode as JSON: GB/s and speedup over one worker,
+ * and p50/p99/max loop delay in milliseconds at each worker count.
+ */
+
+const blake2 = require('../index');
+const childProcess = require('child_process');
+const fs = require('fs');
+const os = require('os');
+const path = require('path');
+const stream = require('stream');
+const {Worker, isMainThread, parentPort, workerData} = require('worker_threads');
+const {monitorEventLoopDelay} = require('perf_hooks');
+const {parseArgs} = require('./common');
+
+const STREAM_CHUNK = 64 * 1024;
+
+function deadline(seconds) {
+	const end = Date.now() + seconds * 1000;
+	return () => Date.now() >= end;
+}
+
+function nextTurn() {
+	return new Promise(resolve => setImmediate(resolve));
+}
+
+function pipeOnce(chunks) {
+	return new Promise(function(resolve, reject) {
+		stream.Readable.from(chunks, {objectMode: false})
+			.pipe(blake2.createHash('blake2b'))
+			.on('error', reject)
+			.once('data', resolve);
+	});
+}
+
+/**
+ * Hashes in the calling thread until `seconds` have passed and resolves
+ * to the number of bytes hashed.  Yields to the loop between buffers.
+ */
+async function hashHere(mode, seconds, size) {
+	const data = Buffer.alloc(size, 0xa5);
+	const chunks = [];
+	for (let at = 0; at < size; at += STREAM_CHUNK) {
+		chunks.push(data.subarray(at, at + STREAM_CHUNK));
+	}
+	const done = deadline(seconds);
+	let bytes = 0;
+	while (!done()) {
+		if (mode === 'stream') {
+			await pipeOnce(chunks);
+		} else {
+			blake2.createHash('blake2b').update(data).digest();
+			await nextTurn();
+		}
+		bytes += size;
+	}
+	return bytes;
+}
+
+function hashInWorkers(mode, workers, seconds, size) {
+	const all = [];
+	for (let i = 0; i < workers; i++) {
+		all.push(new Promise(function(resolve, reject) {
+			const worker = new Worker(__filename, {workerData: {mode, seconds, size}});
+			worker.once('message', resolve);
+			worker.once('error', reject);
+		}));
+	}
+	return Promise.all(all).then(counts => counts.reduce((a, b) => a + b, 0));
+}
+
+async function offloadLoop(seconds, size) {
+	const data = Buffer.alloc(size, 0xa5);
+	const done = deadline(seconds);
+	let bytes = 0;
+	while (!done()) {
+		const hash = blake2.createHash('blake2b', {offload: true});
+		hash.update(data);
+		await hash.digest();
+		bytes += size;
+	}
+	return bytes;
+}
+
+async function fileLoop(file, seconds, size) {
+	const done = deadline(seconds);
+	let bytes = 0;
+	while (!done()) {
+		await blake2.hashMulti(file, ['blake2b']);
+		bytes += size;
+	}
+	return bytes;
+}
+
+async function concurrently(workers, loop) {
+	const all = [];
+	for (let i = 0; i < workers; i++) {
+		all.push(loop());
+	}
+	return (await Promise.all(all)).reduce((a, b) => a + b, 0);
+}
+
+/**
+ * One point of one curve, in a process of its own so that every point gets
+ * a fresh threadpool of the right size
+ */
+async function measurePoint(mode, workers, seconds, size) {
+	let file = null;
+	if (mode === 'file') {
+		file = path.join(os.tmpdir(), 'blake2-scaling-' + process.pid);
+		fs.writeFileSync(file, Buffer.alloc(size, 0xa5));
+	}
+
+	const delay = monitorEventLoopDelay({resolution: 1});
+	delay.enable();
+	const start = process.hrtime.bigint();
+	let bytes;
+	try {
+		if (mode === 'main') {
+			bytes = await hashHere('sync', seconds, size);
+		} else if (mode === 'sync' || mode === 'stream') {
+			bytes = await hashInWorkers(mode, workers, seconds, size);
+		} else if (mode === 'async') {
+			bytes = await concurrently(workers, () => offloadLoop(seconds, size));
+		} else if (mode === 'file') {
+			bytes = await concurrently(workers, () => fileLoop(file, seconds, size));
+		} else {
+			throw new Error("Unknown mode " + mode);
+		}
+	} finally {
+		if (file) {
+			fs.unlinkSync(file);
+		}
+	}
+	const elapsed = Number(process.hrtime.bigint() - start) / 1e9;
+	delay.disable();
+	return {
+		workers,
+		gbPerSec: bytes / elapsed / 1e9,
+		loopDelayP50: delay.percentile(50) / 1e6,
+		loopDelayP99: delay.percentile(99) / 1e6,
+		loopDelayMax: delay.max / 1e6
+	};
+}
+
+function workerCounts(max) {
+	const counts = [];
+	for (let n = 1; n < max; n *= 2) {
+		counts.push(n);
+	}
+	counts.push(max);
+	return counts;
+}
+
+function runPoint(mode, workers, options) {
+	const args = [__filename, '--point', mode + ':' + workers, '--seconds', String(options.seconds), '--size', String(options.size)];
+	const env = Object.assign({}, process.env, {UV_THREADPOOL_SIZE: String(workers)});
+	const result = childProcess.spawnSync(process.execPath, args, {env, encoding: 'utf8', stdio: ['ignore', 'pipe', 'inherit']});
+	if (result.status !== 0) {
+		throw new Error(mode + " with " + workers + " workers failed");
+	}
+	return JSON.parse(result.stdout);
+}
+
+function main() {
+	const options = parseArgs(process.argv.slice(2), {
+		modes: 'main,sync,stream,async,file',
+		maxWorkers: os.cpus().length,
+		seconds: 2,
+		size: 1024 * 1024,
+		point: ''
+	});
+
+	if (options.point) {
+		const [mode, workers] = options.point.split(':');
+		measurePoint(mode, Number(workers), options.seconds, options.size).then(function(point) {
+			process.stdout.write(JSON.stringify(point));
+		}, function(err) {
+			process.stderr.write(err.stack + '\n');
+			process.exitCode = 2;
+		});
+		return;
+	}
+
+	const curves = {};
+	for (const mode of options.modes.split(',')) {
+		// Hashing on the main thread does not scale; it is there for its loop delay
+		const counts = mode === 'main' ? [1] : workerCounts(options.maxWorkers);
+		curves[mode] = counts.map(function(workers) {
+			const point = runPoint(mode, workers, options);
+			process.stderr.write(mode + ' x' + workers + ': ' + point.gbPerSec.toFixed(2) + ' GB/s, loop delay p99 ' + point.loopDelayP99.toFixed(2) + ' ms\n');
+			return point;
+		});
+		for (const point of curves[mode]) {
+			point.speedup = point.gbPerSec / curves[mode][0].gbPerSec;
+		}
+	}
+	process.stdout.write(JSON.stringify({
+		node: process.version,
+		cpus: os.cpus().length,
+		size: options.size,
+		seconds: options.seconds,
+		curves
+	}, null, '\t') + '\n');
+}
+
+if (isMainThread) {
+	main();
+} else {
+	hashHere(workerData.mode, workerData.seconds, workerData.size).then(bytes => parentPort.postMessage(bytes));
+}
@@ -0,0 +1,173 @@
+"use strict";
+
+/*
+ * Throughput and latency of every algorithm and API across input sizes,
+ * printed as JSON, next to node:crypto's blake2b512 and blake2s256.
+ *
+ *   npm run bench -- [--baseline file] [--save file] [--threshold 0.1]
+ *                    [--filter regex] [--max-size bytes] [--time seconds]
+ *
+ * With --baseline, every case is compared against the ops/s stored in that
+ * file (the output of an earlier run, e.g. written with --save), and the
+ * run exits with status 1 if any is slower by more than --threshold.
+ */
+
+const blake2 = require('../index');
+const crypto = require('crypto');
+const fs = require('fs');
+const os = require('os');
+const stream = require('stream');
+const {parseArgs, measure, formatSize} = require('./common');
+
+const options = parseArgs(process.argv.slice(2), {
+	baseline: '',
+	save: '',
+	threshold: 0.1,
+	filter: '',
+	maxSize: 256 * 1024 * 1024,
+	time: 0.5
+});
+
+const ALGORITHMS = ['blake2b', 'blake2bp', 'blake2s', 'blake2sp'];
+const SIZES = [0, 64, 1024, 16 * 1024, 1024 * 1024, 16 * 1024 * 1024, 256 * 1024 * 1024]
+	.filter(size => size <= options.maxSize);
+const NODE_CRYPTO = {blake2b: 'blake2b512', blake2s: 'blake2s256'};
+
+// Chunk size of the readable stream in the stream cases
+const STREAM_CHUNK = 64 * 1024;
+const PIECE_SIZE = 256 * 1024;
+const KEY = Buffer.alloc(32, 0x6b);
+
+const data = Buffer.alloc(Math.max(...SIZES), 0xa5);
+const nodeHashes = crypto.getHashes();
+
+function chunksOf(buffer) {
+	const chunks = [];
+	for (let at = 0; at < buffer.length; at += STREAM_CHUNK) {
+		chunks.push(buffer.subarray(at, at + STREAM_CHUNK));
+	}
+	return chunks;
+}
+
+function pipeOnce(algorithm, chunks) {
+	return new Promise(function(resolve, reject) {
+		stream.Readable.from(chunks, {objectMode: false})
+			.pipe(blake2.createHash(algorithm))
+			.on('error', reject)
+			.once('data', resolve);
+	});
+}
+
+/**
+ * Every case as {api, algorithm, size, op, async}
+ */
+function cases() {
+	const all = [];
+	for (const algorithm of ALGORITHMS) {
+		for (const size of SIZES) {
+			const input = data.subarray(0, size);
+			all.push({api: 'hash', algorithm, size, op: () => blake2.createHash(algorithm).update(input).digest()});
+			all.push({api: 'keyed', algorithm, size, op: () => blake2.createKeyedHash(algorithm, KEY).update(input).digest()});
+			all.push({api: 'hasher', algorithm, size, op: () => blake2.createHasher(algorithm).update(input).digest()});
+			if (size >= STREAM_CHUNK) {
+				const chunks = chunksOf(input);
+				all.push({api: 'stream', algorithm, size, async: true, op: () => pipeOnce(algorithm, chunks)});
+			}
+			if (size >= PIECE_SIZE) {
+				all.push({api: 'pieces', algorithm, size, async: true, op: () => blake2.hashPieces(input, PIECE_SIZE, algorithm)});
+			}
+			const nodeName = NODE_CRYPTO[algorithm];
+			if (nodeName && nodeHashes.includes(nodeName)) {
+				all.push({api: 'node:crypto', algorithm, size, op: () => crypto.createHash(nodeName).update(input).digest()});
+			}
+		}
+		const base = blake2.createHash(algorithm).update(data.subarray(0, 1000));
+		all.push({api: 'copy', algorithm, size: 0, op: () => base.copy().digest()});
+	}
+	for (const size of SIZES.filter(size => size <= 1024)) {
+		const values = [];
+		for (let i = 0; i < 1024; i++) {
+			values.push(data.subarray(0, size));
+		}
+		// One op is one value, so ops/s are values per second
+		all.push({api: 'hash64Many', algorithm: 'blake2s', size, batch: values.length, op: () => blake2.hash64Many(KEY, values)});
+	}
+	return all;
+}
+
+function caseName(c) {
+	return c.api + '/' + c.algorithm + '/' + formatSize(c.size);
+}
+
+async function main() {
+	const filter = options.filter ? new RegExp(options.filter) : null;
+	const results = [];
+	for (const c of cases()) {
+		const name = caseName(c);
+		if (filter && !filter.test(name)) {
+			continue;
+		}
+		const m = await measure(c.op, options.time, c.async);
+		const per = c.batch || 1;
+		const opsPerSec = m.ops * per / m.seconds;
+		results.push({
+			name,
+			api: c.api,
+			algorithm: c.algorithm,
+			size: c.size,
+			opsPerSec,
+			gbPerSec: opsPerSec * c.size / 1e9,
+			p50: m.p50 / per,
+			p99: m.p99 / per
+		});
+		process.stderr.write(name + ': ' + Math.round(opsPerSec) + ' ops/s\n');
+	}
+
+	const byName = new Map(results.map(r => [r.name, r]));
+	for (const r of results) {
+		const nodeName = r.api === 'hash' && NODE_CRYPTO[r.algorithm];
+		const node = nodeName && byName.get('node:crypto/' + r.algorithm + '/' + formatSize(r.size));
+		if (node) {
+			r.vsNodeCrypto = r.opsPerSec / node.opsPerSec;
+		}
+	}
+
+	const regressions = [];
+	if (options.baseline) {
+		const baseline = new Map(JSON.parse(fs.readFileSync(options.baseline, 'utf8')).results.map(r => [r.name, r]));
+		for (const r of results) {
+			const before = baseline.get(r.name);
+			if (!before) {
+				continue;
+			}
+			r.vsBaseline = r.opsPerSec / before.opsPerSec;
+			if (r.vsBaseline < 1 - options.threshold) {
+				regressions.push(r.name);
+			}
+		}
+	}
+
+	const report = {
+		node: process.version,
+		arch: process.arch,
+		cpu: os.cpus()[0].model,
+		date: new Date().toISOString(),
+		threshold: options.threshold,
+		regressions,
+		results
+	};
+	const json = JSON.stringify(report, null, '\t');
+	if (options.save) {
+		fs.writeFileSync(options.save, json + '\n');
+	}
+	process.stdout.write(json + '\n');
+	if (regressions.length) {
+		process.stderr.write('Slower than the baseline by more than ' + (options.threshold * 100) + '%: ' + regressions.join(', ') + '\n');
+		process.exitCode = 1;
+	}
+}
+
+main().catch(function(err) {
+	process.stderr.write(err.stack + '\n');
+	process.exitCode = 2;
+});
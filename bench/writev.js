@@ -0,0 +1,62 @@
+"use strict";
+
+/*
+ * Writes 1 KiB chunks into a hash stream in corked bursts, the way a socket
+ * or a fast producer delivers them, with and without _writev.
+ *
+ *   node bench/writev.js [totalMiB] [chunkBytes] [burst]
+ */
+
+const blake2 = require('../index');
+
+const totalBytes = (Number(process.argv[2]) || 256) * 1024 * 1024;
+const chunkBytes = Number(process.argv[3]) || 1024;
+const burst = Number(process.argv[4]) || 64;
+
+const chunks = [];
+for (let i = 0; i < burst; i++) {
+	chunks.push(Buffer.alloc(chunkBytes, i));
+}
+
+function run(algorithm, writev) {
+	return new Promise(function(resolve) {
+		const hash = blake2.createHash(algorithm);
+		if (!writev) {
+			hash._writev = null;
+		}
+		const start = process.hrtime.bigint();
+		let written = 0;
+		hash.on('data', function() {
+			const seconds = Number(process.hrtime.bigint() - start) / 1e9;
+			resolve(written / seconds / 1e6);
+		});
+		(function writeBurst() {
+			hash.cork();
+			for (let i = 0; i < burst; i++) {
+				hash.write(chunks[i]);
+			}
+			written += burst * chunkBytes;
+			process.nextTick(function() {
+				hash.uncork();
+				if (written < totalBytes) {
+					setImmediate(writeBurst);
+				} else {
+					hash.end();
+				}
+			});
+		})();
+	});
+}
+
+async function main() {
+	// Untimed round so that both paths are optimized before they are measured
+	await run('blake2b', false);
+	await run('blake2b', true);
+	for (const algorithm of ['blake2b', 'blake2s']) {
+		const without = await run(algorithm, false);
+		const withWritev = await run(algorithm, true);
+		console.log(`${algorithm} ${chunkBytes} B chunks: _transform ${without.toFixed(0)} MB/s, _writev ${withWritev.toFixed(0)} MB/s (${(withWritev / without).toFixed(2)}x)`);
+	}
+}
+
+main();
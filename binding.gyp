@@ -7,6 +7,24 @@
 				["target_arch == 'x64' or target_arch == 'ia32'", {
 					"sources": [
 						"src/blake2.cpp",
+						"src/any_blake2.cpp",
+						"src/chunker.cpp",
+						"src/blake2_lanes.cpp",
+						"src/file_io.cpp",
+						"src/pieces.cpp",
+						"src/thread_pool.cpp",
+						"src/tree.cpp",
+						"src/digest_cache.cpp",
+						"src/chain.cpp",
+						"src/hash64.cpp",
+						"src/rendezvous.cpp",
+						"src/bloom_filter.cpp",
+						"src/digest_set.cpp",
+						"src/multi_hash.cpp",
+						"src/stats.cpp",
+						"src/trace.cpp",
+						"src/tuning.cpp",
+						"src/hash_arena.cpp",
 						"src/BLAKE2/sse/blake2b.c",
 						"src/BLAKE2/sse/blake2bp.c",
 						"src/BLAKE2/sse/blake2s.c",
@@ -20,6 +38,24 @@
 				["target_arch == 'arm64'", {
 					"sources": [
 						"src/blake2.cpp",
+						"src/any_blake2.cpp",
+						"src/chunker.cpp",
+						"src/blake2_lanes.cpp",
+						"src/file_io.cpp",
+						"src/pieces.cpp",
+						"src/thread_pool.cpp",
+						"src/tree.cpp",
+						"src/digest_cache.cpp",
+						"src/chain.cpp",
+						"src/hash64.cpp",
+						"src/rendezvous.cpp",
+						"src/bloom_filter.cpp",
+						"src/digest_set.cpp",
+						"src/multi_hash.cpp",
+						"src/stats.cpp",
+						"src/trace.cpp",
+						"src/tuning.cpp",
+						"src/hash_arena.cpp",
 						"src/BLAKE2/neon/blake2b-neon.c",
 						"src/BLAKE2/neon/blake2bp.c",
 						"src/BLAKE2/neon/blake2s-neon.c",
@@ -33,6 +69,24 @@
 				["target_arch != 'x64' and target_arch != 'ia32' and target_arch != 'arm64'", {
 					"sources": [
 						"src/blake2.cpp",
+						"src/any_blake2.cpp",
+						"src/chunker.cpp",
+						"src/blake2_lanes.cpp",
+						"src/file_io.cpp",
+						"src/pieces.cpp",
+						"src/thread_pool.cpp",
+						"src/tree.cpp",
+						"src/digest_cache.cpp",
+						"src/chain.cpp",
+						"src/hash64.cpp",
+						"src/rendezvous.cpp",
+						"src/bloom_filter.cpp",
+						"src/digest_set.cpp",
+						"src/multi_hash.cpp",
+						"src/stats.cpp",
+						"src/trace.cpp",
+						"src/tuning.cpp",
+						"src/hash_arena.cpp",
 						"src/BLAKE2/ref/blake2b-ref.c",
 						"src/BLAKE2/ref/blake2bp-ref.c",
 						"src/BLAKE2/ref/blake2s-ref.c",
@@ -5,6 +5,8 @@
 
 "use strict";
 
+const crypto = require('crypto');
+const fs = require('fs');
 const stream = require('stream');
 const binding = require('./build/Release/blake2');
 
@@ -40,6 +42,250 @@ class LazyTransform extends stream.Transform {
 	});
 });
 
+// Sizes at which hashing switches strategy, as measured by calibrate().  The
+// addon keeps the first ones, in this order; the rest are used here:
+//   deferBytes  a Hasher holds updates up to this long back as a copy, so
+//               that a short input reaches the addon with the digest call
+//   offloadMin  with offload, hash stream chunks at least this long go to
+//               the threadpool
+//   backends    the backend plain hashes use, per algorithm and size class
+const NATIVE_TUNING = ['coalesceBelow', 'multiHashTile', 'piecesLanesMaxSize', 'piecesParallelMinBytes', 'rendezvousTaskKeys'];
+
+function tuningFromNative(values) {
+	const profile = {};
+	NATIVE_TUNING.forEach((name, i) => { profile[name] = values[i]; });
+	return profile;
+}
+
+// node:crypto's OpenSSL implementations can stand in for the bundled
+// kernels for these algorithms, unkeyed and at their full digest length
+const CRYPTO_ALGORITHMS = {blake2b: 'blake2b512', blake2s: 'blake2s256'};
+const CRYPTO_DIGEST_LENGTHS = {blake2b: 64, blake2s: 32};
+
+// Size classes for choosing a backend: inputs below the first bound are
+// small, below the second medium, the rest large
+const BACKEND_SIZE_CLASSES = ['small', 'medium', 'large'];
+const BACKEND_SIZE_BOUNDS = [1024, 64 * 1024];
+const BACKENDS = ['native', 'crypto'];
+
+const JS_TUNING_DEFAULTS = {deferBytes: 64, offloadMin: 64 * 1024, backends: defaultBackends()};
+const tuning = Object.assign(tuningFromNative(binding.getTuning()[0]), JS_TUNING_DEFAULTS);
+
+function defaultBackends() {
+	const backends = {};
+	for (const algorithm of Object.keys(CRYPTO_ALGORITHMS)) {
+		backends[algorithm] = {small: 'native', medium: 'native', large: 'native'};
+	}
+	return backends;
+}
+
+function sizeClass(sizeHint) {
+	const i = BACKEND_SIZE_BOUNDS.findIndex(bound => sizeHint < bound);
+	return BACKEND_SIZE_CLASSES[i === -1 ? BACKEND_SIZE_BOUNDS.length : i];
+}
+
+let cryptoVerified = null;
+
+/**
+ * Whether node:crypto provides `algorithm` here and reproduces every
+ * unkeyed known-answer vector of the reference implementation; checked once
+ * per process, when first asked.
+ */
+function cryptoBackendVerified(algorithm) {
+	if (!cryptoVerified) {
+		cryptoVerified = {};
+		const available = crypto.getHashes();
+		const vectors = require('./src/BLAKE2/testvectors/blake2-kat.json');
+		for (const name of Object.keys(CRYPTO_ALGORITHMS)) {
+			cryptoVerified[name] = available.includes(CRYPTO_ALGORITHMS[name]) && vectors
+				.filter(vector => vector.hash === name && vector.key === '')
+				.every(vector => crypto.createHash(CRYPTO_ALGORITHMS[name]).update(Buffer.from(vector.in, 'hex')).digest('hex') === vector.out);
+		}
+	}
+	return Boolean(cryptoVerified[algorithm]);
+}
+
+/**
+ * A node:crypto hash behind the same methods as the addon's Hash handles
+ */
+class CryptoHandle {
+	constructor(name) {
+		this._name = name;
+		this._hash = crypto.createHash(name);
+	}
+
+	update(buf) {
+		if (!this._hash) {
+			throw new Error("Not initialized");
+		}
+		if (!ArrayBuffer.isView(buf)) {
+			throw new TypeError("Bad argument; need a Buffer");
+		}
+		this._hash.update(buf);
+	}
+
+	updateMany(bufs) {
+		bufs.forEach(buf => this.update(buf));
+	}
+
+	digest(last) {
+		if (last) {
+			this.update(last);
+		} else if (!this._hash) {
+			throw new Error("Not initialized");
+		}
+		const digest = this._hash.digest();
+		this._hash = null;
+		return digest;
+	}
+
+	copy() {
+		if (!this._hash) {
+			throw new Error("Not initialized");
+		}
+		const h = new CryptoHandle(this._name);
+		h._hash = this._hash.copy();
+		return h;
+	}
+}
+
+/**
+ * Picks the backend for a plain hash.  options.backend ('native' or
+ * 'crypto') forces one; otherwise the tuning profile decides by algorithm
+ * and by the size class of options.sizeHint, or `defaultSize` without one.
+ */
+function chooseBackend(algorithm, key, digestLength, options, defaultSize) {
+	const supported = algorithm in CRYPTO_ALGORITHMS && !key &&
+		(digestLength === -1 || digestLength === CRYPTO_DIGEST_LENGTHS[algorithm]);
+	if (options.backend !== undefined && options.backend !== 'native') {
+		if (options.backend !== 'crypto') {
+			throw new TypeError("Backend must be native or crypto");
+		}
+		if (!supported || !cryptoBackendVerified(algorithm)) {
+			throw new TypeError("The crypto backend cannot hash " + algorithm + " with these options");
+		}
+		return 'crypto';
+	}
+	if (options.backend === 'native' || !supported) {
+		return 'native';
+	}
+	const sizeHint = options.sizeHint === undefined ? defaultSize : options.sizeHint;
+	if (tuning.backends[algorithm][sizeClass(sizeHint)] === 'crypto' && cryptoBackendVerified(algorithm)) {
+		return 'crypto';
+	}
+	return 'native';
+}
+
+function newHandle(backend, algorithm, key, digestLength) {
+	if (backend === 'crypto') {
+		return new CryptoHandle(CRYPTO_ALGORITHMS[algorithm]);
+	}
+	return new binding.Hash(algorithm, key, digestLength);
+}
+
+
+/**
+ * With options.checkpointEvery set, emit a 'checkpoint' event with
+ * (offset, digest) each time another checkpointEvery bytes have been hashed,
+ * digest being that of everything up to offset.
+ */
+function setupCheckpoints(hash, algorithm, digestLength, options) {
+	// NaN is falsy but no more valid than 1.5; the addon rejects both
+	const every = options && options.checkpointEvery;
+	if (every || Number.isNaN(every)) {
+		hash._handle.setCheckpointEvery(options.checkpointEvery);
+		if (digestLength === -1) {
+			digestLength = /^blake2b/.test(algorithm) ? 64 : 32;
+		}
+		hash._checkpointRecordLength = 8 + digestLength;
+	}
+}
+
+function emitCheckpoints(hash, records) {
+	const recordLength = hash._checkpointRecordLength;
+	for (let i = 0; i < records.length; i += recordLength) {
+		const offset = records.readUInt32LE(i) + records.readUInt32LE(i + 4) * 2**32;
+		hash.emit('checkpoint', offset, records.slice(i + 8, i + recordLength));
+	}
+}
+
+// Bytes an offloaded hash may have queued before its stream applies
+// backpressure
+const OFFLOAD_BUDGET = 4 * 1024 * 1024;
+
+/**
+ * With options.offload set, update() queues Buffers to be absorbed on the
+ * libuv threadpool, one batch at a time, and digest() returns a promise.
+ * The Buffers must not be modified until they have been absorbed.
+ */
+function setupOffload(hash, options) {
+	if (options && options.offload) {
+		if (options.checkpointEvery) {
+			throw new TypeError("checkpointEvery cannot be combined with offload");
+		}
+		hash._offload = newOffloadState(options.offloadBudget || OFFLOAD_BUDGET);
+	}
+}
+
+function newOffloadState(budget) {
+	return {
+		budget,
+		queue: [],
+		queuedBytes: 0,
+		// Bytes queued or being absorbed
+		pendingBytes: 0,
+		running: false,
+		// A _transform callback held back until pendingBytes is within budget
+		blocked: null,
+		drainWaiters: []
+	};
+}
+
+function offloadUpdate(hash, buf) {
+	if (!Buffer.isBuffer(buf)) {
+		throw new TypeError("Bad argument; need a Buffer");
+	}
+	const state = hash._offload;
+	state.queue.push(buf);
+	state.queuedBytes += buf.length;
+	state.pendingBytes += buf.length;
+	pumpOffload(hash);
+}
+
+function pumpOffload(hash) {
+	const state = hash._offload;
+	if (state.running || state.queue.length === 0) {
+		return;
+	}
+	const chunks = state.queue;
+	const bytes = state.queuedBytes;
+	state.queue = [];
+	state.queuedBytes = 0;
+	state.running = true;
+	hash._handle.updateAsync(chunks, function() {
+		state.running = false;
+		state.pendingBytes -= bytes;
+		pumpOffload(hash);
+		if (state.blocked && state.pendingBytes <= state.budget) {
+			const callback = state.blocked;
+			state.blocked = null;
+			callback();
+		}
+		if (!state.running) {
+			const waiters = state.drainWaiters;
+			state.drainWaiters = [];
+			waiters.forEach(resolve => resolve());
+		}
+	});
+}
+
+function offloadDrained(hash) {
+	const state = hash._offload;
+	if (!state.running) {
+		return Promise.resolve();
+	}
+	return new Promise(resolve => state.drainWaiters.push(resolve));
+}
 
 class Hash extends LazyTransform {
 	constructor(algorithm, options) {
@@ -49,25 +295,70 @@ class Hash extends LazyTransform {
 		if (options && 'digestLength' in options) {
 			digestLength = options.digestLength;
 		}
-		this._handle = new binding.Hash(algorithm, null, digestLength);
+		// Checkpoints and offload need the addon
+		const plain = !(options && (options.checkpointEvery || Number.isNaN(options.checkpointEvery) || options.offload));
+		const backend = plain ? chooseBackend(algorithm, null, digestLength, options || {}, Infinity) : 'native';
+		this._handle = newHandle(backend, algorithm, null, digestLength);
+		setupCheckpoints(this, algorithm, digestLength, options);
+		setupOffload(this, options);
 	}
 
 	_transform(chunk, encoding, callback) {
-		this._handle.update(chunk, encoding);
-		callback();
+		this.update(chunk);
+		this._afterWrite(callback);
+	}
+
+	// Everything written since the last callback, in one native call
+	_writev(chunks, callback) {
+		if (this._offload || this._checkpointRecordLength) {
+			chunks.forEach(entry => this.update(entry.chunk));
+		} else {
+			this._handle.updateMany(chunks.map(entry => entry.chunk));
+		}
+		this._afterWrite(callback);
+	}
+
+	_afterWrite(callback) {
+		if (this._offload && this._offload.pendingBytes > this._offload.budget) {
+			this._offload.blocked = callback;
+		} else {
+			callback();
+		}
 	}
 
 	_flush(callback) {
+		if (this._offload) {
+			offloadDrained(this).then(() => {
+				this.push(this._handle.digest());
+				callback();
+			});
+			return;
+		}
 		this.push(this._handle.digest());
 		callback();
 	}
 
 	update(buf) {
-		this._handle.update(buf);
+		if (this._offload) {
+			offloadUpdate(this, buf);
+		} else if (this._checkpointRecordLength) {
+			const records = this._handle.updateCheckpoints(buf);
+			if (records) {
+				emitCheckpoints(this, records);
+			}
+		} else {
+			this._handle.update(buf);
+		}
 		return this;
 	}
 
 	digest(outputEncoding) {
+		if (this._offload) {
+			return offloadDrained(this).then(() => {
+				this._offload = null;
+				return this.digest(outputEncoding);
+			});
+		}
 		const buf = this._handle.digest();
 		if(outputEncoding) {
 			return buf.toString(outputEncoding);
@@ -76,8 +367,15 @@ class Hash extends LazyTransform {
 	}
 
 	copy() {
+		if (this._offload && this._offload.pendingBytes > 0) {
+			throw new Error("Cannot copy while offloaded updates are pending");
+		}
 		const h = new this.constructor("bypass");
 		h._handle = this._handle.copy();
+		h._checkpointRecordLength = this._checkpointRecordLength;
+		if (this._offload) {
+			h._offload = newOffloadState(this._offload.budget);
+		}
 		return h;
 	}
 }
@@ -96,6 +394,8 @@ class KeyedHash extends LazyTransform {
 			digestLength = options.digestLength;
 		}
 		this._handle = new binding.Hash(algorithm, key, digestLength);
+		setupCheckpoints(this, algorithm, digestLength, options);
+		setupOffload(this, options);
 	}
 }
 
@@ -104,9 +404,1313 @@ KeyedHash.prototype.digest = Hash.prototype.digest;
 KeyedHash.prototype.copy = Hash.prototype.copy;
 KeyedHash.prototype._flush = Hash.prototype._flush;
 KeyedHash.prototype._transform = Hash.prototype._transform;
+KeyedHash.prototype._writev = Hash.prototype._writev;
+KeyedHash.prototype._afterWrite = Hash.prototype._afterWrite;
 
 function createKeyedHash(algorithm, key, options) {
 	return new KeyedHash(algorithm, key, options);
 }
 
-module.exports = {Hash, createHash, KeyedHash, createKeyedHash};
+/**
+ * Normalizes a multi-hash spec, given as an algorithm name or as
+ * {algorithm, key, digestLength}, to the [algorithm, key, digestLength]
+ * form the addon takes.
+ */
+function multiHashSpec(spec) {
+	if (typeof spec === 'string') {
+		return [spec, null, -1];
+	}
+	return [
+		spec.algorithm,
+		spec.key || null,
+		'digestLength' in spec ? spec.digestLength : -1
+	];
+}
+
+/**
+ * Computes one digest per spec over the same data in a single pass.  As a
+ * stream it emits the array of digests when the input ends.
+ */
+class MultiHash extends LazyTransform {
+	constructor(specs, options) {
+		super(Object.assign({}, options, {readableObjectMode: true}));
+		this._handle = new binding.MultiHash(specs.map(multiHashSpec));
+	}
+
+	_transform(chunk, encoding, callback) {
+		this._handle.update(chunk);
+		callback();
+	}
+
+	_flush(callback) {
+		this.push(this._handle.digest());
+		callback();
+	}
+
+	update(buf) {
+		this._handle.update(buf);
+		return this;
+	}
+
+	/** One digest per spec, as Buffers or strings in outputEncoding. */
+	digest(outputEncoding) {
+		const digests = this._handle.digest();
+		if (outputEncoding) {
+			return digests.map(buf => buf.toString(outputEncoding));
+		}
+		return digests;
+	}
+}
+
+function createMultiHash(specs, options) {
+	return new MultiHash(specs, options);
+}
+
+/**
+ * Hashes a Buffer or a file once for every spec, reading it only once, on
+ * the libuv threadpool.  Resolves to one digest per spec.
+ */
+function hashMulti(input, specs) {
+	return new Promise(function(resolve, reject) {
+		binding.hashMulti(input, specs.map(multiHashSpec), function(err, digests) {
+			if (err) {
+				reject(err);
+			} else {
+				resolve(digests);
+			}
+		});
+	});
+}
+
+/**
+ * A plain hash object without any stream machinery.  Constructing one and
+ * hashing a short input takes two native calls; stream() wraps it in a
+ * Transform when one is needed.
+ */
+class Hasher {
+	constructor(algorithm, options) {
+		options = options || {};
+		this._algorithm = algorithm;
+		this._key = options.key || null;
+		this._digestLength = 'digestLength' in options ? options.digestLength : -1;
+		if (algorithm === 'bypass') {
+			this._backend = 'native';
+			this._handle = null;
+		} else {
+			this._backend = chooseBackend(algorithm, this._key, this._digestLength, options, 0);
+			this._handle = newHandle(this._backend, algorithm, this._key, this._digestLength);
+		}
+		this._pending = null;
+	}
+
+	update(buf) {
+		if (this._pending) {
+			this._handle.update(this._pending);
+			this._pending = null;
+		}
+		if (ArrayBuffer.isView(buf) && buf.byteLength <= tuning.deferBytes) {
+			// Copies the bytes of the view, whatever its element type
+			this._pending = Buffer.from(new Uint8Array(buf.buffer, buf.byteOffset, buf.byteLength));
+		} else {
+			this._handle.update(buf);
+		}
+		return this;
+	}
+
+	digest(outputEncoding) {
+		const buf = this._handle.digest(this._pending);
+		this._pending = null;
+		if (outputEncoding) {
+			return buf.toString(outputEncoding);
+		}
+		return buf;
+	}
+
+	copy() {
+		const h = new Hasher('bypass');
+		h._algorithm = this._algorithm;
+		h._key = this._key;
+		h._digestLength = this._digestLength;
+		h._backend = this._backend;
+		h._handle = this._handle.copy();
+		// Never modified, so both copies can hold the same one
+		h._pending = this._pending;
+		return h;
+	}
+
+	/** Starts over with the same algorithm, key and digest length. */
+	reset() {
+		this._handle = newHandle(this._backend, this._algorithm, this._key, this._digestLength);
+		this._pending = null;
+		return this;
+	}
+
+	/**
+	 * A Transform that feeds this hasher and emits its digest when the input
+	 * ends.
+	 */
+	stream(options) {
+		const hasher = this;
+		return new stream.Transform(Object.assign({}, options, {
+			transform(chunk, encoding, callback) {
+				hasher.update(chunk);
+				callback();
+			},
+			writev(chunks, callback) {
+				if (hasher._pending) {
+					hasher._handle.update(hasher._pending);
+					hasher._pending = null;
+				}
+				hasher._handle.updateMany(chunks.map(entry => entry.chunk));
+				callback();
+			},
+			flush(callback) {
+				callback(null, hasher.digest());
+			}
+		}));
+	}
+}
+
+function createHasher(algorithm, options) {
+	return new Hasher(algorithm, options);
+}
+
+/**
+ * Many streaming hashes behind one object.  Each is an integer handle into
+ * native slabs of exactly sized states instead of an object of its own, so
+ * hundreds of thousands of open hashes cost the garbage collector nothing
+ * and sit close together in memory.  A handle is taken until free(), even
+ * once digested.
+ */
+class HashArena {
+	constructor() {
+		this._handle = new binding.HashArena();
+	}
+
+	/** Starts a hash and returns its handle; options take key and digestLength. */
+	create(algorithm, options) {
+		options = options || {};
+		return this._handle.create(
+			algorithm || 'blake2b',
+			options.key || null,
+			'digestLength' in options ? options.digestLength : -1
+		);
+	}
+
+	update(handle, buf) {
+		this._handle.update(handle, buf);
+		return this;
+	}
+
+	digest(handle, outputEncoding) {
+		const buf = this._handle.digest(handle);
+		if (outputEncoding) {
+			return buf.toString(outputEncoding);
+		}
+		return buf;
+	}
+
+	/** A new handle to a copy of the hash. */
+	copy(handle) {
+		return this._handle.copy(handle);
+	}
+
+	/** Updates the hash behind each [handle, buf] entry, as updateBatch() does. */
+	updateBatch(entries) {
+		binding.updateBatch(entries, this._handle);
+		return this;
+	}
+
+	free(handle) {
+		this._handle.free(handle);
+	}
+
+	/** The number of handles taken. */
+	get size() {
+		return this._handle.size();
+	}
+}
+
+function createHashArena() {
+	return new HashArena();
+}
+
+// The addon's hash behind a Hash, KeyedHash or Hasher, or null if it has to
+// be updated through its own update()
+function batchHandle(hash) {
+	if (hash instanceof Hash || hash instanceof KeyedHash) {
+		if (hash._offload || hash._checkpointRecordLength) {
+			return null;
+		}
+	} else if (!(hash instanceof Hasher)) {
+		return null;
+	}
+	return hash._handle instanceof CryptoHandle ? null : hash._handle;
+}
+
+const NO_BYTES = Buffer.alloc(0);
+
+// Throws if a hash updated through its own update() could not take input,
+// or has the addon check it along with the batch
+function checkBatchFallback(hash, native) {
+	if (hash._handle instanceof CryptoHandle) {
+		hash._handle.update(NO_BYTES);
+	} else if (hash._checkpointRecordLength && !hash._offload) {
+		native.push([hash._handle, NO_BYTES]);
+	}
+}
+
+/**
+ * Updates each hash of a list of [hash, buf] entries with its buffer, with
+ * the same result as calling hash.update(buf) for each in turn.  BLAKE2b and
+ * BLAKE2s hashes are advanced together, several blocks side by side, which
+ * pays off for many hashes fed small buffers.
+ */
+function updateBatch(entries) {
+	if (!Array.isArray(entries)) {
+		throw new TypeError('Bad argument; need an array of [hash, Buffer] entries');
+	}
+	// Nothing changes until every entry has been checked; entries that
+	// cannot be batched then follow the batch, which keeps the order of each
+	// hash's updates since no hash is in both
+	const native = [];
+	const fallback = [];
+	const flushed = new Set();
+	for (const entry of entries) {
+		if (!Array.isArray(entry) || entry.length !== 2 || !entry[0] || typeof entry[0].update !== 'function') {
+			throw new TypeError('Bad argument; need an array of [hash, Buffer] entries');
+		}
+		if (!ArrayBuffer.isView(entry[1])) {
+			throw new TypeError('Bad argument; need a Buffer');
+		}
+		const hash = entry[0];
+		const handle = batchHandle(hash);
+		if (!handle) {
+			checkBatchFallback(hash, native);
+			fallback.push(entry);
+			continue;
+		}
+		// A Hasher's deferred input goes first; it is only dropped once the
+		// batch has been taken
+		if (hash._pending && !flushed.has(hash)) {
+			native.push([handle, hash._pending]);
+			flushed.add(hash);
+		}
+		native.push([handle, entry[1]]);
+	}
+	binding.updateBatch(native);
+	for (const hasher of flushed) {
+		hasher._pending = null;
+	}
+	for (const [hash, buf] of fallback) {
+		hash.update(buf);
+	}
+}
+
+// Chunks shorter than tuning.coalesceBelow are copied together, up to this
+// many bytes, before they reach the addon
+const FEED_STAGING_BYTES = 16 * 1024;
+
+/**
+ * Feeds chunks from a web stream or an async iterable to a native hash.
+ * Small chunks are copied into a staging buffer and reach the addon
+ * together; larger ones go with whatever is staged in one updateMany call,
+ * or with offload to the threadpool.  A chunk may be reused once write()
+ * returns, or once the promise it returns for an offloaded chunk resolves.
+ */
+class ChunkFeeder {
+	constructor(algorithm, options) {
+		options = options || {};
+		this._handle = new binding.Hash(
+			algorithm || 'blake2b',
+			options.key || null,
+			'digestLength' in options ? options.digestLength : -1
+		);
+		this._offload = Boolean(options.offload);
+		this._staging = Buffer.allocUnsafe(FEED_STAGING_BYTES);
+		this._staged = 0;
+	}
+
+	write(chunk) {
+		if (typeof chunk === 'string') {
+			chunk = Buffer.from(chunk);
+		} else if (ArrayBuffer.isView(chunk)) {
+			chunk = Buffer.from(chunk.buffer, chunk.byteOffset, chunk.byteLength);
+		} else {
+			throw new TypeError("Chunks must be strings, Buffers or typed arrays");
+		}
+
+		if (chunk.length < Math.min(tuning.coalesceBelow, FEED_STAGING_BYTES)) {
+			if (this._staged + chunk.length > FEED_STAGING_BYTES) {
+				this._handle.update(this._staging.subarray(0, this._staged));
+				this._staged = 0;
+			}
+			chunk.copy(this._staging, this._staged);
+			this._staged += chunk.length;
+			return undefined;
+		}
+
+		const chunks = [];
+		if (this._offload && chunk.length >= tuning.offloadMin) {
+			if (this._staged) {
+				// The staging buffer is reused before the threadpool gets to it
+				chunks.push(Buffer.from(this._staging.subarray(0, this._staged)));
+				this._staged = 0;
+			}
+			chunks.push(chunk);
+			return new Promise(resolve => this._handle.updateAsync(chunks, resolve));
+		}
+		if (this._staged) {
+			chunks.push(this._staging.subarray(0, this._staged));
+			this._staged = 0;
+		}
+		chunks.push(chunk);
+		this._handle.updateMany(chunks);
+		return undefined;
+	}
+
+	digest() {
+		const last = this._staged ? this._staging.subarray(0, this._staged) : null;
+		this._staged = 0;
+		return this._handle.digest(last);
+	}
+}
+
+function webStreams() {
+	return typeof TransformStream === 'function' ? {TransformStream} : require('stream/web');
+}
+
+/**
+ * A WHATWG TransformStream that hashes what is written to it and enqueues
+ * the digest when its writable side closes.
+ */
+function createHashStream(algorithm, options) {
+	const feeder = new ChunkFeeder(algorithm, options);
+	const transformer = {
+		transform(chunk) {
+			return feeder.write(chunk);
+		},
+		flush(controller) {
+			controller.enqueue(feeder.digest());
+		}
+	};
+	// The readable side only ever holds the digest; without room for it,
+	// writes would wait for a reader
+	return new (webStreams().TransformStream)(transformer, undefined, {highWaterMark: 1});
+}
+
+/**
+ * Hashes every chunk of an async (or sync) iterable and resolves to the
+ * digest.  options are {algorithm, key, digestLength, offload}.
+ */
+async function hashAsyncIterable(iterable, options) {
+	options = options || {};
+	const feeder = new ChunkFeeder(options.algorithm, options);
+	const iterator = iterable[Symbol.asyncIterator] ? iterable[Symbol.asyncIterator]() : iterable[Symbol.iterator]();
+	try {
+		for (;;) {
+			const {done, value} = await iterator.next();
+			if (done) {
+				break;
+			}
+			const absorbed = feeder.write(value);
+			if (absorbed) {
+				await absorbed;
+			}
+		}
+	} catch (err) {
+		if (typeof iterator.return === 'function') {
+			await iterator.return();
+		}
+		throw err;
+	}
+	return feeder.digest();
+}
+
+const DEFAULT_AVG_CHUNK_SIZE = 64 * 1024;
+
+function chunkerArguments(options) {
+	options = options || {};
+	const avgSize = options.avgSize || DEFAULT_AVG_CHUNK_SIZE;
+	return [
+		options.algorithm || 'blake2b',
+		options.key || null,
+		'digestLength' in options ? options.digestLength : -1,
+		options.minSize || Math.max(64, Math.floor(avgSize / 4)),
+		avgSize,
+		options.maxSize || avgSize * 4
+	];
+}
+
+/**
+ * Transform that splits its input at content-defined boundaries and
+ * hashes every chunk on the way through.  The readable side yields
+ * packed records of (offset: u64 LE, length: u32 LE, digest); see
+ * parseChunkRecords().
+ */
+class Chunker extends stream.Transform {
+	constructor(options) {
+		super();
+		this._handle = new binding.Chunker(...chunkerArguments(options));
+		this.recordLength = this._handle.recordLength;
+	}
+
+	_transform(chunk, encoding, callback) {
+		const records = this._handle.update(chunk);
+		if (records.length) {
+			this.push(records);
+		}
+		callback();
+	}
+
+	_flush(callback) {
+		const records = this._handle.final();
+		if (records.length) {
+			this.push(records);
+		}
+		callback();
+	}
+}
+
+function createChunker(options) {
+	return new Chunker(options);
+}
+
+/**
+ * Chunks and hashes a whole file off the main thread; resolves to the
+ * same packed records a Chunker would have produced.
+ */
+function chunkFile(path, options) {
+	const args = chunkerArguments(options);
+	return new Promise(function(resolve, reject) {
+		binding.chunkFile(path, ...args, function(err, records) {
+			if (err) {
+				reject(err);
+			} else {
+				resolve(records);
+			}
+		});
+	});
+}
+
+// Bytes of a stream collected before its whole pieces are hashed natively
+const PIECES_STREAM_BATCH = 32 * 1024 * 1024;
+
+function hashPiecesNative(source, pieceSize, args) {
+	return new Promise(function(resolve, reject) {
+		binding.hashPieces(source, pieceSize, ...args, function(err, digests) {
+			if (err) {
+				reject(err);
+			} else {
+				resolve(digests);
+			}
+		});
+	});
+}
+
+/**
+ * Hashes a readable stream piece by piece.  At most one batch is being
+ * hashed while the next one is read, so memory stays bounded by about two
+ * batches however long the stream is.
+ */
+function hashStreamPieces(input, pieceSize, args) {
+	const batchSize = Math.max(pieceSize, PIECES_STREAM_BATCH - PIECES_STREAM_BATCH % pieceSize);
+	return new Promise(function(resolve, reject) {
+		let pending = [];
+		let pendingLength = 0;
+		let hashing = false;
+		let ended = false;
+		let failed = false;
+		const digests = [];
+
+		function fail(err) {
+			if (!failed) {
+				failed = true;
+				reject(err);
+			}
+		}
+
+		function next() {
+			if (hashing || failed) {
+				return;
+			}
+			if (pendingLength < batchSize && !ended) {
+				input.resume();
+				return;
+			}
+			if (ended && pendingLength === 0) {
+				resolve(Buffer.concat(digests));
+				return;
+			}
+			const data = Buffer.concat(pending, pendingLength);
+			const take = ended ? data.length : data.length - data.length % pieceSize;
+			pending = [data.slice(take)];
+			pendingLength = data.length - take;
+			hashing = true;
+			hashPiecesNative(data.slice(0, take), pieceSize, args).then(function(batch) {
+				digests.push(batch);
+				hashing = false;
+				next();
+			}, fail);
+		}
+
+		input.on('data', function(chunk) {
+			pending.push(chunk);
+			pendingLength += chunk.length;
+			if (pendingLength >= batchSize) {
+				if (hashing) {
+					input.pause();
+				} else {
+					next();
+				}
+			}
+		});
+		input.on('end', function() {
+			ended = true;
+			next();
+		});
+		input.on('error', fail);
+	});
+}
+
+/**
+ * Splits `input` (a Buffer, a file path or a readable stream) into
+ * pieceSize pieces and resolves to their digests, back to back.
+ * Pieces are hashed concurrently on native threads.
+ */
+function hashPieces(input, pieceSize, algorithm, options) {
+	options = options || {};
+	const args = [
+		algorithm || 'blake2b',
+		options.key || null,
+		'digestLength' in options ? options.digestLength : -1
+	];
+	if (Buffer.isBuffer(input) || typeof input === 'string') {
+		return hashPiecesNative(input, pieceSize, args);
+	}
+	if (input && typeof input.on === 'function') {
+		if (!Number.isInteger(pieceSize) || pieceSize <= 0) {
+			return Promise.reject(new TypeError("pieceSize must be a positive integer"));
+		}
+		return hashStreamPieces(input, pieceSize, args);
+	}
+	return Promise.reject(new TypeError("Input must be a Buffer, a file path or a readable stream"));
+}
+
+/**
+ * Hashes every regular file and symbolic link below `dir` on native threads
+ * and resolves to {root, files}, where root is a canonical digest of the
+ * sorted (path, mode, size, digest) entries and files (only with
+ * opts.files) lists those entries.
+ */
+function hashTree(dir, opts) {
+	opts = opts || {};
+	const digestLength = 'digestLength' in opts ? opts.digestLength : -1;
+	return new Promise(function(resolve, reject) {
+		binding.hashTree(
+			dir,
+			opts.algorithm || 'blake2b',
+			opts.key || null,
+			digestLength,
+			opts.include || null,
+			opts.exclude || null,
+			Boolean(opts.files),
+			opts.cache || null,
+			function(err, root, paths, records, cached) {
+				if (err) {
+					reject(err);
+					return;
+				}
+				const result = {root};
+				if (cached !== undefined) {
+					result.cached = cached;
+				}
+				if (paths) {
+					const recordLength = records.length / Math.max(paths.length, 1);
+					result.files = paths.map(function(path, i) {
+						const at = i * recordLength;
+						return {
+							path,
+							mode: records.readUInt32LE(at),
+							size: records.readUInt32LE(at + 4) + records.readUInt32LE(at + 8) * 2**32,
+							digest: records.slice(at + 12, at + recordLength)
+						};
+					});
+				}
+				resolve(result);
+			}
+		);
+	});
+}
+
+/**
+ * Packs an array of Buffers into one Buffer plus the end offset of each
+ */
+function packRecords(records) {
+	const ends = new Uint32Array(records.length);
+	let end = 0;
+	for (let i = 0; i < records.length; i++) {
+		end += records[i].length;
+		ends[i] = end;
+	}
+	return [Buffer.concat(records, end), ends];
+}
+
+/**
+ * A hash chain where link_i = H(link_{i-1} || record_i).  Records are given
+ * either as an array of Buffers or as one Buffer plus a Uint32Array with the
+ * end offset of every record.
+ */
+class HashChain {
+	constructor(algorithm, options) {
+		options = options || {};
+		this._handle = new binding.HashChain(
+			algorithm,
+			options.key || null,
+			'digestLength' in options ? options.digestLength : -1,
+			options.link || null
+		);
+	}
+
+	get link() {
+		return this._handle.link();
+	}
+
+	/**
+	 * Advances the chain and returns the new last link, or with all set a
+	 * Buffer holding every new link back to back.
+	 */
+	append(records, ends, all) {
+		if (Array.isArray(records)) {
+			all = ends;
+			[records, ends] = packRecords(records);
+		}
+		return this._handle.append(records, ends, Boolean(all));
+	}
+
+	/**
+	 * Rechecks records that followed link `prev` against their links.
+	 * Returns the index of the first link that does not match, or -1.
+	 */
+	verify(prev, records, ends, links) {
+		if (Array.isArray(records)) {
+			links = ends;
+			[records, ends] = packRecords(records);
+		}
+		return this._handle.verify(prev, records, ends, links);
+	}
+}
+
+function createHashChain(algorithm, options) {
+	return new HashChain(algorithm, options);
+}
+
+/**
+ * Keyed 64-bit hashes (8-byte keyed BLAKE2s digests read as little-endian
+ * integers) with the keyed state computed once.
+ */
+class Hash64 {
+	constructor(key) {
+		this._handle = new binding.Hash64(key);
+	}
+
+	/** Hash of one string or Buffer, as a BigInt. */
+	hash(value) {
+		return this._handle.one(value);
+	}
+
+	/**
+	 * Hashes of an array of strings and Buffers, or of the values packed in
+	 * a Buffer that end at each offset of a Uint32Array, as a BigUint64Array.
+	 */
+	hashMany(values, ends) {
+		const hashes = Array.isArray(values) ? this._handle.many(values) : this._handle.many(values, ends);
+		if (hashes.byteOffset % 8 === 0) {
+			return new BigUint64Array(hashes.buffer, hashes.byteOffset, hashes.length / 8);
+		}
+		return new BigUint64Array(new Uint8Array(hashes).buffer);
+	}
+}
+
+function createHash64(key) {
+	return new Hash64(key);
+}
+
+// The last key used with hash64/hash64Many, so that repeated calls with the
+// same key reuse its precomputed state
+let lastHash64 = null;
+let lastHash64Key = null;
+
+function hash64For(key) {
+	if (!lastHash64 || !Buffer.isBuffer(key) || !key.equals(lastHash64Key)) {
+		lastHash64 = new Hash64(key);
+		lastHash64Key = Buffer.from(key);
+	}
+	return lastHash64;
+}
+
+function hash64(key, value) {
+	return hash64For(key).hash(value);
+}
+
+function hash64Many(key, values, ends) {
+	return hash64For(key).hashMany(values, ends);
+}
+
+/**
+ * Node indexes returned by the addon as a Buffer of native-endian u32s
+ */
+function toUint32Array(buffer) {
+	if (buffer.byteOffset % 4 === 0) {
+		return new Uint32Array(buffer.buffer, buffer.byteOffset, buffer.length / 4);
+	}
+	return new Uint32Array(new Uint8Array(buffer).buffer);
+}
+
+/**
+ * Rendezvous (highest random weight) hashing over a fixed list of node ids.
+ * The weight of a node for an object key is the keyed 64-bit hash of the
+ * node id (prefixed with its length as a u32 LE) followed by the object key.
+ */
+class Rendezvous {
+	constructor(key, nodes) {
+		this.nodes = nodes.slice();
+		this._handle = new binding.Rendezvous(key, this.nodes);
+	}
+
+	/** The k nodes (1 by default) with the highest weights, best first. */
+	select(objectKey, k) {
+		const nodes = this.nodes;
+		return Array.from(toUint32Array(this._handle.select(objectKey, k || 1)), function(i) {
+			return nodes[i];
+		});
+	}
+
+	/**
+	 * Selects the k best nodes for an array of strings and Buffers, or for
+	 * the object keys packed in a Buffer that end at each offset of a
+	 * Uint32Array, off the main thread.  Resolves to a Uint32Array holding
+	 * k node indexes per object key.
+	 */
+	selectMany(objectKeys, ends, k) {
+		if (Array.isArray(objectKeys)) {
+			k = ends;
+			ends = null;
+		}
+		return new Promise((resolve, reject) => {
+			this._handle.selectMany(objectKeys, ends, k || 1, function(err, selected) {
+				if (err) {
+					reject(err);
+					return;
+				}
+				resolve(toUint32Array(selected));
+			});
+		});
+	}
+}
+
+function createRendezvous(key, nodes) {
+	return new Rendezvous(key, nodes);
+}
+
+function toBuffer(value) {
+	return typeof value === 'string' ? Buffer.from(value) : value;
+}
+
+const BLOOM_HEADER_BYTES = 64;
+const BLOOM_BLOCK_BITS = 512;
+
+// Keeping every probe of an item in one cache line costs about 15% more bits
+// than a classic filter for the same error rate
+const BLOOM_BLOCK_OVERHEAD = 1.15;
+
+/**
+ * A Bloom filter stored in a Uint8Array, normally over a SharedArrayBuffer
+ * so that worker threads can attach to it with `new BloomFilter(storage)`
+ * and add or query concurrently.  Items are strings or Buffers, hashed with
+ * keyed BLAKE2s, or existing digests of at least 16 bytes used as they are.
+ */
+class BloomFilter {
+	constructor(storage, probes, salt) {
+		if (storage instanceof binding.BloomFilter) {
+			// Already mapped from a file by loadBloomFilter()
+			this._handle = storage;
+		} else {
+			this._handle = probes ? new binding.BloomFilter(storage, probes, salt) : new binding.BloomFilter(storage);
+		}
+		this.storage = this._handle.storage();
+	}
+
+	/** Items added so far, counting repeats. */
+	get count() {
+		return this._handle.count();
+	}
+
+	/**
+	 * Adds an array of strings and Buffers, or the values packed in a
+	 * Buffer that end at each offset of a Uint32Array.
+	 */
+	add(values, ends) {
+		if (!Array.isArray(values) && !ends) {
+			values = [values];
+		}
+		if (Array.isArray(values)) {
+			[values, ends] = packRecords(values.map(toBuffer));
+		}
+		this._handle.add(values, ends);
+		return this;
+	}
+
+	/** Whether `value` may have been added; false means it surely was not. */
+	has(value) {
+		const [values, ends] = packRecords([toBuffer(value)]);
+		return this._handle.has(values, ends)[0] === 1;
+	}
+
+	/** Like has() for many values at once; a Uint8Array of 0 or 1 per value. */
+	hasMany(values, ends) {
+		if (Array.isArray(values)) {
+			[values, ends] = packRecords(values.map(toBuffer));
+		}
+		return this._handle.has(values, ends);
+	}
+
+	/**
+	 * Adds an array of digests, or `width`-byte digests stored back to back
+	 * in one Buffer, without hashing them again.
+	 */
+	addDigests(digests, width) {
+		if (Array.isArray(digests)) {
+			width = digests.length ? digests[0].length : 16;
+			digests = Buffer.concat(digests);
+		}
+		this._handle.add(digests, null, width);
+		return this;
+	}
+
+	hasDigests(digests, width) {
+		if (Array.isArray(digests)) {
+			width = digests.length ? digests[0].length : 16;
+			digests = Buffer.concat(digests);
+		}
+		return this._handle.has(digests, null, width);
+	}
+
+	/** Writes the filter to `path`, to be reloaded with loadBloomFilter(). */
+	save(path) {
+		this._handle.save(path);
+	}
+}
+
+/**
+ * Creates an empty filter sized for `capacity` items at `errorRate` false
+ * positives (0.01 by default), in a SharedArrayBuffer unless shared is false.
+ */
+function createBloomFilter(options) {
+	const capacity = Math.max(1, options.capacity);
+	const errorRate = options.errorRate || 0.01;
+	const bits = Math.ceil(-capacity * Math.log(errorRate) / (Math.LN2 * Math.LN2));
+	// The probe count is optimal for a classic filter of `bits`; only the
+	// storage grows to make up for probing within one block
+	const probes = Math.min(32, Math.max(1, Math.round(bits / capacity * Math.LN2)));
+	const blocks = Math.ceil(BLOOM_BLOCK_OVERHEAD * bits / BLOOM_BLOCK_BITS);
+	const length = BLOOM_HEADER_BYTES + blocks * BLOOM_BLOCK_BITS / 8;
+	const storage = options.shared === false ? new Uint8Array(length) : new Uint8Array(new SharedArrayBuffer(length));
+	return new BloomFilter(storage, probes, options.salt || crypto.randomBytes(16));
+}
+
+/**
+ * Maps a filter saved with save().  Changes stay private to this process
+ * unless shared is set, in which case they are written to the file and seen
+ * by every process and thread that maps it.
+ */
+function loadBloomFilter(path, options) {
+	options = options || {};
+	return new BloomFilter(new binding.BloomFilter(path, Boolean(options.shared)));
+}
+
+function concatFixed(items) {
+	return Array.isArray(items) ? Buffer.concat(items) : items;
+}
+
+/**
+ * An exact set of fixed-width digests, or with a valueWidth a map from
+ * digests to fixed-width values, stored flat in native memory at close to
+ * the digest width (plus the value width) per entry.  Digests are given one
+ * at a time, as an array of Buffers, or back to back in one Buffer.
+ */
+class DigestSet {
+	constructor(options) {
+		options = options || {};
+		if (options.path) {
+			this._handle = new binding.DigestSet(options.path, Boolean(options.shared));
+		} else {
+			this._handle = new binding.DigestSet(options.width || 32, options.valueWidth || 0, options.capacity || 0);
+		}
+		this.width = this._handle.width();
+		this.valueWidth = this._handle.valueWidth();
+	}
+
+	get size() {
+		return this._handle.size();
+	}
+
+	/**
+	 * Adds digests, with their values for a map, keeping the value of a
+	 * digest already present.  Returns a Uint8Array with 1 for every digest
+	 * that was new.
+	 */
+	add(digests, values) {
+		return this._handle.insert(concatFixed(digests), values ? concatFixed(values) : null, false);
+	}
+
+	/** Adds or replaces one digest's value; true if the digest was new. */
+	set(digest, value) {
+		return this._handle.insert(digest, value, true)[0] === 1;
+	}
+
+	has(digest) {
+		return this._handle.lookup(digest, null)[0] === 1;
+	}
+
+	/** A Uint8Array with 1 for every digest present. */
+	hasMany(digests) {
+		return this._handle.lookup(concatFixed(digests), null);
+	}
+
+	/** The value of one digest, or undefined if it is absent. */
+	get(digest) {
+		const value = Buffer.alloc(this.valueWidth);
+		return this._handle.lookup(digest, value)[0] === 1 ? value : undefined;
+	}
+
+	/**
+	 * Looks up many digests.  Returns {found, values}: a Uint8Array with 1
+	 * for every digest present, and their values back to back in one Buffer.
+	 */
+	getMany(digests) {
+		digests = concatFixed(digests);
+		const values = Buffer.alloc(digests.length / this.width * this.valueWidth);
+		return {found: this._handle.lookup(digests, values), values};
+	}
+
+	/** Writes the set to `path`, to be mapped back with loadDigestSet(). */
+	save(path) {
+		this._handle.save(path);
+	}
+}
+
+function createDigestSet(options) {
+	return new DigestSet(options);
+}
+
+/**
+ * Maps a set saved with save().  Changes stay private to this process unless
+ * shared is set, in which case they go to the file until the set outgrows
+ * it and moves to memory.
+ */
+function loadDigestSet(path, options) {
+	options = options || {};
+	return new DigestSet({path, shared: options.shared});
+}
+
+const DIGEST_CACHE_MAX_ENTRIES = 1024 * 1024;
+
+function openDigestCache(path, options) {
+	options = options || {};
+	return new binding.DigestCache(path, options.maxEntries || DIGEST_CACHE_MAX_ENTRIES);
+}
+
+function parseChunkRecords(records, digestLength) {
+	const recordLength = 12 + (digestLength || 64);
+	const chunks = [];
+	for (let i = 0; i + recordLength <= records.length; i += recordLength) {
+		chunks.push({
+			offset: records.readUInt32LE(i) + records.readUInt32LE(i + 4) * 2**32,
+			length: records.readUInt32LE(i + 8),
+			digest: records.slice(i + 12, i + recordLength)
+		});
+	}
+	return chunks;
+}
+
+const STATS_ALGORITHMS = ['blake2b', 'blake2bp', 'blake2s', 'blake2sp'];
+const STATS_UPDATE_BUCKETS = ['<64', '<512', '<4096', '<65536', '<1048576', '>=1048576'];
+
+function statsObject(names, counters) {
+	const result = {};
+	names.forEach((name, i) => {
+		result[name] = counters[i];
+	});
+	return result;
+}
+
+/**
+ * Counters of all hashing done by the addon on every thread since load or
+ * the last resetStats().  With BLAKE2_STATS=0 in the environment at load,
+ * nothing is counted and `enabled` is false.
+ */
+function stats() {
+	const [enabled, bytes, digests, updates, copies, async] = binding.stats();
+	return {
+		enabled,
+		bytes: statsObject(STATS_ALGORITHMS, bytes),
+		digests: statsObject(STATS_ALGORITHMS, digests),
+		updates: statsObject(STATS_UPDATE_BUCKETS, updates),
+		copies,
+		async: {
+			queued: async[0],
+			maxQueued: async[1],
+			jobs: async[2],
+			waitMs: async[3] / 1e6
+		}
+	};
+}
+
+function resetStats() {
+	binding.resetStats();
+}
+
+/** The sizes hashing currently switches strategy at. */
+function getTuning() {
+	return Object.assign({}, tuning, {backends: mergeBackends(tuning.backends, {})});
+}
+
+/**
+ * `backends` with the choices in `changes` made; throws if `changes` names
+ * an algorithm without a choice of backend, a size class or a backend that
+ * does not exist
+ */
+function mergeBackends(backends, changes) {
+	if (!changes || typeof changes !== 'object') {
+		throw new TypeError("backends must map algorithms to size classes to backends");
+	}
+	const merged = {};
+	for (const algorithm of Object.keys(backends)) {
+		merged[algorithm] = Object.assign({}, backends[algorithm]);
+	}
+	for (const algorithm of Object.keys(changes)) {
+		if (!merged[algorithm]) {
+			throw new TypeError("No choice of backend for " + algorithm);
+		}
+		for (const size of Object.keys(changes[algorithm])) {
+			if (!BACKEND_SIZE_CLASSES.includes(size) || !BACKENDS.includes(changes[algorithm][size])) {
+				throw new TypeError("Bad backend choice for " + algorithm + " " + size);
+			}
+			merged[algorithm][size] = changes[algorithm][size];
+		}
+	}
+	return merged;
+}
+
+/**
+ * Installs a tuning profile, or the one saved in the JSON file at `profile`.
+ * Values it leaves out keep their current setting.  Returns the profile now
+ * in force.
+ */
+function setTuning(profile) {
+	if (typeof profile === 'string') {
+		profile = JSON.parse(fs.readFileSync(profile, 'utf8'));
+	}
+	if (!profile || typeof profile !== 'object') {
+		throw new TypeError("Bad argument; need a tuning profile or the path of one");
+	}
+	for (const name of Object.keys(profile)) {
+		if (!(name in tuning)) {
+			throw new TypeError("Unknown tuning value " + name);
+		}
+		if (name in JS_TUNING_DEFAULTS && name !== 'backends' && !(Number.isInteger(profile[name]) && profile[name] >= 0)) {
+			throw new RangeError("Tuning value out of range");
+		}
+	}
+	const backends = 'backends' in profile ? mergeBackends(tuning.backends, profile.backends) : tuning.backends;
+	binding.setTuning(NATIVE_TUNING.map(name => name in profile ? profile[name] : tuning[name]));
+	Object.assign(tuning, profile, {backends});
+	return getTuning();
+}
+
+/** Goes back to the built-in tuning. */
+function resetTuning() {
+	return setTuning(Object.assign(tuningFromNative(binding.getTuning()[1]), JS_TUNING_DEFAULTS));
+}
+
+// The number of timings calibrate() takes, to share its time out
+const CALIBRATION_TIMINGS = 92;
+
+/**
+ * The fastest of at least three runs of op, which may return a promise,
+ * in nanoseconds
+ */
+async function fastestRun(op, budgetMs) {
+	const end = Date.now() + budgetMs;
+	let fastest = Infinity;
+	for (let runs = 0; runs < 3 || Date.now() < end; runs++) {
+		const start = process.hrtime.bigint();
+		await op();
+		fastest = Math.min(fastest, Number(process.hrtime.bigint() - start));
+	}
+	return fastest;
+}
+
+async function timeWithTuning(profile, op, budgetMs) {
+	const saved = getTuning();
+	setTuning(profile);
+	try {
+		return await fastestRun(op, budgetMs);
+	} finally {
+		setTuning(saved);
+	}
+}
+
+/**
+ * The first of `sizes` at which switching strategy pays: time(size, false)
+ * and time(size, true) time the work without and with switching.
+ */
+async function crossover(sizes, time) {
+	for (const size of sizes) {
+		if (await time(size, true) <= await time(size, false)) {
+			return size;
+		}
+	}
+	return undefined;
+}
+
+async function fastestOf(candidates, time) {
+	let best = candidates[0];
+	let bestTime = Infinity;
+	for (const candidate of candidates) {
+		const t = await time(candidate);
+		if (t < bestTime) {
+			best = candidate;
+			bestTime = t;
+		}
+	}
+	return best;
+}
+
+function powerOfTwoAtLeast(n) {
+	return 2 ** Math.ceil(Math.log2(Math.max(1, n)));
+}
+
+/**
+ * Times the strategies the addon chooses between on this machine, and
+ * node:crypto against the bundled kernels, installs the thresholds and
+ * backends that came out best and resolves to them.  Takes about
+ * options.seconds (2 by default); with options.save the profile is also
+ * written to that path as JSON, for setTuning() or BLAKE2_TUNING to load
+ * later.  Other hashing in the process may see trial values meanwhile.
+ */
+async function calibrate(options) {
+	options = options || {};
+	const budget = (options.seconds || 2) * 1000 / CALIBRATION_TIMINGS;
+	const profile = {};
+
+	// Copying small chunks together against one compression call each
+	const coalesceBelow = await crossover([16, 32, 64, 128, 256, 512, 1024, 2048, 4096, 8192], function(size, direct) {
+		const handle = new binding.Hash('blake2b', null, -1);
+		const chunks = new Array(64).fill(Buffer.alloc(size));
+		return timeWithTuning({coalesceBelow: direct ? size : size + 1}, () => handle.updateMany(chunks), budget);
+	});
+	profile.coalesceBelow = coalesceBelow === undefined ? FEED_STAGING_BYTES : coalesceBelow;
+
+	// Holding a short update back for the digest call against passing it on
+	const deferSizes = [8, 16, 32, 64, 128, 256, 512];
+	const passOnAt = await crossover(deferSizes, function(size, passOn) {
+		const buf = Buffer.alloc(size);
+		return timeWithTuning({deferBytes: passOn ? size - 1 : size}, function() {
+			for (let i = 0; i < 100; i++) {
+				new Hasher('blake2b').update(buf).digest();
+			}
+		}, budget);
+	});
+	profile.deferBytes = passOnAt === undefined ? deferSizes[deferSizes.length - 1] : passOnAt - 1;
+
+	const data = Buffer.alloc(16 * 1024 * 1024);
+
+	profile.multiHashTile = await fastestOf([4096, 8192, 16384, 32768, 65536, 131072, 262144], function(tile) {
+		const handle = new binding.MultiHash(['blake2b', 'blake2bp', 'blake2s', 'blake2sp'].map(multiHashSpec));
+		return timeWithTuning({multiHashTile: tile}, () => handle.update(data.subarray(0, 2 * 1024 * 1024)), budget);
+	});
+
+	// The multi-buffer kernel against one piece at a time, on one thread
+	const lanesSizes = [1024, 4096, 16384, 65536, 262144, 1048576];
+	const sequential = await crossover(lanesSizes, function(size, oneAtATime) {
+		const input = data.subarray(0, 8 * size);
+		return timeWithTuning({
+			piecesLanesMaxSize: oneAtATime ? size - 1 : size,
+			piecesParallelMinBytes: input.length + 1
+		}, () => hashPiecesNative(input, size, ['blake2b', null, -1]), budget);
+	});
+	const lanesIndex = sequential === undefined ? lanesSizes.length : lanesSizes.indexOf(sequential);
+	profile.piecesLanesMaxSize = lanesIndex === 0 ? 0 : lanesSizes[lanesIndex - 1];
+
+	// Spreading pieces over the thread pool against the calling thread alone
+	const parallel = await crossover([65536, 131072, 262144, 524288, 1048576, 2097152, 4194304, 8388608, 16777216], function(length, spread) {
+		const input = data.subarray(0, length);
+		return timeWithTuning({
+			piecesLanesMaxSize: profile.piecesLanesMaxSize,
+			piecesParallelMinBytes: spread ? length : length + 1
+		}, () => hashPiecesNative(input, 16384, ['blake2b', null, -1]), budget);
+	});
+	profile.piecesParallelMinBytes = parallel === undefined ? 2 ** 48 : parallel;
+
+	const keys = 65536;
+	const ends = Uint32Array.from({length: keys}, (_, i) => (i + 1) * 16);
+	const rendezvous = new Rendezvous(Buffer.alloc(16), Array.from({length: 16}, (_, i) => 'node' + i));
+	profile.rendezvousTaskKeys = await fastestOf([256, 1024, 4096, 16384, 65536], function(taskKeys) {
+		return timeWithTuning({rendezvousTaskKeys: taskKeys}, () => rendezvous.selectMany(data.subarray(0, keys * 16), ends, 1), budget);
+	});
+
+	// Offloading pays once hashing a chunk takes longer than a round trip
+	// to the threadpool
+	const hash = new binding.Hash('blake2b', null, -1);
+	const roundTrip = await fastestRun(() => new Promise(resolve => hash.updateAsync([data.subarray(0, 1)], resolve)), budget);
+	const perByte = await fastestRun(() => hash.update(data.subarray(0, 1024 * 1024)), budget) / (1024 * 1024);
+	profile.offloadMin = Math.min(64 * 1024 * 1024, Math.max(4096, powerOfTwoAtLeast(roundTrip / perByte)));
+
+	// node:crypto against the bundled kernels, at one size in each class,
+	// where it passed the known-answer tests
+	const classSizes = [64, 8192, 1024 * 1024];
+	profile.backends = defaultBackends();
+	for (const algorithm of Object.keys(CRYPTO_ALGORITHMS).filter(cryptoBackendVerified)) {
+		for (let i = 0; i < BACKEND_SIZE_CLASSES.length; i++) {
+			const input = data.subarray(0, classSizes[i]);
+			const repeat = Math.max(1, Math.floor(65536 / input.length));
+			const timeBackend = backend => fastestRun(function() {
+				for (let n = 0; n < repeat; n++) {
+					newHandle(backend, algorithm, null, -1).digest(input);
+				}
+			}, budget);
+			if (await timeBackend('crypto') < await timeBackend('native')) {
+				profile.backends[algorithm][BACKEND_SIZE_CLASSES[i]] = 'crypto';
+			}
+		}
+	}
+
+	setTuning(profile);
+	if (options.save) {
+		fs.writeFileSync(options.save, JSON.stringify(profile, null, '\t') + '\n');
+	}
+	return profile;
+}
+
+if (process.env.BLAKE2_TUNING) {
+	setTuning(process.env.BLAKE2_TUNING);
+}
+
+module.exports = {
+	Hash, createHash, KeyedHash, createKeyedHash, Hasher, createHasher,
+	HashArena, createHashArena,
+	updateBatch,
+	createHashStream, hashAsyncIterable,
+	Chunker, createChunker, chunkFile, parseChunkRecords,
+	hashPieces, hashTree, openDigestCache,
+	HashChain, createHashChain,
+	Hash64, createHash64, hash64, hash64Many,
+	Rendezvous, createRendezvous,
+	BloomFilter, createBloomFilter, loadBloomFilter,
+	DigestSet, createDigestSet, loadDigestSet,
+	MultiHash, createMultiHash, hashMulti,
+	stats, resetStats,
+	calibrate, getTuning, setTuning, resetTuning
+};
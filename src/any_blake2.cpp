@@ -0,0 +1,135 @@
+#include <cstring>
+
+#include "any_blake2.h"
+
+bool any_blake2_parse_algo(const char *name, any_blake2_algo *algo) {
+	if (strcmp(name, "blake2b") == 0) {
+		*algo = ANY_BLAKE2B;
+	} else if (strcmp(name, "blake2bp") == 0) {
+		*algo = ANY_BLAKE2BP;
+	} else if (strcmp(name, "blake2s") == 0) {
+		*algo = ANY_BLAKE2S;
+	} else if (strcmp(name, "blake2sp") == 0) {
+		*algo = ANY_BLAKE2SP;
+	} else {
+		return false;
+	}
+	return true;
+}
+
+const char *any_blake2_init(any_blake2 *h, any_blake2_algo algo, const void *key, size_t key_length, int digest_length) {
+	h->algo = algo;
+	switch (algo) {
+	case ANY_BLAKE2B:
+		if (digest_length == -1) {
+			digest_length = BLAKE2B_OUTBYTES;
+		} else if (digest_length < 1 || digest_length > BLAKE2B_OUTBYTES) {
+			return "digestLength must be between 1 and 64";
+		}
+
+		if (!key) {
+			if (blake2b_init(reinterpret_cast<blake2b_state*>(&h->state), digest_length) != 0) {
+				return "blake2b_init failure";
+			}
+		} else {
+			if (key_length > BLAKE2B_KEYBYTES) {
+				return "Key must be 64 bytes or smaller";
+			}
+			if (blake2b_init_key(reinterpret_cast<blake2b_state*>(&h->state), digest_length, key, key_length) != 0) {
+				return "blake2b_init_key failure";
+			}
+		}
+		h->update = BLAKE_FN_CAST(blake2b_update);
+		h->final = BLAKE_FN_CAST(blake2b_final);
+		break;
+	case ANY_BLAKE2BP:
+		if (digest_length == -1) {
+			digest_length = BLAKE2B_OUTBYTES;
+		} else if (digest_length < 1 || digest_length > BLAKE2B_OUTBYTES) {
+			return "digestLength must be between 1 and 64";
+		}
+
+		if (!key) {
+			if (blake2bp_init(reinterpret_cast<blake2bp_state*>(&h->state), digest_length) != 0) {
+				return "blake2bp_init failure";
+			}
+		} else {
+			if (key_length > BLAKE2B_KEYBYTES) {
+				return "Key must be 64 bytes or smaller";
+			}
+			if (blake2bp_init_key(reinterpret_cast<blake2bp_state*>(&h->state), digest_length, key, key_length) != 0) {
+				return "blake2bp_init_key failure";
+			}
+		}
+		h->update = BLAKE_FN_CAST(blake2bp_update);
+		h->final = BLAKE_FN_CAST(blake2bp_final);
+		break;
+	case ANY_BLAKE2S:
+		if (digest_length == -1) {
+			digest_length = BLAKE2S_OUTBYTES;
+		} else if (digest_length < 1 || digest_length > BLAKE2S_OUTBYTES) {
+			return "digestLength must be between 1 and 32";
+		}
+
+		if (!key) {
+			if (blake2s_init(reinterpret_cast<blake2s_state*>(&h->state), digest_length) != 0) {
+				return "blake2s_init failure";
+			}
+		} else {
+			if (key_length > BLAKE2S_KEYBYTES) {
+				return "Key must be 32 bytes or smaller";
+			}
+			if (blake2s_init_key(reinterpret_cast<blake2s_state*>(&h->state), digest_length, key, key_length) != 0) {
+				return "blake2s_init_key failure";
+			}
+		}
+		h->update = BLAKE_FN_CAST(blake2s_update);
+		h->final = BLAKE_FN_CAST(blake2s_final);
+		break;
+	case ANY_BLAKE2SP:
+		if (digest_length == -1) {
+			digest_length = BLAKE2S_OUTBYTES;
+		} else if (digest_length < 1 || digest_length > BLAKE2S_OUTBYTES) {
+			return "digestLength must be between 1 and 32";
+		}
+
+		if (!key) {
+			if (blake2sp_init(reinterpret_cast<blake2sp_state*>(&h->state), digest_length) != 0) {
+				return "blake2sp_init failure";
+			}
+		} else {
+			if (key_length > BLAKE2S_KEYBYTES) {
+				return "Key must be 32 bytes or smaller";
+			}
+			if (blake2sp_init_key(reinterpret_cast<blake2sp_state*>(&h->state), digest_length, key, key_length) != 0) {
+				return "blake2sp_init_key failure";
+			}
+		}
+		h->update = BLAKE_FN_CAST(blake2sp_update);
+		h->final = BLAKE_FN_CAST(blake2sp_final);
+		break;
+	}
+	h->outbytes = digest_length;
+	return nullptr;
+}
+
+size_t any_blake2_state_size(any_blake2_algo algo) {
+	switch (algo) {
+	case ANY_BLAKE2B:
+		return sizeof(blake2b_state);
+	case ANY_BLAKE2BP:
+		return sizeof(blake2bp_state);
+	case ANY_BLAKE2S:
+		return sizeof(blake2s_state);
+	case ANY_BLAKE2SP:
+		return sizeof(blake2sp_state);
+	}
+	return sizeof(any_blake2_state);
+}
+
+int any_blake2_peek(const any_blake2 *h, uint8_t *out) {
+	any_blake2_state copy;
+	StatsCountDigests(h->algo, 1);
+	memcpy(&copy, &h->state, any_blake2_state_size(h->algo));
+	return h->final(reinterpret_cast<void*>(&copy), out, h->outbytes);
+}
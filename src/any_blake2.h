@@ -0,0 +1,86 @@
+#ifndef NODE_BLAKE2_ANY_BLAKE2_H
+#define NODE_BLAKE2_ANY_BLAKE2_H
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+#include "blake2.h"
+#include "stats.h"
+
+union any_blake2_state {
+	blake2b_state casted_blake2b_state;
+	blake2bp_state casted_blake2bp_state;
+	blake2s_state casted_blake2s_state;
+	blake2sp_state casted_blake2sp_state;
+};
+
+enum any_blake2_algo {
+	ANY_BLAKE2B,
+	ANY_BLAKE2BP,
+	ANY_BLAKE2S,
+	ANY_BLAKE2SP
+};
+
+#define BLAKE_FN_CAST(fn) \
+	reinterpret_cast<int (*)(void*, const void*, size_t)>(fn)
+
+/**
+ * One of the four BLAKE2 variants together with the functions that drive it,
+ * so that callers can hash without caring which algorithm was picked.
+ */
+struct any_blake2 {
+	any_blake2_algo algo;
+	int (*update)(void*, const void*, size_t);
+	int (*final)(void*, const void*, size_t);
+	uint8_t outbytes;
+	any_blake2_state state;
+};
+
+/**
+ * Parses an algorithm name; returns false if it is not one of
+ * blake2b, blake2bp, blake2s or blake2sp.
+ */
+bool any_blake2_parse_algo(const char *name, any_blake2_algo *algo);
+
+/**
+ * Initializes `h` for `algo`.  A digest_length of -1 selects the maximum
+ * digest length, a null key selects unkeyed hashing.  Returns nullptr on
+ * success, or an error message suitable for throwing to JS.
+ */
+const char *any_blake2_init(any_blake2 *h, any_blake2_algo algo, const void *key, size_t key_length, int digest_length);
+
+inline void any_blake2_update(any_blake2 *h, const void *data, size_t length) {
+	StatsCountBytes(h->algo, length);
+	h->update(reinterpret_cast<void*>(&h->state), data, length);
+}
+
+/**
+ * Writes h->outbytes bytes of digest to `out`; `h` cannot be updated
+ * afterwards.
+ */
+inline int any_blake2_final(any_blake2 *h, uint8_t *out) {
+	StatsCountDigests(h->algo, 1);
+	return h->final(reinterpret_cast<void*>(&h->state), out, h->outbytes);
+}
+
+/**
+ * Size of the part of any_blake2_state actually used by `algo`.
+ */
+size_t any_blake2_state_size(any_blake2_algo algo);
+
+/**
+ * Copies `src` into `dest`, skipping the part of the state union that
+ * src's algorithm does not use.
+ */
+inline void any_blake2_copy(any_blake2 *dest, const any_blake2 *src) {
+	memcpy(dest, src, offsetof(any_blake2, state) + any_blake2_state_size(src->algo));
+}
+
+/**
+ * Writes h->outbytes bytes of digest to `out` without disturbing `h`,
+ * by finalizing a copy of the state.
+ */
+int any_blake2_peek(const any_blake2 *h, uint8_t *out);
+
+#endif
@@ -5,37 +5,115 @@
 
 #include <cstddef>
 #include <cassert>
+#include <cmath>
 #include <cstring>
 
-#include "blake2.h"
+#include <algorithm>
+#include <unordered_set>
+#include <utility>
+#include <vector>
 
-union any_blake2_state {
-	blake2b_state casted_blake2b_state;
-	blake2bp_state casted_blake2bp_state;
-	blake2s_state casted_blake2s_state;
-	blake2sp_state casted_blake2sp_state;
-};
+#include "any_blake2.h"
+#include "blake2_addon.h"
+#include "blake2_lanes.h"
+#include "byte_order.h"
+#include "hash_arena.h"
+#include "stats.h"
+#include "trace.h"
+#include "tuning.h"
+
+// updateMany copies chunks shorter than TUNING_COALESCE_BELOW into a staging
+// buffer of this size, so runs of small writes reach the compression
+// function as whole blocks
+static const size_t COALESCE_BYTES = 16 * 1024;
+
+// The largest checkpoint interval, beyond which doubles skip integers
+static const double MAX_CHECKPOINT_EVERY = 9007199254740992.0;
 
-#define BLAKE_FN_CAST(fn) \
-	reinterpret_cast<int (*)(void*, const void*, size_t)>(fn)
+// Marks Hash objects in their second internal field, so that updateBatch can
+// tell them from other objects
+static const int HASH_TAG = 0;
 
 class Hash: public Nan::ObjectWrap {
 	static v8::Local<v8::FunctionTemplate> CreateTemplate() {
 		v8::Local<v8::FunctionTemplate> tpl = Nan::New<v8::FunctionTemplate>(New);
 		tpl->SetClassName(Nan::New("Hash").ToLocalChecked());
-		tpl->InstanceTemplate()->SetInternalFieldCount(1);
+		tpl->InstanceTemplate()->SetInternalFieldCount(2);
 		Nan::SetPrototypeMethod(tpl, "update", Update);
+		Nan::SetPrototypeMethod(tpl, "updateMany", UpdateMany);
 		Nan::SetPrototypeMethod(tpl, "digest", Digest);
 		Nan::SetPrototypeMethod(tpl, "copy", Copy);
+		Nan::SetPrototypeMethod(tpl, "setCheckpointEvery", SetCheckpointEvery);
+		Nan::SetPrototypeMethod(tpl, "updateCheckpoints", UpdateCheckpoints);
+		Nan::SetPrototypeMethod(tpl, "updateAsync", UpdateAsync);
 		return tpl;
 	}
 
+	/**
+	 * Absorbs a batch of Buffers on the libuv threadpool.  The Buffers and
+	 * the Hash itself are kept alive until it is done, and the Hash is busy
+	 * meanwhile.
+	 */
+	class UpdateWorker: public Nan::AsyncWorker {
+	 public:
+		UpdateWorker(Nan::Callback *callback, Hash *hash, v8::Local<v8::Object> self, v8::Local<v8::Array> chunks)
+			: Nan::AsyncWorker(callback, "blake2:update"), hash_(hash) {
+			SaveToPersistent("hash", self);
+			SaveToPersistent("chunks", chunks);
+			for (uint32_t i = 0; i < chunks->Length(); i++) {
+				v8::Local<v8::Value> chunk = Nan::Get(chunks, i).ToLocalChecked();
+				chunks_.push_back(std::make_pair(node::Buffer::Data(chunk), node::Buffer::Length(chunk)));
+				StatsCountUpdate(node::Buffer::Length(chunk));
+			}
+			hash_->busy_ = true;
+		}
+
+		void Execute() override {
+			ticket_.Started();
+			TraceSpan span(TRACE_ASYNC, hash_->hash.algo);
+			for (const std::pair<const char*, size_t> &chunk : chunks_) {
+				span.AddBytes(chunk.second);
+				any_blake2_update(&hash_->hash, chunk.first, chunk.second);
+				hash_->offset_ += chunk.second;
+			}
+		}
+
+		void HandleOKCallback() override {
+			hash_->busy_ = false;
+			Nan::AsyncWorker::HandleOKCallback();
+		}
+
+	 private:
+		StatsQueueTicket ticket_;
+		Hash *hash_;
+		std::vector<std::pair<const char*, size_t>> chunks_;
+	};
+
  protected:
 	bool initialized_;
-	int (*any_blake2_update)(void*, const void*, size_t);
-	int (*any_blake2_final)(void*, const void*, size_t);
-	uint8_t outbytes;
-	any_blake2_state state;
+	any_blake2 hash;
+	// Bytes absorbed so far, and the checkpoint interval (0 if none)
+	uint64_t offset_;
+	uint64_t checkpoint_every_;
+	// Set while an UpdateWorker owns the state
+	bool busy_;
+
+	Hash() : initialized_(false), offset_(0), checkpoint_every_(0), busy_(false) {}
+
+	/**
+	 * Throws unless the state can be used from the main thread right now.
+	 */
+	bool Ready() {
+		if (!initialized_) {
+			Nan::ThrowError(v8::Exception::Error(Nan::New<v8::String>("Not initialized").ToLocalChecked()));
+			return false;
+		}
+		if (busy_) {
+			Nan::ThrowError("Hash is busy with an offloaded update");
+			return false;
+		}
+		return true;
+	}
 
  public:
 	static v8::Maybe<bool> Init(v8::Local<v8::Object> target) {
@@ -50,6 +128,7 @@ class Hash: public Nan::ObjectWrap {
 
 		Hash *obj = new Hash();
 		obj->Wrap(info.This());
+		info.This()->SetAlignedPointerInInternalField(1, const_cast<int*>(&HASH_TAG));
 		if (info.Length() < 1 || !info[0]->IsString()) {
 			return Nan::ThrowError(v8::Exception::TypeError(Nan::New<v8::String>("First argument must be a string with algorithm name").ToLocalChecked()));
 		}
@@ -77,152 +156,325 @@ class Hash: public Nan::ObjectWrap {
 
 		if (algo == "bypass") {
 			// Initialize nothing - .copy() will set up all the state
-		} else if (algo == "blake2b") {
-			if (digest_length == -1) {
-				digest_length = BLAKE2B_OUTBYTES;
-			} else if (digest_length < 1 || digest_length > BLAKE2B_OUTBYTES) {
-				return Nan::ThrowError("digestLength must be between 1 and 64");
+		} else {
+			any_blake2_algo parsed;
+			if (!any_blake2_parse_algo(algo.c_str(), &parsed)) {
+				return Nan::ThrowError("Algorithm must be blake2b, blake2s, blake2bp, or blake2sp");
 			}
-
-			if (!key_data) {
-				if (blake2b_init(reinterpret_cast<blake2b_state*>(&obj->state), digest_length) != 0) {
-					return Nan::ThrowError("blake2b_init failure");
-				}
-			} else {
-				if (key_length > BLAKE2B_KEYBYTES) {
-					return Nan::ThrowError("Key must be 64 bytes or smaller");
-				}
-				if (blake2b_init_key(reinterpret_cast<blake2b_state*>(&obj->state), digest_length, key_data, key_length) != 0) {
-					return Nan::ThrowError("blake2b_init_key failure");
-				}
+			const char *error = any_blake2_init(&obj->hash, parsed, key_data, key_length, digest_length);
+			if (error) {
+				return Nan::ThrowError(error);
 			}
-			obj->outbytes = digest_length;
-			obj->any_blake2_update = BLAKE_FN_CAST(blake2b_update);
-			obj->any_blake2_final = BLAKE_FN_CAST(blake2b_final);
 			obj->initialized_ = true;
-		} else if (algo == "blake2bp") {
-			if (digest_length == -1) {
-				digest_length = BLAKE2B_OUTBYTES;
-			} else if (digest_length < 1 || digest_length > BLAKE2B_OUTBYTES) {
-				return Nan::ThrowError("digestLength must be between 1 and 64");
-			}
+		}
+		info.GetReturnValue().Set(info.This());
+	}
 
-			if (!key_data) {
-				if (blake2bp_init(reinterpret_cast<blake2bp_state*>(&obj->state), digest_length) != 0) {
-					return Nan::ThrowError("blake2bp_init failure");
-				}
-			} else {
-				if (key_length > BLAKE2B_KEYBYTES) {
-					return Nan::ThrowError("Key must be 64 bytes or smaller");
-				}
-				if (blake2bp_init_key(reinterpret_cast<blake2bp_state*>(&obj->state), digest_length, key_data, key_length) != 0) {
-					return Nan::ThrowError("blake2bp_init_key failure");
-				}
-			}
-			obj->outbytes = digest_length;
-			obj->any_blake2_update = BLAKE_FN_CAST(blake2bp_update);
-			obj->any_blake2_final = BLAKE_FN_CAST(blake2bp_final);
-			obj->initialized_ = true;
-		} else if (algo == "blake2s") {
-			if (digest_length == -1) {
-				digest_length = BLAKE2S_OUTBYTES;
-			} else if (digest_length < 1 || digest_length > BLAKE2S_OUTBYTES) {
-				return Nan::ThrowError("digestLength must be between 1 and 32");
-			}
+	static NAN_METHOD(Update) {
+		Hash *obj = Nan::ObjectWrap::Unwrap<Hash>(info.This());
 
-			if (!key_data) {
-				if (blake2s_init(reinterpret_cast<blake2s_state*>(&obj->state), digest_length) != 0) {
-					return Nan::ThrowError("blake2s_init failure");
-				}
-			} else {
-				if (key_length > BLAKE2S_KEYBYTES) {
-					return Nan::ThrowError("Key must be 32 bytes or smaller");
-				}
-				if (blake2s_init_key(reinterpret_cast<blake2s_state*>(&obj->state), digest_length, key_data, key_length) != 0) {
-					return Nan::ThrowError("blake2s_init_key failure");
-				}
-			}
-			obj->outbytes = digest_length;
-			obj->any_blake2_update = BLAKE_FN_CAST(blake2s_update);
-			obj->any_blake2_final = BLAKE_FN_CAST(blake2s_final);
-			obj->initialized_ = true;
-		} else if (algo == "blake2sp") {
-			if (digest_length == -1) {
-				digest_length = BLAKE2S_OUTBYTES;
-			} else if (digest_length < 1 || digest_length > BLAKE2S_OUTBYTES) {
-				return Nan::ThrowError("digestLength must be between 1 and 32");
+		if (!obj->Ready()) {
+			return;
+		}
+
+		if (info.Length() < 1 || !node::Buffer::HasInstance(info[0])) {
+			return Nan::ThrowError(v8::Exception::TypeError(Nan::New<v8::String>("Bad argument; need a Buffer").ToLocalChecked()));
+		}
+
+		v8::Local<v8::Object> buffer_obj = info[0]->ToObject(Nan::GetCurrentContext()).ToLocalChecked();
+		const char *buffer_data = node::Buffer::Data(buffer_obj);
+		size_t buffer_length = node::Buffer::Length(buffer_obj);
+		StatsCountUpdate(buffer_length);
+		TraceSpan span(TRACE_UPDATE, obj->hash.algo, buffer_length);
+		any_blake2_update(&obj->hash, buffer_data, buffer_length);
+		obj->offset_ += buffer_length;
+
+		info.GetReturnValue().Set(info.This());
+	}
+
+	/**
+	 * updateMany(buffers): absorbs an array of Buffers in one call, as
+	 * stream _writev does with everything written since the last callback.
+	 */
+	static NAN_METHOD(UpdateMany) {
+		static thread_local std::vector<char> staged;
+		Hash *obj = Nan::ObjectWrap::Unwrap<Hash>(info.This());
+
+		if (!obj->Ready()) {
+			return;
+		}
+		if (info.Length() < 1 || !info[0]->IsArray()) {
+			return Nan::ThrowError(v8::Exception::TypeError(Nan::New<v8::String>("Bad argument; need an array of Buffers").ToLocalChecked()));
+		}
+
+		v8::Local<v8::Array> chunks = info[0].As<v8::Array>();
+		const uint32_t count = chunks->Length();
+		for (uint32_t i = 0; i < count; i++) {
+			if (!node::Buffer::HasInstance(Nan::Get(chunks, i).ToLocalChecked())) {
+				return Nan::ThrowError(v8::Exception::TypeError(Nan::New<v8::String>("Bad argument; need a Buffer").ToLocalChecked()));
 			}
+		}
 
-			if (!key_data) {
-				if (blake2sp_init(reinterpret_cast<blake2sp_state*>(&obj->state), digest_length) != 0) {
-					return Nan::ThrowError("blake2sp_init failure");
-				}
-			} else {
-				if (key_length > BLAKE2S_KEYBYTES) {
-					return Nan::ThrowError("Key must be 32 bytes or smaller");
-				}
-				if (blake2sp_init_key(reinterpret_cast<blake2sp_state*>(&obj->state), digest_length, key_data, key_length) != 0) {
-					return Nan::ThrowError("blake2sp_init_key failure");
+		TraceSpan span(TRACE_UPDATE, obj->hash.algo);
+		const uint64_t coalesce_below = Tuned(TUNING_COALESCE_BELOW);
+		staged.clear();
+		for (uint32_t i = 0; i < count; i++) {
+			v8::Local<v8::Value> chunk = Nan::Get(chunks, i).ToLocalChecked();
+			const char *data = node::Buffer::Data(chunk);
+			const size_t length = node::Buffer::Length(chunk);
+			StatsCountUpdate(length);
+			span.AddBytes(length);
+			obj->offset_ += length;
+			if (length < coalesce_below) {
+				staged.insert(staged.end(), data, data + length);
+				if (staged.size() >= COALESCE_BYTES) {
+					any_blake2_update(&obj->hash, staged.data(), staged.size());
+					staged.clear();
 				}
+				continue;
 			}
-			obj->outbytes = digest_length;
-			obj->any_blake2_update = BLAKE_FN_CAST(blake2sp_update);
-			obj->any_blake2_final = BLAKE_FN_CAST(blake2sp_final);
-			obj->initialized_ = true;
-		} else {
-			return Nan::ThrowError("Algorithm must be blake2b, blake2s, blake2bp, or blake2sp");
+			if (!staged.empty()) {
+				any_blake2_update(&obj->hash, staged.data(), staged.size());
+				staged.clear();
+			}
+			any_blake2_update(&obj->hash, data, length);
+		}
+		if (!staged.empty()) {
+			any_blake2_update(&obj->hash, staged.data(), staged.size());
 		}
+
 		info.GetReturnValue().Set(info.This());
 	}
 
-	static NAN_METHOD(Update) {
+	static NAN_METHOD(SetCheckpointEvery) {
 		Hash *obj = Nan::ObjectWrap::Unwrap<Hash>(info.This());
 
-		if (!obj->initialized_) {
-			v8::Local<v8::Value> exception = v8::Exception::Error(Nan::New<v8::String>("Not initialized").ToLocalChecked());
-			return Nan::ThrowError(exception);
+		const double every = info.Length() >= 1 && info[0]->IsNumber() ? Nan::To<double>(info[0]).FromJust() : NAN;
+		// Also rules out NaN and Infinity, which cannot be cast
+		if (!(every >= 1 && every <= MAX_CHECKPOINT_EVERY) || std::floor(every) != every) {
+			return Nan::ThrowError(v8::Exception::TypeError(Nan::New<v8::String>("checkpointEvery must be a positive integer").ToLocalChecked()));
 		}
+		obj->checkpoint_every_ = static_cast<uint64_t>(every);
+	}
+
+	/**
+	 * Like update, but also returns (offset u64 LE, digest) records for
+	 * every multiple of the checkpoint interval crossed, or undefined if
+	 * none was.  Each digest is finalized from a copy of the state on the
+	 * stack, so no intermediate Hash is ever created.
+	 */
+	static NAN_METHOD(UpdateCheckpoints) {
+		static thread_local std::vector<uint8_t> records;
+		Hash *obj = Nan::ObjectWrap::Unwrap<Hash>(info.This());
 
+		if (!obj->Ready()) {
+			return;
+		}
+		if (obj->checkpoint_every_ == 0) {
+			return Nan::ThrowError("setCheckpointEvery() has not been called");
+		}
 		if (info.Length() < 1 || !node::Buffer::HasInstance(info[0])) {
 			return Nan::ThrowError(v8::Exception::TypeError(Nan::New<v8::String>("Bad argument; need a Buffer").ToLocalChecked()));
 		}
 
-		v8::Local<v8::Object> buffer_obj = info[0]->ToObject(Nan::GetCurrentContext()).ToLocalChecked();
-		const char *buffer_data = node::Buffer::Data(buffer_obj);
-		size_t buffer_length = node::Buffer::Length(buffer_obj);
-		obj->any_blake2_update(
-			reinterpret_cast<void*>(&obj->state),
-			reinterpret_cast<const uint8_t*>(buffer_data),
-			buffer_length
-		);
+		const uint8_t *data = reinterpret_cast<const uint8_t*>(node::Buffer::Data(info[0]));
+		size_t length = node::Buffer::Length(info[0]);
+		StatsCountUpdate(length);
+		TraceSpan span(TRACE_UPDATE, obj->hash.algo, length);
+		const uint64_t every = obj->checkpoint_every_;
+		records.clear();
+		while (length > 0) {
+			size_t part = static_cast<size_t>(std::min<uint64_t>(length, every - obj->offset_ % every));
+			any_blake2_update(&obj->hash, data, part);
+			obj->offset_ += part;
+			data += part;
+			length -= part;
+			if (obj->offset_ % every == 0) {
+				size_t at = records.size();
+				records.resize(at + 8 + obj->hash.outbytes);
+				store_le64(&records[at], obj->offset_);
+				any_blake2_peek(&obj->hash, &records[at + 8]);
+			}
+		}
 
-		info.GetReturnValue().Set(info.This());
+		if (!records.empty()) {
+			info.GetReturnValue().Set(Nan::CopyBuffer(reinterpret_cast<const char*>(records.data()), records.size()).ToLocalChecked());
+		}
+	}
+
+	// updateAsync(buffers, callback): absorbs an array of Buffers off the main thread
+	static NAN_METHOD(UpdateAsync) {
+		Hash *obj = Nan::ObjectWrap::Unwrap<Hash>(info.This());
+
+		if (!obj->Ready()) {
+			return;
+		}
+		if (info.Length() < 2 || !info[0]->IsArray() || !info[1]->IsFunction()) {
+			return Nan::ThrowError(v8::Exception::TypeError(Nan::New<v8::String>("Expected an array of Buffers and a callback").ToLocalChecked()));
+		}
+		v8::Local<v8::Array> chunks = info[0].As<v8::Array>();
+		for (uint32_t i = 0; i < chunks->Length(); i++) {
+			if (!node::Buffer::HasInstance(Nan::Get(chunks, i).ToLocalChecked())) {
+				return Nan::ThrowError(v8::Exception::TypeError(Nan::New<v8::String>("Bad argument; need a Buffer").ToLocalChecked()));
+			}
+		}
+
+		Nan::Callback *callback = new Nan::Callback(info[1].As<v8::Function>());
+		Nan::AsyncQueueWorker(new UpdateWorker(callback, obj, info.This(), chunks));
 	}
 
+	// digest(last): `last`, if given, is a final Buffer to absorb first
 	static NAN_METHOD(Digest) {
 		Hash *obj = Nan::ObjectWrap::Unwrap<Hash>(info.This());
 		unsigned char digest[512 / 8];
 
-		if (!obj->initialized_) {
-			v8::Local<v8::Value> exception = v8::Exception::Error(Nan::New<v8::String>("Not initialized").ToLocalChecked());
-			return Nan::ThrowError(exception);
+		if (!obj->Ready()) {
+			return;
+		}
+		TraceSpan span(TRACE_FINAL, obj->hash.algo);
+		if (info.Length() >= 1 && !info[0]->IsUndefined() && !info[0]->IsNull()) {
+			if (!node::Buffer::HasInstance(info[0])) {
+				return Nan::ThrowError(v8::Exception::TypeError(Nan::New<v8::String>("Bad argument; need a Buffer").ToLocalChecked()));
+			}
+			span.AddBytes(node::Buffer::Length(info[0]));
+			StatsCountUpdate(node::Buffer::Length(info[0]));
+			any_blake2_update(&obj->hash, node::Buffer::Data(info[0]), node::Buffer::Length(info[0]));
+			obj->offset_ += node::Buffer::Length(info[0]);
 		}
 
 		obj->initialized_ = false;
-		if (obj->any_blake2_final(reinterpret_cast<void*>(&obj->state), digest, obj->outbytes) != 0) {
+		if (any_blake2_final(&obj->hash, digest) != 0) {
 			return Nan::ThrowError("blake2*_final failure");
 		}
 
 		v8::Local<v8::Value> rc = Nan::Encode(
 			reinterpret_cast<const char*>(digest),
-			obj->outbytes,
+			obj->hash.outbytes,
 			Nan::BUFFER
 		);
 
 		info.GetReturnValue().Set(rc);
 	}
 
+	/**
+	 * updateBatch(entries, arena): absorbs the Buffer of every [target,
+	 * buffer] entry into its target, a Hash or, with an arena, a handle into
+	 * it, as update() would in turn.  Every entry is checked first, so on
+	 * error no target has changed.  BLAKE2b and BLAKE2s states that
+	 * complete blocks are advanced together through the lanes, as many
+	 * states at a time as a vector holds words.
+	 */
+	static NAN_METHOD(UpdateBatch) {
+		struct Entry {
+			any_blake2_algo algo;
+			void *state;
+			Hash *hash;
+			ArenaPool *pool;
+			ArenaSlot *slot;
+			const uint8_t *data;
+			size_t length;
+		};
+		static thread_local std::vector<Entry> entries;
+		static thread_local std::vector<blake2b_update_op> b_updates;
+		static thread_local std::vector<blake2s_update_op> s_updates;
+		static thread_local std::unordered_set<void*> waiting;
+
+		if (info.Length() < 1 || !info[0]->IsArray()) {
+			return Nan::ThrowError(v8::Exception::TypeError(Nan::New<v8::String>("Bad argument; need an array of [hash, Buffer] entries").ToLocalChecked()));
+		}
+		HashArena *arena = info.Length() >= 2 ? HashArena::FromValue(info[1]) : nullptr;
+		v8::Local<v8::Array> array = info[0].As<v8::Array>();
+		const uint32_t count = array->Length();
+
+		// Every entry is checked before any state changes
+		entries.clear();
+		uint64_t bytes = 0;
+		for (uint32_t i = 0; i < count; i++) {
+			v8::Local<v8::Value> item = Nan::Get(array, i).ToLocalChecked();
+			if (!item->IsArray() || item.As<v8::Array>()->Length() != 2) {
+				return Nan::ThrowError(v8::Exception::TypeError(Nan::New<v8::String>("Bad argument; need an array of [hash, Buffer] entries").ToLocalChecked()));
+			}
+			v8::Local<v8::Value> target = Nan::Get(item.As<v8::Array>(), 0).ToLocalChecked();
+			v8::Local<v8::Value> buffer = Nan::Get(item.As<v8::Array>(), 1).ToLocalChecked();
+			if (!node::Buffer::HasInstance(buffer)) {
+				return Nan::ThrowError(v8::Exception::TypeError(Nan::New<v8::String>("Bad argument; need a Buffer").ToLocalChecked()));
+			}
+			Entry entry;
+			entry.hash = nullptr;
+			entry.pool = nullptr;
+			entry.slot = nullptr;
+			entry.data = reinterpret_cast<const uint8_t*>(node::Buffer::Data(buffer));
+			entry.length = node::Buffer::Length(buffer);
+			if (arena) {
+				entry.slot = arena->LookupOpen(target, &entry.pool);
+				if (!entry.slot) {
+					return;
+				}
+				entry.algo = entry.pool->Algo();
+				entry.state = ArenaPool::State(entry.slot);
+			} else {
+				v8::Local<v8::Object> object = target->IsObject() ? target.As<v8::Object>() : v8::Local<v8::Object>();
+				if (object.IsEmpty() || object->InternalFieldCount() != 2 || object->GetAlignedPointerFromInternalField(1) != &HASH_TAG) {
+					return Nan::ThrowError(v8::Exception::TypeError(Nan::New<v8::String>("Bad argument; need a Hash").ToLocalChecked()));
+				}
+				entry.hash = Nan::ObjectWrap::Unwrap<Hash>(object);
+				if (!entry.hash->Ready()) {
+					return;
+				}
+				// An empty buffer crosses no checkpoint; it only checks that
+				// the hash can still be updated
+				if (entry.hash->checkpoint_every_ && entry.length) {
+					return Nan::ThrowError(v8::Exception::TypeError(Nan::New<v8::String>("Hashes with checkpoints cannot be updated in a batch").ToLocalChecked()));
+				}
+				entry.algo = entry.hash->hash.algo;
+				entry.state = &entry.hash->hash.state;
+			}
+			bytes += entry.length;
+			entries.push_back(entry);
+		}
+
+		TraceSpan span(TRACE_BATCH, count ? entries[0].algo : ANY_BLAKE2B, bytes);
+		const bool lanes = blake2_lanes_accelerated();
+		auto run_lanes = [&]() {
+			blake2b_update_many(b_updates.data(), b_updates.size());
+			blake2s_update_many(s_updates.data(), s_updates.size());
+			b_updates.clear();
+			s_updates.clear();
+			waiting.clear();
+		};
+		for (const Entry &entry : entries) {
+			if (entry.hash && entry.hash->checkpoint_every_) {
+				continue;
+			}
+			StatsCountUpdate(entry.length);
+			if (entry.hash) {
+				entry.hash->offset_ += entry.length;
+			}
+			if (lanes && (entry.algo == ANY_BLAKE2B || entry.algo == ANY_BLAKE2S)) {
+				// A state takes one update per pass through the lanes
+				if (!waiting.insert(entry.state).second) {
+					run_lanes();
+					waiting.insert(entry.state);
+				}
+				if (entry.algo == ANY_BLAKE2B) {
+					b_updates.push_back({static_cast<blake2b_state*>(entry.state), entry.data, entry.length});
+				} else {
+					s_updates.push_back({static_cast<blake2s_state*>(entry.state), entry.data, entry.length});
+				}
+			} else if (entry.hash) {
+				any_blake2_update(&entry.hash->hash, entry.data, entry.length);
+			} else {
+				entry.pool->Update(entry.slot, entry.data, entry.length);
+			}
+		}
+		run_lanes();
+	}
+
 	static NAN_METHOD(Copy) {
+		if (Nan::ObjectWrap::Unwrap<Hash>(info.This())->busy_) {
+			return Nan::ThrowError("Hash is busy with an offloaded update");
+		}
+
 		const unsigned argc = 1;
 		v8::Local<v8::Value> argv[argc] = { Nan::New<v8::String>("bypass").ToLocalChecked() };
 
@@ -239,13 +491,108 @@ class Hash: public Nan::ObjectWrap {
 		dest->Wrap(inst);
 
 		dest->initialized_ = src->initialized_;
-		dest->any_blake2_update = src->any_blake2_update;
-		dest->any_blake2_final = src->any_blake2_final;
-		dest->outbytes = src->outbytes;
-		dest->state = src->state;
+		dest->hash = src->hash;
+		dest->offset_ = src->offset_;
+		dest->checkpoint_every_ = src->checkpoint_every_;
+		StatsCountCopy();
 
 		info.GetReturnValue().Set(inst);
 	}
 };
 
-NAN_MODULE_WORKER_ENABLED(NODE_GYP_MODULE_NAME, Hash::Init)
+bool HashFromValues(v8::Local<v8::Value> algorithm, v8::Local<v8::Value> key, v8::Local<v8::Value> digestLength, any_blake2 *h) {
+	if (!algorithm->IsString()) {
+		Nan::ThrowError(v8::Exception::TypeError(Nan::New<v8::String>("First argument must be a string with algorithm name").ToLocalChecked()));
+		return false;
+	}
+	any_blake2_algo algo;
+	if (!any_blake2_parse_algo(*Nan::Utf8String(algorithm), &algo)) {
+		Nan::ThrowError("Algorithm must be blake2b, blake2s, blake2bp, or blake2sp");
+		return false;
+	}
+
+	const char *key_data = nullptr;
+	size_t key_length = 0;
+	if (!key->IsNull() && !key->IsUndefined()) {
+		if (!node::Buffer::HasInstance(key)) {
+			Nan::ThrowError(v8::Exception::TypeError(Nan::New<v8::String>("If key argument is given, it must be a Buffer").ToLocalChecked()));
+			return false;
+		}
+		key_data = node::Buffer::Data(key);
+		key_length = node::Buffer::Length(key);
+	}
+
+	int digest_length = -1;
+	if (!digestLength->IsUndefined()) {
+		if (!digestLength->IsNumber()) {
+			Nan::ThrowError(v8::Exception::TypeError(Nan::New<v8::String>("digestLength must be a number").ToLocalChecked()));
+			return false;
+		}
+		digest_length = Nan::To<int32_t>(digestLength).FromJust();
+	}
+
+	const char *error = any_blake2_init(h, algo, key_data, key_length, digest_length);
+	if (error) {
+		Nan::ThrowError(error);
+		return false;
+	}
+	return true;
+}
+
+bool HashFromArguments(const Nan::FunctionCallbackInfo<v8::Value> &info, int first, any_blake2 *h) {
+	// Missing arguments read as undefined
+	return HashFromValues(info[first], info[first + 1], info[first + 2], h);
+}
+
+static v8::Local<v8::Array> CountersToArray(const uint64_t *counters, int count) {
+	v8::Local<v8::Array> array = Nan::New<v8::Array>(count);
+	for (int i = 0; i < count; i++) {
+		Nan::Set(array, static_cast<uint32_t>(i), Nan::New<v8::Number>(static_cast<double>(counters[i])));
+	}
+	return array;
+}
+
+/**
+ * stats(): [enabled, bytes, digests, updates, copies, async] with one entry
+ * per algorithm in bytes and digests, one per size bucket in updates, and
+ * [queued, maxQueued, jobs, waitNs] in async
+ */
+static NAN_METHOD(Stats) {
+	StatsSnapshot stats;
+	StatsRead(&stats);
+	const uint64_t async[] = { stats.async_queued, stats.async_max_queued, stats.async_jobs, stats.async_wait_ns };
+	v8::Local<v8::Array> result = Nan::New<v8::Array>(6);
+	Nan::Set(result, 0, Nan::New<v8::Boolean>(stats_enabled));
+	Nan::Set(result, 1, CountersToArray(stats.bytes, STATS_ALGOS));
+	Nan::Set(result, 2, CountersToArray(stats.digests, STATS_ALGOS));
+	Nan::Set(result, 3, CountersToArray(stats.updates, STATS_UPDATE_BUCKETS));
+	Nan::Set(result, 4, Nan::New<v8::Number>(static_cast<double>(stats.copies)));
+	Nan::Set(result, 5, CountersToArray(async, 4));
+	info.GetReturnValue().Set(result);
+}
+
+static NAN_METHOD(ResetStats) {
+	StatsReset();
+}
+
+NAN_MODULE_INIT(InitAll) {
+	TraceInit();
+	Hash::Init(target);
+	InitChunker(target);
+	InitPieces(target);
+	InitTree(target);
+	InitDigestCache(target);
+	InitChain(target);
+	InitHash64(target);
+	InitRendezvous(target);
+	InitBloomFilter(target);
+	InitDigestSet(target);
+	InitMultiHash(target);
+	InitTuning(target);
+	InitHashArena(target);
+	Nan::SetMethod(target, "updateBatch", Hash::UpdateBatch);
+	Nan::SetMethod(target, "stats", Stats);
+	Nan::SetMethod(target, "resetStats", ResetStats);
+}
+
+NAN_MODULE_WORKER_ENABLED(NODE_GYP_MODULE_NAME, InitAll)
@@ -0,0 +1,44 @@
+#ifndef NODE_BLAKE2_ADDON_H
+#define NODE_BLAKE2_ADDON_H
+
+#include <memory>
+
+#include <nan.h>
+
+#include "any_blake2.h"
+
+/**
+ * Initializes `h` from the (algorithm, key, digestLength) arguments found at
+ * info[first], info[first + 1] and info[first + 2], with the same rules as
+ * the Hash constructor.  key may be null and digestLength may be -1.  On
+ * failure a JS exception has been thrown and false is returned.
+ */
+bool HashFromArguments(const Nan::FunctionCallbackInfo<v8::Value> &info, int first, any_blake2 *h);
+
+/**
+ * Like HashFromArguments, for values taken from anywhere else.
+ */
+bool HashFromValues(v8::Local<v8::Value> algorithm, v8::Local<v8::Value> key, v8::Local<v8::Value> digestLength, any_blake2 *h);
+
+class DigestCache;
+
+/**
+ * Returns the cache behind a DigestCache object, or nullptr if `value` is
+ * not one or it has been closed.
+ */
+std::shared_ptr<DigestCache> DigestCacheFromValue(v8::Local<v8::Value> value);
+
+NAN_MODULE_INIT(InitChunker);
+NAN_MODULE_INIT(InitPieces);
+NAN_MODULE_INIT(InitTree);
+NAN_MODULE_INIT(InitDigestCache);
+NAN_MODULE_INIT(InitChain);
+NAN_MODULE_INIT(InitHash64);
+NAN_MODULE_INIT(InitRendezvous);
+NAN_MODULE_INIT(InitBloomFilter);
+NAN_MODULE_INIT(InitDigestSet);
+NAN_MODULE_INIT(InitMultiHash);
+NAN_MODULE_INIT(InitTuning);
+NAN_MODULE_INIT(InitHashArena);
+
+#endif
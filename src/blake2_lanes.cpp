@@ -0,0 +1,563 @@
+#include <cstring>
+
+#include "any_blake2.h"
+#include "blake2_lanes.h"
+#include "byte_order.h"
+#include "stats.h"
+
+#if (defined(__x86_64__) || defined(__i386__)) && defined(__GNUC__) && !defined(__AVX2__)
+#define LANES_AVX2_DISPATCH
+#endif
+
+#if defined(_MSC_VER)
+#define LANES_INLINE __forceinline
+#else
+#define LANES_INLINE inline __attribute__((always_inline))
+#endif
+
+namespace {
+
+const uint8_t SIGMA[12][16] = {
+	{  0,  1,  2,  3,  4,  5,  6,  7,  8,  9, 10, 11, 12, 13, 14, 15 },
+	{ 14, 10,  4,  8,  9, 15, 13,  6,  1, 12,  0,  2, 11,  7,  5,  3 },
+	{ 11,  8, 12,  0,  5,  2, 15, 13, 10, 14,  3,  6,  7,  1,  9,  4 },
+	{  7,  9,  3,  1, 13, 12, 11, 14,  2,  6,  5, 10,  4,  0, 15,  8 },
+	{  9,  0,  5,  7,  2,  4, 10, 15, 14,  1, 11, 12,  6,  8,  3, 13 },
+	{  2, 12,  6, 10,  0, 11,  8,  3,  4, 13,  7,  5, 15, 14,  1,  9 },
+	{ 12,  5,  1, 15, 14, 13,  4, 10,  0,  7,  6,  3,  9,  2,  8, 11 },
+	{ 13, 11,  7, 14, 12,  1,  3,  9,  5,  0, 15,  4,  8,  6,  2, 10 },
+	{  6, 15, 14,  9, 11,  3,  0,  8, 12,  2, 13,  7,  1,  4, 10,  5 },
+	{ 10,  2,  8,  4,  7,  6,  1,  5, 15, 11,  9, 14,  3, 12, 13,  0 },
+	{  0,  1,  2,  3,  4,  5,  6,  7,  8,  9, 10, 11, 12, 13, 14, 15 },
+	{ 14, 10,  4,  8,  9, 15, 13,  6,  1, 12,  0,  2, 11,  7,  5,  3 }
+};
+
+template<typename W> struct Variant;
+
+template<> struct Variant<uint64_t> {
+	typedef blake2b_state State;
+	typedef blake2b_message Message;
+	typedef blake2b_update_op UpdateOp;
+	enum { ROUNDS = 12, R1 = 32, R2 = 24, R3 = 16, R4 = 63, BLOCK = BLAKE2B_BLOCKBYTES, LANES = BLAKE2B_LANES };
+
+	static LANES_INLINE uint64_t Load(const uint8_t *p) {
+		return load_le64(p);
+	}
+	static LANES_INLINE void Store(uint8_t *p, uint64_t w) {
+		store_le64(p, w);
+	}
+	static uint64_t Counter(const State *S) {
+		return S->t[0];
+	}
+	static void SetCounter(State *S, uint64_t t) {
+		S->t[0] = t;
+	}
+	static LANES_INLINE uint64_t CounterHigh(uint64_t) {
+		return 0;
+	}
+	static uint64_t IV(int i) {
+		static const uint64_t iv[8] = {
+			0x6a09e667f3bcc908ULL, 0xbb67ae8584caa73bULL,
+			0x3c6ef372fe94f82bULL, 0xa54ff53a5f1d36f1ULL,
+			0x510e527fade682d1ULL, 0x9b05688c2b3e6c1fULL,
+			0x1f83d9abfb41bd6bULL, 0x5be0cd19137e2179ULL
+		};
+		return iv[i];
+	}
+};
+
+template<> struct Variant<uint32_t> {
+	typedef blake2s_state State;
+	typedef blake2s_message Message;
+	typedef blake2s_update_op UpdateOp;
+	enum { ROUNDS = 10, R1 = 16, R2 = 12, R3 = 8, R4 = 7, BLOCK = BLAKE2S_BLOCKBYTES, LANES = BLAKE2S_LANES };
+
+	static LANES_INLINE uint32_t Load(const uint8_t *p) {
+		return load_le32(p);
+	}
+	static LANES_INLINE void Store(uint8_t *p, uint32_t w) {
+		store_le32(p, w);
+	}
+	static uint64_t Counter(const State *S) {
+		return S->t[0] | (static_cast<uint64_t>(S->t[1]) << 32);
+	}
+	static void SetCounter(State *S, uint64_t t) {
+		S->t[0] = static_cast<uint32_t>(t);
+		S->t[1] = static_cast<uint32_t>(t >> 32);
+	}
+	static LANES_INLINE uint32_t CounterHigh(uint64_t t) {
+		return static_cast<uint32_t>(t >> 32);
+	}
+	static uint32_t IV(int i) {
+		static const uint32_t iv[8] = {
+			0x6A09E667UL, 0xBB67AE85UL, 0x3C6EF372UL, 0xA54FF53AUL,
+			0x510E527FUL, 0x9B05688CUL, 0x1F83D9ABUL, 0x5BE0CD19UL
+		};
+		return iv[i];
+	}
+};
+
+template<typename W, int R>
+LANES_INLINE W rotr(W x) {
+	return (x >> R) | (x << (sizeof(W) * 8 - R));
+}
+
+template<typename W, int N>
+LANES_INLINE void G(W v[16][N], const W m[16][N], int a, int b, int c, int d, int x, int y) {
+	typedef Variant<W> V;
+	for (int l = 0; l < N; l++) {
+		v[a][l] += v[b][l] + m[x][l];
+		v[d][l] = rotr<W, V::R1>(v[d][l] ^ v[a][l]);
+		v[c][l] += v[d][l];
+		v[b][l] = rotr<W, V::R2>(v[b][l] ^ v[c][l]);
+		v[a][l] += v[b][l] + m[y][l];
+		v[d][l] = rotr<W, V::R3>(v[d][l] ^ v[a][l]);
+		v[c][l] += v[d][l];
+		v[b][l] = rotr<W, V::R4>(v[b][l] ^ v[c][l]);
+	}
+}
+
+template<typename W, int N>
+LANES_INLINE void Compress(W h[8][N], const uint8_t *const blocks[N], const uint64_t t[N], const W f[N]) {
+	typedef Variant<W> V;
+	W m[16][N];
+	W v[16][N];
+
+	for (int i = 0; i < 16; i++) {
+		for (int l = 0; l < N; l++) {
+			m[i][l] = V::Load(blocks[l] + i * sizeof(W));
+		}
+	}
+	for (int i = 0; i < 8; i++) {
+		for (int l = 0; l < N; l++) {
+			v[i][l] = h[i][l];
+			v[i + 8][l] = V::IV(i);
+		}
+	}
+	for (int l = 0; l < N; l++) {
+		v[12][l] ^= static_cast<W>(t[l]);
+		v[13][l] ^= V::CounterHigh(t[l]);
+		v[14][l] ^= f[l];
+	}
+
+	for (int r = 0; r < V::ROUNDS; r++) {
+		const uint8_t *s = SIGMA[r];
+		G<W, N>(v, m, 0, 4,  8, 12, s[ 0], s[ 1]);
+		G<W, N>(v, m, 1, 5,  9, 13, s[ 2], s[ 3]);
+		G<W, N>(v, m, 2, 6, 10, 14, s[ 4], s[ 5]);
+		G<W, N>(v, m, 3, 7, 11, 15, s[ 6], s[ 7]);
+		G<W, N>(v, m, 0, 5, 10, 15, s[ 8], s[ 9]);
+		G<W, N>(v, m, 1, 6, 11, 12, s[10], s[11]);
+		G<W, N>(v, m, 2, 7,  8, 13, s[12], s[13]);
+		G<W, N>(v, m, 3, 4,  9, 14, s[14], s[15]);
+	}
+
+	for (int i = 0; i < 8; i++) {
+		for (int l = 0; l < N; l++) {
+			h[i][l] ^= v[i][l] ^ v[i + 8][l];
+		}
+	}
+}
+
+void blake2b_compress_generic(uint64_t h[8][BLAKE2B_LANES], const uint8_t *const blocks[BLAKE2B_LANES], const uint64_t t[BLAKE2B_LANES], const uint64_t f[BLAKE2B_LANES]) {
+	Compress<uint64_t, BLAKE2B_LANES>(h, blocks, t, f);
+}
+
+void blake2s_compress_generic(uint32_t h[8][BLAKE2S_LANES], const uint8_t *const blocks[BLAKE2S_LANES], const uint64_t t[BLAKE2S_LANES], const uint32_t f[BLAKE2S_LANES]) {
+	Compress<uint32_t, BLAKE2S_LANES>(h, blocks, t, f);
+}
+
+#ifdef LANES_AVX2_DISPATCH
+__attribute__((target("avx2")))
+void blake2b_compress_avx2(uint64_t h[8][BLAKE2B_LANES], const uint8_t *const blocks[BLAKE2B_LANES], const uint64_t t[BLAKE2B_LANES], const uint64_t f[BLAKE2B_LANES]) {
+	Compress<uint64_t, BLAKE2B_LANES>(h, blocks, t, f);
+}
+
+__attribute__((target("avx2")))
+void blake2s_compress_avx2(uint32_t h[8][BLAKE2S_LANES], const uint8_t *const blocks[BLAKE2S_LANES], const uint64_t t[BLAKE2S_LANES], const uint32_t f[BLAKE2S_LANES]) {
+	Compress<uint32_t, BLAKE2S_LANES>(h, blocks, t, f);
+}
+
+bool cpu_has_avx2() {
+	__builtin_cpu_init();
+	return __builtin_cpu_supports("avx2");
+}
+
+const bool use_avx2 = cpu_has_avx2();
+#endif
+
+inline void CompressLanes(uint64_t h[8][BLAKE2B_LANES], const uint8_t *const blocks[BLAKE2B_LANES], const uint64_t t[BLAKE2B_LANES], const uint64_t f[BLAKE2B_LANES]) {
+	blake2b_compress_lanes(h, blocks, t, f);
+}
+
+inline void CompressLanes(uint32_t h[8][BLAKE2S_LANES], const uint8_t *const blocks[BLAKE2S_LANES], const uint64_t t[BLAKE2S_LANES], const uint32_t f[BLAKE2S_LANES]) {
+	blake2s_compress_lanes(h, blocks, t, f);
+}
+
+template<typename W>
+void HashLanes(const typename Variant<W>::State *S, const uint8_t *const *in, size_t inlen, uint8_t *const *out, size_t lanes) {
+	typedef Variant<W> V;
+	const int N = V::LANES;
+	const size_t BLOCK = V::BLOCK;
+
+	W h[8][N];
+	W f[N];
+	uint64_t t[N];
+	const uint8_t *blocks[N];
+	uint8_t staging[N][BLOCK];
+
+	for (int i = 0; i < 8; i++) {
+		for (int l = 0; l < N; l++) {
+			h[i][l] = S->h[i];
+		}
+	}
+
+	// The message of each lane is S's pending bytes followed by in[lane]
+	const size_t prefix = S->buflen;
+	const size_t total = prefix + inlen;
+	const size_t nonfinal = total == 0 ? 0 : (total - 1) / BLOCK;
+	uint64_t counter = V::Counter(S);
+
+	for (size_t k = 0; k <= nonfinal; k++) {
+		const size_t start = k * BLOCK;
+		const size_t length = k < nonfinal ? BLOCK : total - start;
+		const bool direct = start >= prefix && length == BLOCK;
+		counter += length;
+
+		for (int l = 0; l < N; l++) {
+			const uint8_t *message = in[static_cast<size_t>(l) < lanes ? l : 0];
+			if (direct) {
+				blocks[l] = message + (start - prefix);
+			} else {
+				size_t filled = 0;
+				if (start < prefix) {
+					filled = prefix - start < length ? prefix - start : length;
+					memcpy(staging[l], S->buf + start, filled);
+				}
+				if (filled < length) {
+					memcpy(staging[l] + filled, message + (start + filled - prefix), length - filled);
+				}
+				memset(staging[l] + length, 0, BLOCK - length);
+				blocks[l] = staging[l];
+			}
+			t[l] = counter;
+			f[l] = k == nonfinal ? static_cast<W>(~static_cast<W>(0)) : 0;
+		}
+
+		CompressLanes(h, blocks, t, f);
+	}
+
+	for (size_t l = 0; l < lanes; l++) {
+		uint8_t digest[8 * sizeof(W)];
+		for (int i = 0; i < 8; i++) {
+			V::Store(digest + i * sizeof(W), h[i][l]);
+		}
+		memcpy(out[l], digest, S->outlen);
+	}
+}
+
+template<typename W>
+void HashMany(const typename Variant<W>::Message *messages, size_t count) {
+	typedef Variant<W> V;
+	const int N = V::LANES;
+	const size_t BLOCK = V::BLOCK;
+	static const uint8_t idle_block[BLOCK] = {0};
+
+	struct Lane {
+		const typename V::Message *message;
+		size_t block;
+		size_t nonfinal;
+		uint64_t counter;
+	} lane[N];
+
+	W h[8][N];
+	W f[N];
+	uint64_t t[N];
+	const uint8_t *blocks[N];
+	uint8_t staging[N][BLOCK];
+
+	size_t next = 0;
+	int busy = 0;
+	auto start = [&](int l) {
+		if (next == count) {
+			lane[l].message = nullptr;
+			return;
+		}
+		const typename V::Message *m = &messages[next++];
+		const size_t total = m->S->buflen + m->inlen;
+		lane[l].message = m;
+		lane[l].block = 0;
+		lane[l].nonfinal = total == 0 ? 0 : (total - 1) / BLOCK;
+		lane[l].counter = V::Counter(m->S);
+		for (int i = 0; i < 8; i++) {
+			h[i][l] = m->S->h[i];
+		}
+		busy++;
+	};
+	for (int l = 0; l < N; l++) {
+		start(l);
+	}
+
+	while (busy > 0) {
+		for (int l = 0; l < N; l++) {
+			const typename V::Message *m = lane[l].message;
+			if (!m) {
+				blocks[l] = idle_block;
+				t[l] = 0;
+				f[l] = 0;
+				continue;
+			}
+			// Same block layout as HashLanes: the state's pending bytes, then in
+			const size_t prefix = m->S->buflen;
+			const size_t total = prefix + m->inlen;
+			const size_t begin = lane[l].block * BLOCK;
+			const size_t length = lane[l].block < lane[l].nonfinal ? BLOCK : total - begin;
+			if (begin >= prefix && length == BLOCK) {
+				blocks[l] = m->in + (begin - prefix);
+			} else {
+				size_t filled = 0;
+				if (begin < prefix) {
+					filled = prefix - begin < length ? prefix - begin : length;
+					memcpy(staging[l], m->S->buf + begin, filled);
+				}
+				if (filled < length) {
+					memcpy(staging[l] + filled, m->in + (begin + filled - prefix), length - filled);
+				}
+				memset(staging[l] + length, 0, BLOCK - length);
+				blocks[l] = staging[l];
+			}
+			lane[l].counter += length;
+			t[l] = lane[l].counter;
+			f[l] = lane[l].block == lane[l].nonfinal ? static_cast<W>(~static_cast<W>(0)) : 0;
+		}
+
+		CompressLanes(h, blocks, t, f);
+
+		for (int l = 0; l < N; l++) {
+			const typename V::Message *m = lane[l].message;
+			if (!m) {
+				continue;
+			}
+			if (lane[l].block < lane[l].nonfinal) {
+				lane[l].block++;
+				continue;
+			}
+			uint8_t digest[8 * sizeof(W)];
+			for (int i = 0; i < 8; i++) {
+				V::Store(digest + i * sizeof(W), h[i][l]);
+			}
+			memcpy(m->out, digest, m->S->outlen);
+			busy--;
+			start(l);
+		}
+	}
+}
+
+template<typename W>
+void UpdateMany(const typename Variant<W>::UpdateOp *updates, size_t count) {
+	typedef Variant<W> V;
+	const int N = V::LANES;
+	const size_t BLOCK = V::BLOCK;
+	static const uint8_t idle_block[BLOCK] = {0};
+
+	struct Lane {
+		const typename V::UpdateOp *update;
+		size_t block;
+		// Blocks to compress; like blake2b_update, the last one stays buffered
+		size_t blocks;
+		uint64_t counter;
+	} lane[N];
+
+	W h[8][N];
+	W f[N] = {0};
+	uint64_t t[N];
+	const uint8_t *blocks[N];
+	uint8_t staging[N][BLOCK];
+
+	size_t next = 0;
+	int busy = 0;
+	auto start = [&](int l) {
+		lane[l].update = nullptr;
+		while (next < count) {
+			const typename V::UpdateOp *u = &updates[next++];
+			typename V::State *S = u->S;
+			const size_t total = S->buflen + u->inlen;
+			if (total <= BLOCK) {
+				memcpy(S->buf + S->buflen, u->in, u->inlen);
+				S->buflen = total;
+				continue;
+			}
+			lane[l].update = u;
+			lane[l].block = 0;
+			lane[l].blocks = (total - 1) / BLOCK;
+			lane[l].counter = V::Counter(S);
+			for (int i = 0; i < 8; i++) {
+				h[i][l] = S->h[i];
+			}
+			busy++;
+			return;
+		}
+	};
+	for (int l = 0; l < N; l++) {
+		start(l);
+	}
+
+	while (busy > 0) {
+		for (int l = 0; l < N; l++) {
+			const typename V::UpdateOp *u = lane[l].update;
+			if (!u) {
+				blocks[l] = idle_block;
+				t[l] = 0;
+				continue;
+			}
+			// The buffered bytes come first, so only block 0 may need them
+			const size_t prefix = u->S->buflen;
+			const size_t begin = lane[l].block * BLOCK;
+			if (begin >= prefix) {
+				blocks[l] = u->in + (begin - prefix);
+			} else {
+				memcpy(staging[l], u->S->buf, prefix);
+				memcpy(staging[l] + prefix, u->in, BLOCK - prefix);
+				blocks[l] = staging[l];
+			}
+			lane[l].counter += BLOCK;
+			t[l] = lane[l].counter;
+		}
+
+		CompressLanes(h, blocks, t, f);
+
+		for (int l = 0; l < N; l++) {
+			const typename V::UpdateOp *u = lane[l].update;
+			if (!u || ++lane[l].block < lane[l].blocks) {
+				continue;
+			}
+			typename V::State *S = u->S;
+			for (int i = 0; i < 8; i++) {
+				S->h[i] = h[i][l];
+			}
+			V::SetCounter(S, lane[l].counter);
+			const size_t used = lane[l].blocks * BLOCK - S->buflen;
+			memcpy(S->buf, u->in + used, u->inlen - used);
+			S->buflen = u->inlen - used;
+			busy--;
+			start(l);
+		}
+	}
+}
+
+template<typename W>
+void AbsorbPending(typename Variant<W>::State *S) {
+	typedef Variant<W> V;
+	if (S->buflen != static_cast<size_t>(V::BLOCK)) {
+		return;
+	}
+	W h[8][1];
+	for (int i = 0; i < 8; i++) {
+		h[i][0] = S->h[i];
+	}
+	const uint8_t *blocks[1] = { S->buf };
+	const uint64_t t[1] = { V::Counter(S) + V::BLOCK };
+	const W f[1] = { 0 };
+	Compress<W, 1>(h, blocks, t, f);
+	for (int i = 0; i < 8; i++) {
+		S->h[i] = h[i][0];
+	}
+	V::SetCounter(S, t[0]);
+	S->buflen = 0;
+}
+
+}  // namespace
+
+void blake2b_compress_lanes(uint64_t h[8][BLAKE2B_LANES], const uint8_t *const blocks[BLAKE2B_LANES], const uint64_t t[BLAKE2B_LANES], const uint64_t f[BLAKE2B_LANES]) {
+#ifdef LANES_AVX2_DISPATCH
+	if (use_avx2) {
+		return blake2b_compress_avx2(h, blocks, t, f);
+	}
+#endif
+	blake2b_compress_generic(h, blocks, t, f);
+}
+
+void blake2s_compress_lanes(uint32_t h[8][BLAKE2S_LANES], const uint8_t *const blocks[BLAKE2S_LANES], const uint64_t t[BLAKE2S_LANES], const uint32_t f[BLAKE2S_LANES]) {
+#ifdef LANES_AVX2_DISPATCH
+	if (use_avx2) {
+		return blake2s_compress_avx2(h, blocks, t, f);
+	}
+#endif
+	blake2s_compress_generic(h, blocks, t, f);
+}
+
+void blake2b_hash_lanes(const blake2b_state *S, const uint8_t *const *in, size_t inlen, uint8_t *const *out, size_t lanes) {
+	StatsCountBytes(ANY_BLAKE2B, inlen * lanes);
+	StatsCountDigests(ANY_BLAKE2B, lanes);
+	HashLanes<uint64_t>(S, in, inlen, out, lanes);
+}
+
+void blake2s_hash_lanes(const blake2s_state *S, const uint8_t *const *in, size_t inlen, uint8_t *const *out, size_t lanes) {
+	StatsCountBytes(ANY_BLAKE2S, inlen * lanes);
+	StatsCountDigests(ANY_BLAKE2S, lanes);
+	HashLanes<uint32_t>(S, in, inlen, out, lanes);
+}
+
+void blake2b_hash_many(const blake2b_message *messages, size_t count) {
+	if (stats_enabled) {
+		size_t bytes = 0;
+		for (size_t i = 0; i < count; i++) {
+			bytes += messages[i].inlen;
+		}
+		StatsCountBytes(ANY_BLAKE2B, bytes);
+		StatsCountDigests(ANY_BLAKE2B, count);
+	}
+	HashMany<uint64_t>(messages, count);
+}
+
+void blake2s_hash_many(const blake2s_message *messages, size_t count) {
+	if (stats_enabled) {
+		size_t bytes = 0;
+		for (size_t i = 0; i < count; i++) {
+			bytes += messages[i].inlen;
+		}
+		StatsCountBytes(ANY_BLAKE2S, bytes);
+		StatsCountDigests(ANY_BLAKE2S, count);
+	}
+	HashMany<uint32_t>(messages, count);
+}
+
+void blake2b_update_many(const blake2b_update_op *updates, size_t count) {
+	if (stats_enabled) {
+		size_t bytes = 0;
+		for (size_t i = 0; i < count; i++) {
+			bytes += updates[i].inlen;
+		}
+		StatsCountBytes(ANY_BLAKE2B, bytes);
+	}
+	UpdateMany<uint64_t>(updates, count);
+}
+
+void blake2s_update_many(const blake2s_update_op *updates, size_t count) {
+	if (stats_enabled) {
+		size_t bytes = 0;
+		for (size_t i = 0; i < count; i++) {
+			bytes += updates[i].inlen;
+		}
+		StatsCountBytes(ANY_BLAKE2S, bytes);
+	}
+	UpdateMany<uint32_t>(updates, count);
+}
+
+void blake2b_absorb_pending(blake2b_state *S) {
+	AbsorbPending<uint64_t>(S);
+}
+
+void blake2s_absorb_pending(blake2s_state *S) {
+	AbsorbPending<uint32_t>(S);
+}
+
+bool blake2_lanes_accelerated() {
+#if defined(__AVX2__)
+	return true;
+#elif defined(LANES_AVX2_DISPATCH)
+	return use_avx2;
+#else
+	return false;
+#endif
+}
@@ -0,0 +1,105 @@
+#ifndef NODE_BLAKE2_LANES_H
+#define NODE_BLAKE2_LANES_H
+
+#include <cstddef>
+#include <cstdint>
+
+#include "blake2.h"
+
+/*
+ * Multi-buffer BLAKE2b and BLAKE2s: one compression call advances several
+ * independent states at once, with the states transposed so that word i of
+ * every lane sits side by side (h[i][lane]).  The lane loops are written so
+ * that the compiler turns each one into a single vector operation; on x86 an
+ * AVX2 build of the same code is picked at runtime when the CPU has it.
+ */
+
+enum {
+	BLAKE2B_LANES = 4,
+	BLAKE2S_LANES = 8
+};
+
+/**
+ * Compresses blocks[lane] into h[..][lane] for every lane.  t[lane] is the
+ * byte counter after this block, f[lane] is all ones for a final block.
+ */
+void blake2b_compress_lanes(uint64_t h[8][BLAKE2B_LANES], const uint8_t *const blocks[BLAKE2B_LANES], const uint64_t t[BLAKE2B_LANES], const uint64_t f[BLAKE2B_LANES]);
+void blake2s_compress_lanes(uint32_t h[8][BLAKE2S_LANES], const uint8_t *const blocks[BLAKE2S_LANES], const uint64_t t[BLAKE2S_LANES], const uint32_t f[BLAKE2S_LANES]);
+
+/**
+ * Hashes up to BLAKE2B_LANES (BLAKE2S_LANES) messages of the same length,
+ * each as if blake2b_update(S, in[lane], inlen) and blake2b_final had been
+ * called on its own copy of S.  S is not modified.  `lanes` may be smaller
+ * than the lane count; unused lanes are simply not computed into `out`.
+ */
+void blake2b_hash_lanes(const blake2b_state *S, const uint8_t *const *in, size_t inlen, uint8_t *const *out, size_t lanes);
+void blake2s_hash_lanes(const blake2s_state *S, const uint8_t *const *in, size_t inlen, uint8_t *const *out, size_t lanes);
+
+/**
+ * One message for blake2b_hash_many (blake2s_hash_many): hashed as if
+ * blake2b_update(S, in, inlen) and blake2b_final(S, out, S->outlen) had been
+ * called on a copy of *S.
+ */
+struct blake2b_message {
+	const blake2b_state *S;
+	const uint8_t *in;
+	size_t inlen;
+	uint8_t *out;
+};
+
+struct blake2s_message {
+	const blake2s_state *S;
+	const uint8_t *in;
+	size_t inlen;
+	uint8_t *out;
+};
+
+/**
+ * Hashes `count` messages of any lengths, each from its own state.  A lane
+ * moves on to the next message as soon as it finishes one, so the lanes stay
+ * busy however much the lengths vary.
+ */
+void blake2b_hash_many(const blake2b_message *messages, size_t count);
+void blake2s_hash_many(const blake2s_message *messages, size_t count);
+
+/**
+ * One update for blake2b_update_many (blake2s_update_many): applied as if
+ * blake2b_update(S, in, inlen) had been called.
+ */
+struct blake2b_update_op {
+	blake2b_state *S;
+	const uint8_t *in;
+	size_t inlen;
+};
+
+struct blake2s_update_op {
+	blake2s_state *S;
+	const uint8_t *in;
+	size_t inlen;
+};
+
+/**
+ * Applies `count` updates to as many different states.  The blocks the
+ * updates complete are compressed through the lanes, one state per lane,
+ * and each state is written back once its blocks are done; input that does
+ * not complete a block is only buffered.  No state may appear twice.
+ */
+void blake2b_update_many(const blake2b_update_op *updates, size_t count);
+void blake2s_update_many(const blake2s_update_op *updates, size_t count);
+
+/**
+ * If S holds a full block that is known not to be the last one (typically
+ * the key block right after blake2b_init_key), compresses it now so that
+ * copies of S start from the post-key state.  S must not be finalized
+ * without further input afterwards.
+ */
+void blake2b_absorb_pending(blake2b_state *S);
+void blake2s_absorb_pending(blake2s_state *S);
+
+/**
+ * True when the lane kernels run on vector units wide enough to make
+ * them faster than hashing the messages one after another.
+ */
+bool blake2_lanes_accelerated();
+
+#endif
@@ -0,0 +1,419 @@
+#include <node.h>
+#include <node_buffer.h>
+#include <v8.h>
+#include <nan.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <string>
+
+#include "any_blake2.h"
+#include "blake2_addon.h"
+#include "blake2_lanes.h"
+#include "byte_order.h"
+#include "file_io.h"
+#include "stats.h"
+#include "trace.h"
+
+/*
+ * A blocked Bloom filter: every item sets `probes` bits inside one 64-byte
+ * block, so a lookup touches a single cache line.  The block and the bits
+ * come from 16 bytes of one hash: a 16-byte BLAKE2s digest of the value
+ * keyed with the filter's salt, or the first 16 bytes of a digest given
+ * directly.  The filter lives in caller-provided storage (a
+ * SharedArrayBuffer for worker threads, or a mapped file) laid out as:
+ *
+ *   0   magic "B2BLOOM\0"
+ *   8   version u32 LE
+ *   12  probes per item u32 LE
+ *   16  blocks u64 LE
+ *   24  salt, 16 bytes
+ *   40  items added, native-endian 64-bit atomic
+ *   64  blocks of 64 bytes, each eight native-endian 64-bit atomic words
+ *
+ * Bits are set with relaxed atomic ORs, so any number of threads may add and
+ * query at once.
+ */
+
+static const char BLOOM_MAGIC[8] = {'B', '2', 'B', 'L', 'O', 'O', 'M', '\0'};
+static const uint32_t BLOOM_VERSION = 1;
+static const size_t BLOOM_HEADER_BYTES = 64;
+static const size_t BLOOM_VERSION_OFFSET = 8;
+static const size_t BLOOM_PROBES_OFFSET = 12;
+static const size_t BLOOM_BLOCKS_OFFSET = 16;
+static const size_t BLOOM_SALT_OFFSET = 24;
+static const size_t BLOOM_COUNT_OFFSET = 40;
+static const size_t BLOOM_SALT_BYTES = 16;
+static const size_t BLOOM_BLOCK_BYTES = 64;
+static const size_t BLOOM_BLOCK_WORDS = BLOOM_BLOCK_BYTES / 8;
+static const uint32_t BLOOM_MAX_PROBES = 32;
+
+// The 16 hash bytes an item is placed by
+static const size_t BLOOM_HASH_BYTES = 16;
+
+// Items hashed, then prefetched, then probed at once
+static const size_t BLOOM_BATCH = 64;
+
+static_assert(std::atomic<uint64_t>::is_always_lock_free, "filter words must be lock-free to be shared between threads");
+
+struct BloomHash {
+	uint64_t block;
+	uint64_t bits;
+};
+
+class BloomFilterView {
+ public:
+	/**
+	 * Writes an empty filter over all of `length` bytes at `base`.
+	 */
+	static const char *Format(uint8_t *base, size_t length, uint32_t probes, const uint8_t *salt) {
+		if (length < BLOOM_HEADER_BYTES + BLOOM_BLOCK_BYTES) {
+			return "Bloom filter storage is too small";
+		}
+		memset(base, 0, length);
+		memcpy(base, BLOOM_MAGIC, sizeof(BLOOM_MAGIC));
+		store_le32(base + BLOOM_VERSION_OFFSET, BLOOM_VERSION);
+		store_le32(base + BLOOM_PROBES_OFFSET, probes);
+		store_le64(base + BLOOM_BLOCKS_OFFSET, (length - BLOOM_HEADER_BYTES) / BLOOM_BLOCK_BYTES);
+		memcpy(base + BLOOM_SALT_OFFSET, salt, BLOOM_SALT_BYTES);
+		return nullptr;
+	}
+
+	/**
+	 * Validates the filter at `base`.  The hashing state is only set up on
+	 * the first call; later calls just follow the storage if it moved.
+	 */
+	const char *Attach(uint8_t *base, size_t length) {
+		if (reinterpret_cast<uintptr_t>(base) % alignof(std::atomic<uint64_t>) != 0) {
+			return "Bloom filter storage must be 8-byte aligned";
+		}
+		if (length < BLOOM_HEADER_BYTES || memcmp(base, BLOOM_MAGIC, sizeof(BLOOM_MAGIC)) != 0) {
+			return "Not a Bloom filter";
+		}
+		if (load_le32(base + BLOOM_VERSION_OFFSET) != BLOOM_VERSION) {
+			return "Unsupported Bloom filter version";
+		}
+		const uint32_t probes = load_le32(base + BLOOM_PROBES_OFFSET);
+		const uint64_t blocks = load_le64(base + BLOOM_BLOCKS_OFFSET);
+		if (probes == 0 || probes > BLOOM_MAX_PROBES || blocks == 0 || blocks > (length - BLOOM_HEADER_BYTES) / BLOOM_BLOCK_BYTES) {
+			return "Bloom filter header is corrupt";
+		}
+
+		if (!base_) {
+			any_blake2 h;
+			const char *error = any_blake2_init(&h, ANY_BLAKE2S, base + BLOOM_SALT_OFFSET, BLOOM_SALT_BYTES, BLOOM_HASH_BYTES);
+			if (error) {
+				return error;
+			}
+			post_key_ = h.state.casted_blake2s_state;
+			blake2s_absorb_pending(&post_key_);
+			initial_ = h.state.casted_blake2s_state;
+		}
+		base_ = base;
+		probes_ = probes;
+		blocks_ = blocks;
+		return nullptr;
+	}
+
+	uint64_t Count() const {
+		return Counter()->load(std::memory_order_relaxed);
+	}
+
+	/**
+	 * Places the values ending at each of `ends` in `data`.
+	 */
+	void HashValues(const uint8_t *data, const uint32_t *ends, size_t count, BloomHash *out) const {
+		TraceSpan span(TRACE_BATCH, ANY_BLAKE2S, count ? ends[count - 1] : 0);
+		uint8_t digests[BLOOM_BATCH][BLOOM_HASH_BYTES];
+		blake2s_message messages[BLOOM_BATCH];
+		for (size_t first = 0; first < count; first += BLOOM_BATCH) {
+			const size_t batch = std::min(count - first, BLOOM_BATCH);
+			for (size_t j = 0; j < batch; j++) {
+				const size_t i = first + j;
+				const uint32_t start = i ? ends[i - 1] : 0;
+				messages[j].in = data + start;
+				messages[j].inlen = ends[i] - start;
+				messages[j].S = messages[j].inlen ? &post_key_ : &initial_;
+				messages[j].out = digests[j];
+			}
+			if (blake2_lanes_accelerated()) {
+				blake2s_hash_many(messages, batch);
+			} else {
+				for (size_t j = 0; j < batch; j++) {
+					blake2s_state S = *messages[j].S;
+					StatsCountBytes(ANY_BLAKE2S, messages[j].inlen);
+					StatsCountDigests(ANY_BLAKE2S, 1);
+					blake2s_update(&S, messages[j].in, messages[j].inlen);
+					blake2s_final(&S, digests[j], BLOOM_HASH_BYTES);
+				}
+			}
+			HashDigests(digests[0], BLOOM_HASH_BYTES, batch, out + first);
+		}
+	}
+
+	/**
+	 * Places `count` digests of `width` bytes each, stored back to back.
+	 */
+	void HashDigests(const uint8_t *digests, size_t width, size_t count, BloomHash *out) const {
+		for (size_t i = 0; i < count; i++) {
+			out[i].block = load_le64(digests + i * width) % blocks_;
+			out[i].bits = load_le64(digests + i * width + 8);
+		}
+	}
+
+	void Add(const BloomHash *hashes, size_t count) {
+		Prefetch(hashes, count);
+		for (size_t i = 0; i < count; i++) {
+			uint64_t masks[BLOOM_BLOCK_WORDS];
+			Masks(hashes[i].bits, masks);
+			std::atomic<uint64_t> *block = Block(hashes[i].block);
+			for (size_t w = 0; w < BLOOM_BLOCK_WORDS; w++) {
+				if (masks[w] && (block[w].load(std::memory_order_relaxed) & masks[w]) != masks[w]) {
+					block[w].fetch_or(masks[w], std::memory_order_relaxed);
+				}
+			}
+		}
+		Counter()->fetch_add(count, std::memory_order_relaxed);
+	}
+
+	/**
+	 * Sets out[i] to 1 if item i may have been added, 0 if it surely was not.
+	 */
+	void Has(const BloomHash *hashes, size_t count, uint8_t *out) const {
+		Prefetch(hashes, count);
+		for (size_t i = 0; i < count; i++) {
+			uint64_t masks[BLOOM_BLOCK_WORDS];
+			Masks(hashes[i].bits, masks);
+			const std::atomic<uint64_t> *block = Block(hashes[i].block);
+			uint8_t found = 1;
+			for (size_t w = 0; w < BLOOM_BLOCK_WORDS; w++) {
+				if ((block[w].load(std::memory_order_relaxed) & masks[w]) != masks[w]) {
+					found = 0;
+					break;
+				}
+			}
+			out[i] = found;
+		}
+	}
+
+ private:
+	std::atomic<uint64_t> *Counter() const {
+		return reinterpret_cast<std::atomic<uint64_t>*>(base_ + BLOOM_COUNT_OFFSET);
+	}
+
+	std::atomic<uint64_t> *Block(uint64_t block) const {
+		return reinterpret_cast<std::atomic<uint64_t>*>(base_ + BLOOM_HEADER_BYTES + block * BLOOM_BLOCK_BYTES);
+	}
+
+	void Prefetch(const BloomHash *hashes, size_t count) const {
+#if defined(__GNUC__)
+		for (size_t i = 0; i < count; i++) {
+			__builtin_prefetch(Block(hashes[i].block));
+		}
+#endif
+	}
+
+	// Probe j sets bit (a + j * b) mod 512 of the block, with b odd
+	void Masks(uint64_t bits, uint64_t *masks) const {
+		const uint32_t a = static_cast<uint32_t>(bits);
+		const uint32_t b = static_cast<uint32_t>(bits >> 32) | 1;
+		memset(masks, 0, BLOOM_BLOCK_WORDS * sizeof(uint64_t));
+		for (uint32_t j = 0; j < probes_; j++) {
+			const uint32_t bit = (a + j * b) % (BLOOM_BLOCK_BYTES * 8);
+			masks[bit / 64] |= uint64_t(1) << (bit % 64);
+		}
+	}
+
+	uint8_t *base_ = nullptr;
+	uint32_t probes_ = 0;
+	uint64_t blocks_ = 0;
+	blake2s_state initial_;
+	blake2s_state post_key_;
+};
+
+static void FreeMappedFile(char *data, void *hint) {
+	delete static_cast<MappedFile*>(hint);
+}
+
+class BloomFilter: public Nan::ObjectWrap {
+	BloomFilterView filter;
+	Nan::Persistent<v8::Object> storage;
+	// The mapping behind `storage` for a filter loaded from a file; the
+	// storage Buffer owns it and outlives this object
+	MappedFile *mapped = nullptr;
+
+ public:
+	~BloomFilter() {
+		storage.Reset();
+	}
+
+	static NAN_MODULE_INIT(Init) {
+		v8::Local<v8::FunctionTemplate> tpl = Nan::New<v8::FunctionTemplate>(New);
+		tpl->SetClassName(Nan::New("BloomFilter").ToLocalChecked());
+		tpl->InstanceTemplate()->SetInternalFieldCount(1);
+		Nan::SetPrototypeMethod(tpl, "add", Add);
+		Nan::SetPrototypeMethod(tpl, "has", Has);
+		Nan::SetPrototypeMethod(tpl, "count", Count);
+		Nan::SetPrototypeMethod(tpl, "storage", Storage);
+		Nan::SetPrototypeMethod(tpl, "save", Save);
+		Nan::Set(target, Nan::New("BloomFilter").ToLocalChecked(), Nan::GetFunction(tpl).ToLocalChecked());
+	}
+
+	/**
+	 * new BloomFilter(storage, probes, salt): formats `storage` (a Uint8Array
+	 * over a SharedArrayBuffer, a mapped file or any other memory) as an
+	 * empty filter, or with only `storage` attaches to the filter in it.
+	 * new BloomFilter(path, shared) maps the filter saved in a file.
+	 */
+	static NAN_METHOD(New) {
+		if (!info.IsConstructCall()) {
+			return Nan::ThrowError("Constructor must be called with new");
+		}
+		v8::Local<v8::Object> object;
+		MappedFile *mapped = nullptr;
+		if (info.Length() >= 2 && info[0]->IsString() && info[1]->IsBoolean()) {
+			mapped = new MappedFile();
+			if (!mapped->Open(*Nan::Utf8String(info[0]), info[1]->IsTrue())) {
+				std::string error = "Cannot map " + std::string(*Nan::Utf8String(info[0])) + ": " + ReadOnlyFile::LastError();
+				delete mapped;
+				return Nan::ThrowError(error.c_str());
+			}
+			object = Nan::NewBuffer(reinterpret_cast<char*>(mapped->Data()), mapped->Length(), FreeMappedFile, mapped).ToLocalChecked();
+		} else if (info.Length() >= 1 && node::Buffer::HasInstance(info[0])) {
+			object = info[0].As<v8::Object>();
+		} else {
+			return Nan::ThrowError(v8::Exception::TypeError(Nan::New<v8::String>("Storage must be a Uint8Array").ToLocalChecked()));
+		}
+		uint8_t *base = reinterpret_cast<uint8_t*>(node::Buffer::Data(object));
+		const size_t length = node::Buffer::Length(object);
+
+		if (!mapped && info.Length() >= 3) {
+			if (!info[1]->IsUint32() || Nan::To<uint32_t>(info[1]).FromJust() == 0 || Nan::To<uint32_t>(info[1]).FromJust() > BLOOM_MAX_PROBES) {
+				return Nan::ThrowError(v8::Exception::RangeError(Nan::New<v8::String>("Probes must be between 1 and 32").ToLocalChecked()));
+			}
+			if (!node::Buffer::HasInstance(info[2]) || node::Buffer::Length(info[2]) != BLOOM_SALT_BYTES) {
+				return Nan::ThrowError(v8::Exception::TypeError(Nan::New<v8::String>("Salt must be a Buffer of 16 bytes").ToLocalChecked()));
+			}
+			const char *error = BloomFilterView::Format(base, length, Nan::To<uint32_t>(info[1]).FromJust(), reinterpret_cast<const uint8_t*>(node::Buffer::Data(info[2])));
+			if (error) {
+				return Nan::ThrowError(error);
+			}
+		}
+
+		BloomFilter *obj = new BloomFilter();
+		obj->Wrap(info.This());
+		const char *error = obj->filter.Attach(base, length);
+		if (error) {
+			return Nan::ThrowError(error);
+		}
+		obj->storage.Reset(object);
+		obj->mapped = mapped;
+		info.GetReturnValue().Set(info.This());
+	}
+
+	// add(buffer, ends) or add(buffer, null, digestWidth)
+	static NAN_METHOD(Add) {
+		static thread_local std::vector<BloomHash> hashes;
+		BloomFilter *obj = Nan::ObjectWrap::Unwrap<BloomFilter>(info.This());
+		if (!obj->HashArguments(info, &hashes)) {
+			return;
+		}
+		obj->filter.Add(hashes.data(), hashes.size());
+	}
+
+	// has(buffer, ends) or has(buffer, null, digestWidth): a Buffer of 0 or 1 per item
+	static NAN_METHOD(Has) {
+		static thread_local std::vector<BloomHash> hashes;
+		BloomFilter *obj = Nan::ObjectWrap::Unwrap<BloomFilter>(info.This());
+		if (!obj->HashArguments(info, &hashes)) {
+			return;
+		}
+		v8::Local<v8::Object> found = Nan::NewBuffer(static_cast<uint32_t>(hashes.size())).ToLocalChecked();
+		obj->filter.Has(hashes.data(), hashes.size(), reinterpret_cast<uint8_t*>(node::Buffer::Data(found)));
+		info.GetReturnValue().Set(found);
+	}
+
+	// count(): items added so far, counting repeats
+	static NAN_METHOD(Count) {
+		BloomFilter *obj = Nan::ObjectWrap::Unwrap<BloomFilter>(info.This());
+		if (!obj->Reattach()) {
+			return;
+		}
+		info.GetReturnValue().Set(Nan::New<v8::Number>(static_cast<double>(obj->filter.Count())));
+	}
+
+	// storage(): the Uint8Array the filter lives in
+	static NAN_METHOD(Storage) {
+		BloomFilter *obj = Nan::ObjectWrap::Unwrap<BloomFilter>(info.This());
+		info.GetReturnValue().Set(Nan::New(obj->storage));
+	}
+
+	// save(path): writes the filter in the format that new BloomFilter(path) maps
+	static NAN_METHOD(Save) {
+		BloomFilter *obj = Nan::ObjectWrap::Unwrap<BloomFilter>(info.This());
+		if (info.Length() < 1 || !info[0]->IsString()) {
+			return Nan::ThrowError(v8::Exception::TypeError(Nan::New<v8::String>("Path must be a string").ToLocalChecked()));
+		}
+		const std::string path = *Nan::Utf8String(info[0]);
+		v8::Local<v8::Object> object = Nan::New(obj->storage);
+		if (!SaveFile(obj->mapped, path, node::Buffer::Data(object), node::Buffer::Length(object))) {
+			std::string error = "Cannot write " + path + ": " + ReadOnlyFile::LastError();
+			return Nan::ThrowError(error.c_str());
+		}
+	}
+
+ private:
+	// Follows the storage in case its memory moved
+	bool Reattach() {
+		v8::Local<v8::Object> object = Nan::New(storage);
+		const char *error = filter.Attach(reinterpret_cast<uint8_t*>(node::Buffer::Data(object)), node::Buffer::Length(object));
+		if (error) {
+			Nan::ThrowError(error);
+			return false;
+		}
+		return true;
+	}
+
+	bool HashArguments(const Nan::FunctionCallbackInfo<v8::Value> &info, std::vector<BloomHash> *hashes) {
+		if (info.Length() < 2 || !node::Buffer::HasInstance(info[0])) {
+			Nan::ThrowError(v8::Exception::TypeError(Nan::New<v8::String>("Bad argument; need a Buffer").ToLocalChecked()));
+			return false;
+		}
+		if (!Reattach()) {
+			return false;
+		}
+		const uint8_t *data = reinterpret_cast<const uint8_t*>(node::Buffer::Data(info[0]));
+		const size_t length = node::Buffer::Length(info[0]);
+
+		if (info[1]->IsUint32Array()) {
+			Nan::TypedArrayContents<uint32_t> ends(info[1]);
+			uint32_t previous = 0;
+			for (size_t i = 0; i < ends.length(); i++) {
+				if ((*ends)[i] < previous || (*ends)[i] > length) {
+					Nan::ThrowError(v8::Exception::RangeError(Nan::New<v8::String>("Value ends must be ascending and within the buffer").ToLocalChecked()));
+					return false;
+				}
+				previous = (*ends)[i];
+			}
+			hashes->resize(ends.length());
+			filter.HashValues(data, *ends, ends.length(), hashes->data());
+		} else if (info.Length() >= 3 && info[2]->IsUint32()) {
+			const uint32_t width = Nan::To<uint32_t>(info[2]).FromJust();
+			if (width < BLOOM_HASH_BYTES || length % width != 0) {
+				Nan::ThrowError(v8::Exception::RangeError(Nan::New<v8::String>("Digests must be at least 16 bytes each and fill the buffer").ToLocalChecked()));
+				return false;
+			}
+			hashes->resize(length / width);
+			filter.HashDigests(data, width, length / width, hashes->data());
+		} else {
+			Nan::ThrowError(v8::Exception::TypeError(Nan::New<v8::String>("Expected a Uint32Array of value ends or a digest width").ToLocalChecked()));
+			return false;
+		}
+		return true;
+	}
+};
+
+NAN_MODULE_INIT(InitBloomFilter) {
+	BloomFilter::Init(target);
+}
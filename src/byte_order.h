@@ -0,0 +1,34 @@
+#ifndef NODE_BLAKE2_BYTE_ORDER_H
+#define NODE_BLAKE2_BYTE_ORDER_H
+
+#include <cstdint>
+
+/*
+ * Records handed to JS are always little-endian, whatever the host.
+ */
+
+inline void store_le32(uint8_t *p, uint32_t v) {
+	p[0] = static_cast<uint8_t>(v);
+	p[1] = static_cast<uint8_t>(v >> 8);
+	p[2] = static_cast<uint8_t>(v >> 16);
+	p[3] = static_cast<uint8_t>(v >> 24);
+}
+
+inline void store_le64(uint8_t *p, uint64_t v) {
+	store_le32(p, static_cast<uint32_t>(v));
+	store_le32(p + 4, static_cast<uint32_t>(v >> 32));
+}
+
+inline uint32_t load_le32(const uint8_t *p) {
+	return static_cast<uint32_t>(p[0]) |
+		(static_cast<uint32_t>(p[1]) << 8) |
+		(static_cast<uint32_t>(p[2]) << 16) |
+		(static_cast<uint32_t>(p[3]) << 24);
+}
+
+inline uint64_t load_le64(const uint8_t *p) {
+	return static_cast<uint64_t>(load_le32(p)) |
+		(static_cast<uint64_t>(load_le32(p + 4)) << 32);
+}
+
+#endif
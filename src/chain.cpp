@@ -0,0 +1,219 @@
+#include <node.h>
+#include <node_buffer.h>
+#include <v8.h>
+#include <nan.h>
+
+#include <cstring>
+
+#include "any_blake2.h"
+#include "blake2_addon.h"
+#include "blake2_lanes.h"
+#include "trace.h"
+
+/*
+ * Hash chains for append-only logs: link_i = H(link_{i-1} || record_i),
+ * starting from a given link_0 (all zeros by default).  A batch of records
+ * is passed as one Buffer plus the end offset of every record in it.
+ */
+
+class ChainHasher {
+ public:
+	void Reset(const any_blake2 &initial, const uint8_t *link) {
+		post_key_ = initial;
+		// Every message starts with a link, so it is never empty and the key
+		// block can be compressed once for the whole chain
+		if (initial.algo == ANY_BLAKE2B) {
+			blake2b_absorb_pending(&post_key_.state.casted_blake2b_state);
+		} else if (initial.algo == ANY_BLAKE2S) {
+			blake2s_absorb_pending(&post_key_.state.casted_blake2s_state);
+		}
+		if (link) {
+			memcpy(link_, link, initial.outbytes);
+		} else {
+			memset(link_, 0, sizeof(link_));
+		}
+	}
+
+	size_t OutBytes() const {
+		return post_key_.outbytes;
+	}
+
+	const uint8_t *Link() const {
+		return link_;
+	}
+
+	/**
+	 * Advances the chain over every record; with `links` non-null, every
+	 * new link is written there back to back.
+	 */
+	void Append(const uint8_t *data, const uint32_t *ends, size_t count, uint8_t *links) {
+		TraceSpan span(TRACE_BATCH, post_key_.algo, count ? ends[count - 1] : 0);
+		uint32_t start = 0;
+		for (size_t i = 0; i < count; i++) {
+			Next(link_, data + start, ends[i] - start, link_);
+			if (links) {
+				memcpy(links + i * OutBytes(), link_, OutBytes());
+			}
+			start = ends[i];
+		}
+	}
+
+	/**
+	 * Rechecks a segment that followed `prev`.  Returns the index of the first
+	 * link that does not match, or -1 if they all do.
+	 */
+	int64_t Verify(const uint8_t *prev, const uint8_t *data, const uint32_t *ends, size_t count, const uint8_t *links) const {
+		TraceSpan span(TRACE_BATCH, post_key_.algo, count ? ends[count - 1] : 0);
+		uint8_t link[BLAKE2B_OUTBYTES];
+		uint32_t start = 0;
+		for (size_t i = 0; i < count; i++) {
+			Next(i == 0 ? prev : links + (i - 1) * OutBytes(), data + start, ends[i] - start, link);
+			if (memcmp(link, links + i * OutBytes(), OutBytes()) != 0) {
+				return static_cast<int64_t>(i);
+			}
+			start = ends[i];
+		}
+		return -1;
+	}
+
+ private:
+	void Next(const uint8_t *prev, const uint8_t *record, size_t length, uint8_t *out) const {
+		any_blake2 h;
+		any_blake2_copy(&h, &post_key_);
+		any_blake2_update(&h, prev, OutBytes());
+		any_blake2_update(&h, record, length);
+		any_blake2_final(&h, out);
+	}
+
+	any_blake2 post_key_;
+	uint8_t link_[BLAKE2B_OUTBYTES];
+};
+
+/**
+ * Record ends must be ascending and lie within a buffer of `length` bytes.
+ */
+static bool EndsValid(const uint32_t *ends, size_t count, size_t length) {
+	uint32_t previous = 0;
+	for (size_t i = 0; i < count; i++) {
+		if (ends[i] < previous || ends[i] > length) {
+			return false;
+		}
+		previous = ends[i];
+	}
+	return true;
+}
+
+static void ThrowBadEnds(v8::Local<v8::Value> value) {
+	if (!value->IsUint32Array()) {
+		Nan::ThrowError(v8::Exception::TypeError(Nan::New<v8::String>("Record ends must be a Uint32Array").ToLocalChecked()));
+	} else {
+		Nan::ThrowError(v8::Exception::RangeError(Nan::New<v8::String>("Record ends must be ascending and within the buffer").ToLocalChecked()));
+	}
+}
+
+class HashChain: public Nan::ObjectWrap {
+	ChainHasher chain;
+
+ public:
+	static NAN_MODULE_INIT(Init) {
+		v8::Local<v8::FunctionTemplate> tpl = Nan::New<v8::FunctionTemplate>(New);
+		tpl->SetClassName(Nan::New("HashChain").ToLocalChecked());
+		tpl->InstanceTemplate()->SetInternalFieldCount(1);
+		Nan::SetPrototypeMethod(tpl, "append", Append);
+		Nan::SetPrototypeMethod(tpl, "verify", Verify);
+		Nan::SetPrototypeMethod(tpl, "link", Link);
+		Nan::Set(target, Nan::New("HashChain").ToLocalChecked(), Nan::GetFunction(tpl).ToLocalChecked());
+	}
+
+	// new HashChain(algorithm, key, digestLength, link)
+	static NAN_METHOD(New) {
+		if (!info.IsConstructCall()) {
+			return Nan::ThrowError("Constructor must be called with new");
+		}
+
+		HashChain *obj = new HashChain();
+		obj->Wrap(info.This());
+
+		any_blake2 initial;
+		if (!HashFromArguments(info, 0, &initial)) {
+			return;
+		}
+		const uint8_t *link = nullptr;
+		if (info.Length() > 3 && !info[3]->IsNull() && !info[3]->IsUndefined()) {
+			if (!node::Buffer::HasInstance(info[3]) || node::Buffer::Length(info[3]) != initial.outbytes) {
+				return Nan::ThrowError(v8::Exception::TypeError(Nan::New<v8::String>("link must be a Buffer of digestLength bytes").ToLocalChecked()));
+			}
+			link = reinterpret_cast<const uint8_t*>(node::Buffer::Data(info[3]));
+		}
+		obj->chain.Reset(initial, link);
+		info.GetReturnValue().Set(info.This());
+	}
+
+	// append(buffer, ends, all): returns every new link, or only the last one
+	static NAN_METHOD(Append) {
+		HashChain *obj = Nan::ObjectWrap::Unwrap<HashChain>(info.This());
+
+		if (info.Length() < 2 || !node::Buffer::HasInstance(info[0])) {
+			return Nan::ThrowError(v8::Exception::TypeError(Nan::New<v8::String>("Bad argument; need a Buffer").ToLocalChecked()));
+		}
+		const uint8_t *data = reinterpret_cast<const uint8_t*>(node::Buffer::Data(info[0]));
+		if (!info[1]->IsUint32Array()) {
+			return ThrowBadEnds(info[1]);
+		}
+		Nan::TypedArrayContents<uint32_t> ends(info[1]);
+		if (!EndsValid(*ends, ends.length(), node::Buffer::Length(info[0]))) {
+			return ThrowBadEnds(info[1]);
+		}
+
+		const size_t outbytes = obj->chain.OutBytes();
+		if (info.Length() > 2 && info[2]->IsTrue()) {
+			v8::Local<v8::Object> links = Nan::NewBuffer(static_cast<uint32_t>(ends.length() * outbytes)).ToLocalChecked();
+			obj->chain.Append(data, *ends, ends.length(), reinterpret_cast<uint8_t*>(node::Buffer::Data(links)));
+			info.GetReturnValue().Set(links);
+		} else {
+			obj->chain.Append(data, *ends, ends.length(), nullptr);
+			info.GetReturnValue().Set(Nan::CopyBuffer(reinterpret_cast<const char*>(obj->chain.Link()), outbytes).ToLocalChecked());
+		}
+	}
+
+	// verify(prev, buffer, ends, links): index of the first bad link, or -1
+	static NAN_METHOD(Verify) {
+		HashChain *obj = Nan::ObjectWrap::Unwrap<HashChain>(info.This());
+		const size_t outbytes = obj->chain.OutBytes();
+
+		if (info.Length() < 4 || !node::Buffer::HasInstance(info[0]) || node::Buffer::Length(info[0]) != outbytes) {
+			return Nan::ThrowError(v8::Exception::TypeError(Nan::New<v8::String>("prev must be a Buffer of digestLength bytes").ToLocalChecked()));
+		}
+		if (!node::Buffer::HasInstance(info[1])) {
+			return Nan::ThrowError(v8::Exception::TypeError(Nan::New<v8::String>("Bad argument; need a Buffer").ToLocalChecked()));
+		}
+		if (!info[2]->IsUint32Array()) {
+			return ThrowBadEnds(info[2]);
+		}
+		Nan::TypedArrayContents<uint32_t> ends(info[2]);
+		if (!EndsValid(*ends, ends.length(), node::Buffer::Length(info[1]))) {
+			return ThrowBadEnds(info[2]);
+		}
+		if (!node::Buffer::HasInstance(info[3]) || node::Buffer::Length(info[3]) != ends.length() * outbytes) {
+			return Nan::ThrowError(v8::Exception::TypeError(Nan::New<v8::String>("links must be a Buffer of one link per record").ToLocalChecked()));
+		}
+
+		int64_t bad = obj->chain.Verify(
+			reinterpret_cast<const uint8_t*>(node::Buffer::Data(info[0])),
+			reinterpret_cast<const uint8_t*>(node::Buffer::Data(info[1])),
+			*ends,
+			ends.length(),
+			reinterpret_cast<const uint8_t*>(node::Buffer::Data(info[3]))
+		);
+		info.GetReturnValue().Set(Nan::New<v8::Number>(static_cast<double>(bad)));
+	}
+
+	static NAN_METHOD(Link) {
+		HashChain *obj = Nan::ObjectWrap::Unwrap<HashChain>(info.This());
+		info.GetReturnValue().Set(Nan::CopyBuffer(reinterpret_cast<const char*>(obj->chain.Link()), obj->chain.OutBytes()).ToLocalChecked());
+	}
+};
+
+NAN_MODULE_INIT(InitChain) {
+	HashChain::Init(target);
+}
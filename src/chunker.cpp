@@ -0,0 +1,320 @@
+#include <node.h>
+#include <node_buffer.h>
+#include <v8.h>
+#include <nan.h>
+
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include "any_blake2.h"
+#include "blake2_addon.h"
+#include "byte_order.h"
+#include "file_io.h"
+#include "stats.h"
+#include "trace.h"
+
+/*
+ * Content-defined chunking (FastCDC with normalized chunking, Xia et al.)
+ * that hashes every chunk with BLAKE2 while its bytes are still in cache.
+ *
+ * Each chunk produces one record: offset (u64 LE), length (u32 LE), digest.
+ */
+
+static const size_t CHUNK_RECORD_HEADER = 12;
+
+// Bytes scanned for a boundary before the scanned span is fed to BLAKE2.
+static const size_t CDC_SCAN_WINDOW = 16 * 1024;
+
+static const size_t CDC_FILE_READ_SIZE = 1024 * 1024;
+
+struct GearTable {
+	uint64_t values[256];
+
+	GearTable() {
+		// splitmix64, so the table (and therefore every boundary) is fixed
+		uint64_t x = 0x626c616b65326364ULL;
+		for (int i = 0; i < 256; i++) {
+			uint64_t z = (x += 0x9e3779b97f4a7c15ULL);
+			z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+			z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+			values[i] = z ^ (z >> 31);
+		}
+	}
+};
+
+static const GearTable gear;
+
+class CdcChunker {
+ public:
+	any_blake2_algo Algo() const {
+		return initial_.algo;
+	}
+
+	const char *Configure(uint32_t min_size, uint32_t avg_size, uint32_t max_size) {
+		if (min_size < 64 || min_size > avg_size || avg_size > max_size) {
+			return "Chunk sizes must satisfy 64 <= minSize <= avgSize <= maxSize";
+		}
+		min_size_ = min_size;
+		avg_size_ = avg_size;
+		max_size_ = max_size;
+
+		unsigned bits = 0;
+		while ((2ULL << bits) <= avg_size) {
+			bits++;
+		}
+		// Harder to cut before avgSize, easier after it; the mask bits are
+		// taken from the top of the fingerprint, which covers the last 64 bytes
+		mask_small_ = ~0ULL << (63 - bits);
+		mask_large_ = ~0ULL << (65 - bits);
+		return nullptr;
+	}
+
+	void Reset(const any_blake2 &initial) {
+		initial_ = initial;
+		chunk_ = initial;
+		offset_ = 0;
+		size_ = 0;
+		fingerprint_ = 0;
+	}
+
+	size_t RecordLength() const {
+		return CHUNK_RECORD_HEADER + initial_.outbytes;
+	}
+
+	void Update(const uint8_t *data, size_t length, std::vector<uint8_t> &records) {
+		while (length > 0) {
+			bool cut = false;
+			size_t n = Scan(data, length < CDC_SCAN_WINDOW ? length : CDC_SCAN_WINDOW, &cut);
+			any_blake2_update(&chunk_, data, n);
+			size_ += n;
+			data += n;
+			length -= n;
+			if (cut) {
+				Emit(records);
+			}
+		}
+	}
+
+	void Final(std::vector<uint8_t> &records) {
+		if (size_ > 0) {
+			Emit(records);
+		}
+	}
+
+ private:
+	size_t Scan(const uint8_t *data, size_t length, bool *cut) {
+		size_t i = 0;
+		uint64_t size = size_;
+		uint64_t fp = fingerprint_;
+
+		if (size < min_size_) {
+			size_t skip = min_size_ - size;
+			if (skip >= length) {
+				return length;
+			}
+			i = skip;
+			size += skip;
+		}
+
+		for (; i < length && size < avg_size_; i++, size++) {
+			fp = (fp << 1) + gear.values[data[i]];
+			if (!(fp & mask_small_)) {
+				*cut = true;
+				return i + 1;
+			}
+		}
+		for (; i < length && size < max_size_; i++, size++) {
+			fp = (fp << 1) + gear.values[data[i]];
+			if (!(fp & mask_large_)) {
+				*cut = true;
+				return i + 1;
+			}
+		}
+		if (size >= max_size_) {
+			*cut = true;
+		}
+		fingerprint_ = fp;
+		return i;
+	}
+
+	void Emit(std::vector<uint8_t> &records) {
+		size_t at = records.size();
+		records.resize(at + RecordLength());
+		uint8_t *record = records.data() + at;
+		store_le64(record, offset_);
+		store_le32(record + 8, static_cast<uint32_t>(size_));
+		any_blake2_final(&chunk_, record + CHUNK_RECORD_HEADER);
+
+		offset_ += size_;
+		size_ = 0;
+		fingerprint_ = 0;
+		memcpy(&chunk_.state, &initial_.state, any_blake2_state_size(initial_.algo));
+	}
+
+	uint32_t min_size_;
+	uint32_t avg_size_;
+	uint32_t max_size_;
+	uint64_t mask_small_;
+	uint64_t mask_large_;
+
+	any_blake2 initial_;
+	any_blake2 chunk_;
+	uint64_t offset_;
+	uint64_t size_;
+	uint64_t fingerprint_;
+};
+
+/**
+ * Reads (minSize, avgSize, maxSize) from info[first..first + 2] into chunker.
+ */
+static bool ConfigureFromArguments(const Nan::FunctionCallbackInfo<v8::Value> &info, int first, CdcChunker *chunker) {
+	uint32_t sizes[3];
+	for (int i = 0; i < 3; i++) {
+		if (info.Length() <= first + i || !info[first + i]->IsUint32()) {
+			Nan::ThrowError(v8::Exception::TypeError(Nan::New<v8::String>("Chunk sizes must be unsigned 32-bit integers").ToLocalChecked()));
+			return false;
+		}
+		sizes[i] = Nan::To<uint32_t>(info[first + i]).FromJust();
+	}
+	const char *error = chunker->Configure(sizes[0], sizes[1], sizes[2]);
+	if (error) {
+		Nan::ThrowError(error);
+		return false;
+	}
+	return true;
+}
+
+static v8::Local<v8::Object> RecordsToBuffer(const std::vector<uint8_t> &records) {
+	return Nan::CopyBuffer(reinterpret_cast<const char*>(records.data()), records.size()).ToLocalChecked();
+}
+
+class ChunkFileWorker: public Nan::AsyncWorker {
+ public:
+	ChunkFileWorker(Nan::Callback *callback, const std::string &path, const CdcChunker &chunker)
+		: Nan::AsyncWorker(callback, "blake2:chunkFile"), path_(path), chunker_(chunker) {}
+
+	void Execute() override {
+		ticket_.Started();
+		ReadOnlyFile file;
+		if (!file.Open(path_)) {
+			return SetErrorMessage(ReadOnlyFile::LastError().c_str());
+		}
+		TraceSpan span(TRACE_FILE, chunker_.Algo());
+		std::vector<uint8_t> buffer(CDC_FILE_READ_SIZE);
+		uint64_t offset = 0;
+		int64_t n;
+		while ((n = file.ReadAt(buffer.data(), buffer.size(), offset)) > 0) {
+			chunker_.Update(buffer.data(), static_cast<size_t>(n), records_);
+			span.AddBytes(static_cast<uint64_t>(n));
+			offset += n;
+		}
+		if (n < 0) {
+			return SetErrorMessage(ReadOnlyFile::LastError().c_str());
+		}
+		chunker_.Final(records_);
+	}
+
+	void HandleOKCallback() override {
+		Nan::HandleScope scope;
+		v8::Local<v8::Value> argv[] = { Nan::Null(), RecordsToBuffer(records_) };
+		callback->Call(2, argv, async_resource);
+	}
+
+ private:
+	StatsQueueTicket ticket_;
+	std::string path_;
+	CdcChunker chunker_;
+	std::vector<uint8_t> records_;
+};
+
+class Chunker: public Nan::ObjectWrap {
+	CdcChunker chunker;
+	bool initialized_;
+
+	Chunker() : initialized_(false) {}
+
+ public:
+	static NAN_MODULE_INIT(Init) {
+		v8::Local<v8::FunctionTemplate> tpl = Nan::New<v8::FunctionTemplate>(New);
+		tpl->SetClassName(Nan::New("Chunker").ToLocalChecked());
+		tpl->InstanceTemplate()->SetInternalFieldCount(1);
+		Nan::SetPrototypeMethod(tpl, "update", Update);
+		Nan::SetPrototypeMethod(tpl, "final", Final);
+		Nan::Set(target, Nan::New("Chunker").ToLocalChecked(), Nan::GetFunction(tpl).ToLocalChecked());
+		Nan::SetMethod(target, "chunkFile", ChunkFile);
+	}
+
+	// new Chunker(algorithm, key, digestLength, minSize, avgSize, maxSize)
+	static NAN_METHOD(New) {
+		if (!info.IsConstructCall()) {
+			return Nan::ThrowError("Constructor must be called with new");
+		}
+
+		Chunker *obj = new Chunker();
+		obj->Wrap(info.This());
+
+		any_blake2 initial;
+		if (!HashFromArguments(info, 0, &initial) || !ConfigureFromArguments(info, 3, &obj->chunker)) {
+			return;
+		}
+		obj->chunker.Reset(initial);
+		obj->initialized_ = true;
+
+		Nan::Set(info.This(), Nan::New("recordLength").ToLocalChecked(), Nan::New<v8::Uint32>(static_cast<uint32_t>(obj->chunker.RecordLength())));
+		info.GetReturnValue().Set(info.This());
+	}
+
+	static NAN_METHOD(Update) {
+		Chunker *obj = Nan::ObjectWrap::Unwrap<Chunker>(info.This());
+
+		if (!obj->initialized_) {
+			return Nan::ThrowError("Not initialized");
+		}
+		if (info.Length() < 1 || !node::Buffer::HasInstance(info[0])) {
+			return Nan::ThrowError(v8::Exception::TypeError(Nan::New<v8::String>("Bad argument; need a Buffer").ToLocalChecked()));
+		}
+
+		std::vector<uint8_t> records;
+		obj->chunker.Update(
+			reinterpret_cast<const uint8_t*>(node::Buffer::Data(info[0])),
+			node::Buffer::Length(info[0]),
+			records
+		);
+		info.GetReturnValue().Set(RecordsToBuffer(records));
+	}
+
+	static NAN_METHOD(Final) {
+		Chunker *obj = Nan::ObjectWrap::Unwrap<Chunker>(info.This());
+
+		if (!obj->initialized_) {
+			return Nan::ThrowError("Not initialized");
+		}
+		obj->initialized_ = false;
+
+		std::vector<uint8_t> records;
+		obj->chunker.Final(records);
+		info.GetReturnValue().Set(RecordsToBuffer(records));
+	}
+
+	// chunkFile(path, algorithm, key, digestLength, minSize, avgSize, maxSize, callback)
+	static NAN_METHOD(ChunkFile) {
+		if (info.Length() < 8 || !info[0]->IsString() || !info[7]->IsFunction()) {
+			return Nan::ThrowError(v8::Exception::TypeError(Nan::New<v8::String>("Expected a path and a callback").ToLocalChecked()));
+		}
+
+		CdcChunker chunker;
+		any_blake2 initial;
+		if (!HashFromArguments(info, 1, &initial) || !ConfigureFromArguments(info, 4, &chunker)) {
+			return;
+		}
+		chunker.Reset(initial);
+
+		Nan::Callback *callback = new Nan::Callback(info[7].As<v8::Function>());
+		Nan::AsyncQueueWorker(new ChunkFileWorker(callback, *Nan::Utf8String(info[0]), chunker));
+	}
+};
+
+NAN_MODULE_INIT(InitChunker) {
+	Chunker::Init(target);
+}
@@ -0,0 +1,617 @@
+#include <node.h>
+#include <v8.h>
+#include <nan.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#ifndef _WIN32
+#include <cerrno>
+#include <ctime>
+#include <fcntl.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include "blake2_addon.h"
+#include "byte_order.h"
+#include "digest_cache.h"
+
+/*
+ * File layout.  The header is
+ *
+ *   magic[8] || version (u32 LE) || record size (u32 LE) || committed count
+ *
+ * where the committed count is a native-endian 64-bit atomic updated in
+ * place through the mapping.  Each record is
+ *
+ *   dev || ino || size || mtime_ns || ctime_ns || params (u64 LE each)
+ *   || digest[64] || check[8] || padding
+ *
+ * with check the first 8 bytes of BLAKE2b over everything before it, so that
+ * records torn by a crash are skipped rather than trusted.
+ */
+
+static const char DIGEST_CACHE_MAGIC[8] = {'B', '2', 'D', 'C', 'A', 'C', 'H', 'E'};
+static const uint32_t DIGEST_CACHE_VERSION = 1;
+
+static const size_t DIGEST_CACHE_HEADER_SIZE = 64;
+static const size_t DIGEST_CACHE_COUNT_OFFSET = 16;
+static const size_t DIGEST_CACHE_RECORD_SIZE = 128;
+static const size_t DIGEST_CACHE_DIGEST_OFFSET = 48;
+static const size_t DIGEST_CACHE_CHECK_OFFSET = DIGEST_CACHE_DIGEST_OFFSET + BLAKE2B_OUTBYTES;
+static const size_t DIGEST_CACHE_CHECK_SIZE = 8;
+
+static const uint64_t DIGEST_CACHE_INITIAL_RECORDS = 1024;
+
+// Files with fewer records than this are never compacted
+static const uint64_t DIGEST_CACHE_COMPACT_MIN_RECORDS = 4096;
+
+// Changes closer together than this may share a timestamp
+static const int64_t DIGEST_CACHE_RACY_NS = 1000000000;
+
+static_assert(std::atomic<uint64_t>::is_always_lock_free, "the committed count must be lock-free to be shared between processes");
+
+struct DigestCacheMapping {
+	uint8_t *base;
+	size_t length;
+
+	DigestCacheMapping() : base(nullptr), length(0) {}
+	~DigestCacheMapping();
+
+	std::atomic<uint64_t> *Count() const {
+		return reinterpret_cast<std::atomic<uint64_t>*>(base + DIGEST_CACHE_COUNT_OFFSET);
+	}
+
+	const uint8_t *Record(uint64_t i) const {
+		return base + DIGEST_CACHE_HEADER_SIZE + i * DIGEST_CACHE_RECORD_SIZE;
+	}
+};
+
+static void RecordCheck(const uint8_t *record, uint8_t check[DIGEST_CACHE_CHECK_SIZE]) {
+	blake2b(check, DIGEST_CACHE_CHECK_SIZE, record, DIGEST_CACHE_CHECK_OFFSET, nullptr, 0);
+}
+
+static bool RecordValid(const uint8_t *record) {
+	uint8_t check[DIGEST_CACHE_CHECK_SIZE];
+	RecordCheck(record, check);
+	return memcmp(check, record + DIGEST_CACHE_CHECK_OFFSET, sizeof(check)) == 0;
+}
+
+static void EncodeRecord(const DigestCacheRecord &record, uint8_t *out) {
+	memset(out, 0, DIGEST_CACHE_RECORD_SIZE);
+	store_le64(out, record.key.dev);
+	store_le64(out + 8, record.key.ino);
+	store_le64(out + 16, record.key.size);
+	store_le64(out + 24, static_cast<uint64_t>(record.key.mtime_ns));
+	store_le64(out + 32, static_cast<uint64_t>(record.key.ctime_ns));
+	store_le64(out + 40, record.key.params);
+	memcpy(out + DIGEST_CACHE_DIGEST_OFFSET, record.digest, BLAKE2B_OUTBYTES);
+	RecordCheck(out, out + DIGEST_CACHE_CHECK_OFFSET);
+}
+
+static uint64_t Mix(uint64_t dev, uint64_t ino, uint64_t params) {
+	uint64_t x = dev * 0x9e3779b97f4a7c15ULL ^ ino ^ params * 0xc2b2ae3d27d4eb4fULL;
+	x ^= x >> 33;
+	x *= 0xff51afd7ed558ccdULL;
+	x ^= x >> 33;
+	return x;
+}
+
+static bool SameIdentity(const uint8_t *record, uint64_t dev, uint64_t ino, uint64_t params) {
+	return load_le64(record) == dev && load_le64(record + 8) == ino && load_le64(record + 40) == params;
+}
+
+bool operator==(const DigestCacheKey &a, const DigestCacheKey &b) {
+	return a.dev == b.dev && a.ino == b.ino && a.size == b.size &&
+		a.mtime_ns == b.mtime_ns && a.ctime_ns == b.ctime_ns && a.params == b.params;
+}
+
+/*
+ * The snapshot index is an open-addressing table of record numbers (plus
+ * one, so that zero marks an empty slot) keyed by (dev, ino, params).  A
+ * later record for the same file replaces the earlier one, so each file
+ * appears once with its newest digest.
+ */
+
+const uint8_t *DigestCacheSnapshot::Find(const DigestCacheKey &key) const {
+	if (slots_.empty()) {
+		return nullptr;
+	}
+	const size_t mask = slots_.size() - 1;
+	for (size_t i = Mix(key.dev, key.ino, key.params) & mask; slots_[i]; i = (i + 1) & mask) {
+		const uint8_t *record = mapping_->Record(slots_[i] - 1);
+		if (!SameIdentity(record, key.dev, key.ino, key.params)) {
+			continue;
+		}
+		if (load_le64(record + 16) != key.size ||
+				static_cast<int64_t>(load_le64(record + 24)) != key.mtime_ns ||
+				static_cast<int64_t>(load_le64(record + 32)) != key.ctime_ns) {
+			return nullptr;
+		}
+		return record + DIGEST_CACHE_DIGEST_OFFSET;
+	}
+	return nullptr;
+}
+
+bool DigestCacheSnapshot::Racy(const DigestCacheKey &key) const {
+	return key.mtime_ns > taken_ns_ - DIGEST_CACHE_RACY_NS || key.ctime_ns > taken_ns_ - DIGEST_CACHE_RACY_NS;
+}
+
+void DigestCacheSnapshot::Index(uint64_t from, uint64_t to) {
+	for (uint64_t i = from; i < to; i++) {
+		if (RecordValid(mapping_->Record(i))) {
+			Insert(static_cast<uint32_t>(i));
+		}
+	}
+}
+
+void DigestCacheSnapshot::Insert(uint32_t number) {
+	if ((live_ + 1) * 2 > slots_.size()) {
+		std::vector<uint32_t> old(std::max<size_t>(slots_.size() * 2, 64), 0);
+		old.swap(slots_);
+		live_ = 0;
+		for (uint32_t slot : old) {
+			if (slot) {
+				Insert(slot - 1);
+			}
+		}
+	}
+
+	const uint8_t *record = mapping_->Record(number);
+	const uint64_t dev = load_le64(record);
+	const uint64_t ino = load_le64(record + 8);
+	const uint64_t params = load_le64(record + 40);
+	const size_t mask = slots_.size() - 1;
+	size_t i = Mix(dev, ino, params) & mask;
+	for (; slots_[i]; i = (i + 1) & mask) {
+		if (SameIdentity(mapping_->Record(slots_[i] - 1), dev, ino, params)) {
+			slots_[i] = number + 1;
+			return;
+		}
+	}
+	slots_[i] = number + 1;
+	live_++;
+}
+
+uint64_t DigestCache::Params(const any_blake2 &initial) {
+	static const char probe[] = "blake2-digest-cache-params";
+
+	any_blake2 h;
+	any_blake2_copy(&h, &initial);
+	any_blake2_update(&h, probe, sizeof(probe));
+	uint8_t fingerprint[2 + BLAKE2B_OUTBYTES] = {static_cast<uint8_t>(initial.algo), initial.outbytes};
+	any_blake2_final(&h, fingerprint + 2);
+
+	uint8_t params[8];
+	blake2b(params, sizeof(params), fingerprint, 2 + h.outbytes, nullptr, 0);
+	return load_le64(params);
+}
+
+DigestCache::DigestCache(const std::string &path, uint64_t max_entries)
+	: path_(path), max_entries_(max_entries), fd_(-1), dev_(0), ino_(0) {}
+
+#ifdef _WIN32
+
+DigestCacheMapping::~DigestCacheMapping() {}
+
+DigestCache::~DigestCache() {}
+
+std::shared_ptr<DigestCache> DigestCache::Open(const std::string &path, uint64_t max_entries, std::string *error) {
+	*error = "The digest cache is not supported on Windows";
+	return nullptr;
+}
+
+bool DigestCache::Stat(const std::string &path, DigestCacheKey *key) {
+	return false;
+}
+
+std::shared_ptr<const DigestCacheSnapshot> DigestCache::Snapshot(std::string *error) {
+	*error = "The digest cache is not supported on Windows";
+	return nullptr;
+}
+
+bool DigestCache::Append(const std::vector<DigestCacheRecord> &records, std::string *error) {
+	*error = "The digest cache is not supported on Windows";
+	return false;
+}
+
+#else
+
+static std::string ErrnoMessage(const std::string &path) {
+	return path + ": " + strerror(errno);
+}
+
+static bool WriteAt(int fd, const uint8_t *data, size_t length, uint64_t offset) {
+	while (length > 0) {
+		ssize_t written = pwrite(fd, data, length, static_cast<off_t>(offset));
+		if (written < 0) {
+			if (errno == EINTR) {
+				continue;
+			}
+			return false;
+		}
+		data += written;
+		length -= static_cast<size_t>(written);
+		offset += static_cast<uint64_t>(written);
+	}
+	return true;
+}
+
+static bool LockFile(int fd, int operation) {
+	while (flock(fd, operation) != 0) {
+		if (errno != EINTR) {
+			return false;
+		}
+	}
+	return true;
+}
+
+static int64_t TimespecNs(const struct timespec &ts) {
+	return static_cast<int64_t>(ts.tv_sec) * 1000000000 + ts.tv_nsec;
+}
+
+static void EncodeHeader(uint64_t count, uint8_t *header) {
+	memset(header, 0, DIGEST_CACHE_HEADER_SIZE);
+	memcpy(header, DIGEST_CACHE_MAGIC, sizeof(DIGEST_CACHE_MAGIC));
+	store_le32(header + 8, DIGEST_CACHE_VERSION);
+	store_le32(header + 12, DIGEST_CACHE_RECORD_SIZE);
+	memcpy(header + DIGEST_CACHE_COUNT_OFFSET, &count, sizeof(count));
+}
+
+DigestCacheMapping::~DigestCacheMapping() {
+	if (base) {
+		munmap(base, length);
+	}
+}
+
+DigestCache::~DigestCache() {
+	if (fd_ != -1) {
+		close(fd_);
+	}
+}
+
+std::shared_ptr<DigestCache> DigestCache::Open(const std::string &path, uint64_t max_entries, std::string *error) {
+	std::shared_ptr<DigestCache> cache(new DigestCache(path, max_entries));
+	if (!cache->Reopen(error)) {
+		return nullptr;
+	}
+	return cache;
+}
+
+bool DigestCache::Stat(const std::string &path, DigestCacheKey *key) {
+	struct stat st;
+	if (stat(path.c_str(), &st) != 0) {
+		return false;
+	}
+	key->dev = static_cast<uint64_t>(st.st_dev);
+	key->ino = static_cast<uint64_t>(st.st_ino);
+	key->size = static_cast<uint64_t>(st.st_size);
+#ifdef __APPLE__
+	key->mtime_ns = TimespecNs(st.st_mtimespec);
+	key->ctime_ns = TimespecNs(st.st_ctimespec);
+#else
+	key->mtime_ns = TimespecNs(st.st_mtim);
+	key->ctime_ns = TimespecNs(st.st_ctim);
+#endif
+	return true;
+}
+
+/**
+ * (Re)opens path_, creating and initializing it if it is new.  Needed at
+ * first and whenever another process has renamed a compacted file over it.
+ */
+bool DigestCache::Reopen(std::string *error) {
+	int fd;
+	do {
+		fd = open(path_.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+	} while (fd == -1 && errno == EINTR);
+	if (fd == -1) {
+		*error = ErrnoMessage(path_);
+		return false;
+	}
+
+	struct stat st;
+	uint8_t header[DIGEST_CACHE_HEADER_SIZE];
+	bool ok = LockFile(fd, LOCK_EX) && fstat(fd, &st) == 0;
+	if (ok && st.st_size == 0) {
+		EncodeHeader(0, header);
+		ok = WriteAt(fd, header, sizeof(header), 0) &&
+			ftruncate(fd, DIGEST_CACHE_HEADER_SIZE + DIGEST_CACHE_INITIAL_RECORDS * DIGEST_CACHE_RECORD_SIZE) == 0 &&
+			fstat(fd, &st) == 0;
+	} else if (ok) {
+		const bool complete = pread(fd, header, sizeof(header), 0) == static_cast<ssize_t>(sizeof(header));
+		if (!complete || (memcmp(header, DIGEST_CACHE_MAGIC, sizeof(DIGEST_CACHE_MAGIC)) != 0 ||
+				load_le32(header + 8) != DIGEST_CACHE_VERSION ||
+				load_le32(header + 12) != DIGEST_CACHE_RECORD_SIZE)) {
+			LockFile(fd, LOCK_UN);
+			close(fd);
+			*error = path_ + ": not a digest cache";
+			return false;
+		}
+	}
+	if (!ok) {
+		*error = ErrnoMessage(path_);
+		close(fd);
+		return false;
+	}
+	LockFile(fd, LOCK_UN);
+
+	if (fd_ != -1) {
+		close(fd_);
+	}
+	fd_ = fd;
+	dev_ = static_cast<uint64_t>(st.st_dev);
+	ino_ = static_cast<uint64_t>(st.st_ino);
+	mapping_.reset();
+	snapshot_.reset();
+	return Map(0, error);
+}
+
+/**
+ * True if path_ still names the file we have open.
+ */
+bool DigestCache::Current() {
+	struct stat st;
+	return stat(path_.c_str(), &st) == 0 &&
+		static_cast<uint64_t>(st.st_dev) == dev_ && static_cast<uint64_t>(st.st_ino) == ino_;
+}
+
+/**
+ * Makes sure mapping_ covers the header and the first `count` records.
+ * Older mappings stay valid for the snapshots that still use them.
+ */
+bool DigestCache::Map(uint64_t count, std::string *error) {
+	if (mapping_ && mapping_->length >= DIGEST_CACHE_HEADER_SIZE + count * DIGEST_CACHE_RECORD_SIZE) {
+		return true;
+	}
+	struct stat st;
+	if (fstat(fd_, &st) != 0) {
+		*error = ErrnoMessage(path_);
+		return false;
+	}
+	std::shared_ptr<DigestCacheMapping> mapping = std::make_shared<DigestCacheMapping>();
+	mapping->length = static_cast<size_t>(st.st_size);
+	if (mapping->length < DIGEST_CACHE_HEADER_SIZE + count * DIGEST_CACHE_RECORD_SIZE) {
+		*error = path_ + ": truncated digest cache";
+		return false;
+	}
+	void *base = mmap(nullptr, mapping->length, PROT_READ | PROT_WRITE, MAP_SHARED, fd_, 0);
+	if (base == MAP_FAILED) {
+		*error = ErrnoMessage(path_);
+		return false;
+	}
+	mapping->base = static_cast<uint8_t*>(base);
+	mapping_ = mapping;
+	return true;
+}
+
+bool DigestCache::Lock(std::string *error) {
+	for (;;) {
+		if (!LockFile(fd_, LOCK_EX)) {
+			*error = ErrnoMessage(path_);
+			return false;
+		}
+		if (Current()) {
+			return true;
+		}
+		Unlock();
+		if (!Reopen(error)) {
+			return false;
+		}
+	}
+}
+
+void DigestCache::Unlock() {
+	LockFile(fd_, LOCK_UN);
+}
+
+std::shared_ptr<const DigestCacheSnapshot> DigestCache::Snapshot(std::string *error) {
+	std::lock_guard<std::mutex> lock(mutex_);
+	if (!Current() && !Reopen(error)) {
+		return nullptr;
+	}
+	const uint64_t count = mapping_->Count()->load(std::memory_order_acquire);
+	if (!Map(count, error)) {
+		return nullptr;
+	}
+
+	std::shared_ptr<DigestCacheSnapshot> snapshot = std::make_shared<DigestCacheSnapshot>();
+	uint64_t from = 0;
+	if (snapshot_ && snapshot_->count_ <= count) {
+		snapshot->slots_ = snapshot_->slots_;
+		snapshot->live_ = snapshot_->live_;
+		from = snapshot_->count_;
+	} else {
+		snapshot->live_ = 0;
+	}
+	struct timespec now;
+	clock_gettime(CLOCK_REALTIME, &now);
+	snapshot->taken_ns_ = TimespecNs(now);
+	snapshot->mapping_ = mapping_;
+	snapshot->count_ = count;
+	snapshot->Index(from, count);
+	snapshot_ = snapshot;
+	return snapshot_;
+}
+
+bool DigestCache::Append(const std::vector<DigestCacheRecord> &records, std::string *error) {
+	if (records.empty()) {
+		return true;
+	}
+	std::lock_guard<std::mutex> lock(mutex_);
+	if (!Lock(error)) {
+		return false;
+	}
+
+	const uint64_t count = mapping_->Count()->load(std::memory_order_acquire);
+	const uint64_t total = count + records.size();
+	struct stat st;
+	bool ok = fstat(fd_, &st) == 0;
+	const uint64_t capacity = ok ? (static_cast<uint64_t>(st.st_size) - DIGEST_CACHE_HEADER_SIZE) / DIGEST_CACHE_RECORD_SIZE : 0;
+	if (ok && total > capacity) {
+		ok = ftruncate(fd_, DIGEST_CACHE_HEADER_SIZE + std::max(total, capacity * 2) * DIGEST_CACHE_RECORD_SIZE) == 0;
+	}
+	if (ok) {
+		std::vector<uint8_t> encoded(records.size() * DIGEST_CACHE_RECORD_SIZE);
+		for (size_t i = 0; i < records.size(); i++) {
+			EncodeRecord(records[i], encoded.data() + i * DIGEST_CACHE_RECORD_SIZE);
+		}
+		ok = WriteAt(fd_, encoded.data(), encoded.size(), DIGEST_CACHE_HEADER_SIZE + count * DIGEST_CACHE_RECORD_SIZE);
+	}
+	if (!ok) {
+		*error = ErrnoMessage(path_);
+		Unlock();
+		return false;
+	}
+	// Readers only look at committed records, so this publishes them
+	mapping_->Count()->store(total, std::memory_order_release);
+
+	// Only rebuild the index to check when superseded records may dominate
+	const uint64_t live_estimate = snapshot_ ? snapshot_->live_ + records.size() : total;
+	if (total >= DIGEST_CACHE_COMPACT_MIN_RECORDS && (total >= 2 * live_estimate || live_estimate > max_entries_)) {
+		std::shared_ptr<DigestCacheSnapshot> full = std::make_shared<DigestCacheSnapshot>();
+		ok = Map(total, error);
+		if (ok) {
+			full->mapping_ = mapping_;
+			full->count_ = total;
+			full->live_ = 0;
+			full->taken_ns_ = 0;
+			full->Index(0, total);
+			if (total >= 2 * full->live_ || full->live_ > max_entries_) {
+				ok = Compact(*full, error);
+			}
+		}
+	}
+	Unlock();
+	return ok;
+}
+
+/**
+ * Writes the newest max_entries_ live records of `snapshot` to a new file
+ * and renames it over path_.  Called with the lock held.
+ */
+bool DigestCache::Compact(const DigestCacheSnapshot &snapshot, std::string *error) {
+	std::vector<uint32_t> live;
+	live.reserve(static_cast<size_t>(snapshot.live_));
+	for (uint32_t slot : snapshot.slots_) {
+		if (slot) {
+			live.push_back(slot - 1);
+		}
+	}
+	std::sort(live.begin(), live.end());
+	if (live.size() > max_entries_) {
+		live.erase(live.begin(), live.end() - static_cast<ptrdiff_t>(max_entries_));
+	}
+
+	struct stat st;
+	if (fstat(fd_, &st) != 0) {
+		*error = ErrnoMessage(path_);
+		return false;
+	}
+	const std::string temporary = path_ + ".compact." + std::to_string(getpid());
+	int fd;
+	do {
+		fd = open(temporary.c_str(), O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, st.st_mode & 0777);
+	} while (fd == -1 && errno == EINTR);
+	if (fd == -1) {
+		*error = ErrnoMessage(temporary);
+		return false;
+	}
+
+	const uint64_t capacity = std::max<uint64_t>(DIGEST_CACHE_INITIAL_RECORDS, live.size() * 2);
+	uint8_t header[DIGEST_CACHE_HEADER_SIZE];
+	EncodeHeader(live.size(), header);
+	bool ok = ftruncate(fd, DIGEST_CACHE_HEADER_SIZE + capacity * DIGEST_CACHE_RECORD_SIZE) == 0 &&
+		WriteAt(fd, header, sizeof(header), 0);
+
+	std::vector<uint8_t> batch;
+	uint64_t offset = DIGEST_CACHE_HEADER_SIZE;
+	for (size_t i = 0; ok && i < live.size(); i++) {
+		const uint8_t *record = snapshot.mapping_->Record(live[i]);
+		batch.insert(batch.end(), record, record + DIGEST_CACHE_RECORD_SIZE);
+		if (batch.size() >= 1024 * DIGEST_CACHE_RECORD_SIZE || i + 1 == live.size()) {
+			ok = WriteAt(fd, batch.data(), batch.size(), offset);
+			offset += batch.size();
+			batch.clear();
+		}
+	}
+	ok = ok && fsync(fd) == 0 && rename(temporary.c_str(), path_.c_str()) == 0;
+	if (!ok) {
+		*error = ErrnoMessage(temporary);
+		unlink(temporary.c_str());
+	}
+	close(fd);
+	// Everyone, this process included, moves to the new file on next use
+	snapshot_.reset();
+	return ok;
+}
+
+#endif
+
+/*
+ * JS wrapper.  The second internal field holds a tag so that a cache passed
+ * back to native code can be told apart from any other wrapped object.
+ */
+
+static const int DIGEST_CACHE_TAG = 0;
+
+class DigestCacheWrap: public Nan::ObjectWrap {
+ public:
+	std::shared_ptr<DigestCache> cache;
+
+	static NAN_MODULE_INIT(Init) {
+		v8::Local<v8::FunctionTemplate> tpl = Nan::New<v8::FunctionTemplate>(New);
+		tpl->SetClassName(Nan::New("DigestCache").ToLocalChecked());
+		tpl->InstanceTemplate()->SetInternalFieldCount(2);
+		Nan::SetPrototypeMethod(tpl, "close", Close);
+		Nan::Set(target, Nan::New("DigestCache").ToLocalChecked(), Nan::GetFunction(tpl).ToLocalChecked());
+	}
+
+	// new DigestCache(path, maxEntries)
+	static NAN_METHOD(New) {
+		if (!info.IsConstructCall()) {
+			return Nan::ThrowError("Constructor must be called with new");
+		}
+		if (info.Length() < 2 || !info[0]->IsString() || !info[1]->IsNumber() || Nan::To<double>(info[1]).FromJust() < 1) {
+			return Nan::ThrowError(v8::Exception::TypeError(Nan::New<v8::String>("Expected a path and a positive maxEntries").ToLocalChecked()));
+		}
+
+		DigestCacheWrap *obj = new DigestCacheWrap();
+		obj->Wrap(info.This());
+		info.This()->SetAlignedPointerInInternalField(1, const_cast<int*>(&DIGEST_CACHE_TAG));
+
+		std::string error;
+		obj->cache = DigestCache::Open(*Nan::Utf8String(info[0]), static_cast<uint64_t>(Nan::To<double>(info[1]).FromJust()), &error);
+		if (!obj->cache) {
+			return Nan::ThrowError(error.c_str());
+		}
+		info.GetReturnValue().Set(info.This());
+	}
+
+	static NAN_METHOD(Close) {
+		DigestCacheWrap *obj = Nan::ObjectWrap::Unwrap<DigestCacheWrap>(info.This());
+		// Operations already in flight keep their own reference
+		obj->cache.reset();
+	}
+};
+
+std::shared_ptr<DigestCache> DigestCacheFromValue(v8::Local<v8::Value> value) {
+	if (!value->IsObject()) {
+		return nullptr;
+	}
+	v8::Local<v8::Object> object = value.As<v8::Object>();
+	if (object->InternalFieldCount() != 2 || object->GetAlignedPointerFromInternalField(1) != &DIGEST_CACHE_TAG) {
+		return nullptr;
+	}
+	return Nan::ObjectWrap::Unwrap<DigestCacheWrap>(object)->cache;
+}
+
+NAN_MODULE_INIT(InitDigestCache) {
+	DigestCacheWrap::Init(target);
+}
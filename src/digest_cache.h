@@ -0,0 +1,135 @@
+#ifndef NODE_BLAKE2_DIGEST_CACHE_H
+#define NODE_BLAKE2_DIGEST_CACHE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "any_blake2.h"
+
+/**
+ * Identifies one version of one file hashed with one set of parameters.
+ * `params` is a fingerprint of the algorithm, key and digest length.
+ */
+struct DigestCacheKey {
+	uint64_t dev;
+	uint64_t ino;
+	uint64_t size;
+	int64_t mtime_ns;
+	int64_t ctime_ns;
+	uint64_t params;
+};
+
+bool operator==(const DigestCacheKey &a, const DigestCacheKey &b);
+
+struct DigestCacheRecord {
+	DigestCacheKey key;
+	uint8_t digest[BLAKE2B_OUTBYTES];
+};
+
+struct DigestCacheMapping;
+
+/**
+ * An immutable view of the records committed when it was taken.  Lookups
+ * take no locks, so any number of threads may share one snapshot.
+ */
+class DigestCacheSnapshot {
+ public:
+	/**
+	 * Returns the cached digest for `key`, or nullptr.  The digest stays
+	 * valid for the lifetime of the snapshot.
+	 */
+	const uint8_t *Find(const DigestCacheKey &key) const;
+
+	/**
+	 * True if the file changed too recently before the snapshot was taken
+	 * for its timestamps to tell a later change apart, in which case its
+	 * digest should not be stored.
+	 */
+	bool Racy(const DigestCacheKey &key) const;
+
+ private:
+	friend class DigestCache;
+
+	void Index(uint64_t from, uint64_t to);
+	void Insert(uint32_t record);
+
+	std::shared_ptr<DigestCacheMapping> mapping_;
+	std::vector<uint32_t> slots_;
+	uint64_t count_;
+	uint64_t live_;
+	int64_t taken_ns_;
+};
+
+/**
+ * A persistent table of file digests shared between threads and processes.
+ *
+ * The file is a header followed by fixed-size checksummed records and is
+ * only ever appended to: a writer takes an exclusive flock(), writes its
+ * records past the committed ones and then publishes them by bumping the
+ * committed count in the memory-mapped header.  Readers never lock; they map
+ * the file and index the committed records into a snapshot.  Compaction
+ * rewrites the live records into a new file and renames it over the old
+ * one, which other processes notice by its inode changing.
+ */
+class DigestCache {
+ public:
+	/**
+	 * Opens or creates the cache at `path`.  Compaction keeps at most
+	 * `max_entries` entries.  Returns nullptr and sets `error` on failure.
+	 */
+	static std::shared_ptr<DigestCache> Open(const std::string &path, uint64_t max_entries, std::string *error);
+
+	~DigestCache();
+
+	/**
+	 * Fingerprint of the parameters `initial` was set up with, for
+	 * DigestCacheKey::params.
+	 */
+	static uint64_t Params(const any_blake2 &initial);
+
+	/**
+	 * Fills everything but key->params from the file at `path` (following
+	 * symlinks).  Returns false if it cannot be stat()ed.
+	 */
+	static bool Stat(const std::string &path, DigestCacheKey *key);
+
+	/**
+	 * Picks up records committed since the last snapshot, by this or any
+	 * other process.  Returns nullptr and sets `error` on failure.
+	 */
+	std::shared_ptr<const DigestCacheSnapshot> Snapshot(std::string *error);
+
+	/**
+	 * Appends and commits `records`, compacting the file if it holds too
+	 * many superseded records.  Returns false and sets `error` on failure.
+	 */
+	bool Append(const std::vector<DigestCacheRecord> &records, std::string *error);
+
+ private:
+	DigestCache(const std::string &path, uint64_t max_entries);
+	DigestCache(const DigestCache&);
+	DigestCache &operator=(const DigestCache&);
+
+	bool Reopen(std::string *error);
+	bool Current();
+	bool Map(uint64_t count, std::string *error);
+	bool Lock(std::string *error);
+	void Unlock();
+	bool Compact(const DigestCacheSnapshot &snapshot, std::string *error);
+
+	std::string path_;
+	uint64_t max_entries_;
+	int fd_;
+	uint64_t dev_;
+	uint64_t ino_;
+
+	std::mutex mutex_;
+	std::shared_ptr<DigestCacheMapping> mapping_;
+	std::shared_ptr<const DigestCacheSnapshot> snapshot_;
+};
+
+#endif
@@ -0,0 +1,447 @@
+#include <node.h>
+#include <node_buffer.h>
+#include <v8.h>
+#include <nan.h>
+
+#include <algorithm>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "blake2_addon.h"
+#include "byte_order.h"
+#include "file_io.h"
+
+/*
+ * An open-addressing hash set of fixed-width digests, optionally mapping
+ * each to a fixed-width value.  Digests are already uniformly distributed,
+ * so the first 8 bytes of a digest pick its home slot directly, and
+ * collisions probe linearly.  Slots hold the digest and value bytes with
+ * nothing else; an all-zero digest marks an empty slot, and the all-zero
+ * digest itself, if present, lives in one extra slot past the end.  The
+ * table is stored, and saved or mapped from disk, as:
+ *
+ *   0   magic "B2DIGSET"
+ *   8   version u32 LE
+ *   12  digest width u32 LE
+ *   16  value width u32 LE
+ *   20  flags u32 LE (bit 0: the zero digest is present)
+ *   24  slots u64 LE
+ *   32  digests u64 LE
+ *   64  slots + 1 slots of (digest, value)
+ */
+
+static const char DIGEST_SET_MAGIC[8] = {'B', '2', 'D', 'I', 'G', 'S', 'E', 'T'};
+static const uint32_t DIGEST_SET_VERSION = 1;
+static const size_t DIGEST_SET_HEADER_BYTES = 64;
+static const size_t DIGEST_SET_VERSION_OFFSET = 8;
+static const size_t DIGEST_SET_WIDTH_OFFSET = 12;
+static const size_t DIGEST_SET_VALUE_WIDTH_OFFSET = 16;
+static const size_t DIGEST_SET_FLAGS_OFFSET = 20;
+static const size_t DIGEST_SET_SLOTS_OFFSET = 24;
+static const size_t DIGEST_SET_COUNT_OFFSET = 32;
+static const uint32_t DIGEST_SET_HAS_ZERO = 1;
+static const uint32_t DIGEST_SET_MIN_WIDTH = 8;
+static const uint32_t DIGEST_SET_MAX_WIDTH = 64;
+static const uint32_t DIGEST_SET_MAX_VALUE_WIDTH = 64;
+
+// Tables grow by half once they are 80% full
+static const uint64_t DIGEST_SET_LOAD_NUM = 4;
+static const uint64_t DIGEST_SET_LOAD_DEN = 5;
+static const uint64_t DIGEST_SET_MIN_SLOTS = 16;
+
+// Digests whose home slots are prefetched before any of them is probed
+static const size_t DIGEST_SET_BATCH = 16;
+
+class DigestTable {
+ public:
+	DigestTable() : base_(nullptr), length_(0), width_(0), value_width_(0), slot_bytes_(0), slots_(0), count_(0), flags_(0) {}
+
+	const char *Create(uint32_t width, uint32_t value_width, uint64_t capacity) {
+		if (width < DIGEST_SET_MIN_WIDTH || width > DIGEST_SET_MAX_WIDTH) {
+			return "Digest width must be between 8 and 64 bytes";
+		}
+		if (value_width > DIGEST_SET_MAX_VALUE_WIDTH) {
+			return "Value width must be at most 64 bytes";
+		}
+		width_ = width;
+		value_width_ = value_width;
+		slot_bytes_ = width + value_width;
+		Allocate(SlotsFor(capacity));
+		return nullptr;
+	}
+
+	bool Load(const std::string &path, bool shared, std::string *error) {
+		std::unique_ptr<MappedFile> file(new MappedFile());
+		if (!file->Open(path, shared)) {
+			*error = "Cannot map " + path + ": " + ReadOnlyFile::LastError();
+			return false;
+		}
+		const uint8_t *base = file->Data();
+		if (file->Length() < DIGEST_SET_HEADER_BYTES || memcmp(base, DIGEST_SET_MAGIC, sizeof(DIGEST_SET_MAGIC)) != 0) {
+			*error = path + " is not a digest set";
+			return false;
+		}
+		if (load_le32(base + DIGEST_SET_VERSION_OFFSET) != DIGEST_SET_VERSION) {
+			*error = "Unsupported digest set version in " + path;
+			return false;
+		}
+		const uint32_t width = load_le32(base + DIGEST_SET_WIDTH_OFFSET);
+		const uint32_t value_width = load_le32(base + DIGEST_SET_VALUE_WIDTH_OFFSET);
+		const uint64_t slots = load_le64(base + DIGEST_SET_SLOTS_OFFSET);
+		const uint64_t count = load_le64(base + DIGEST_SET_COUNT_OFFSET);
+		if (width < DIGEST_SET_MIN_WIDTH || width > DIGEST_SET_MAX_WIDTH || value_width > DIGEST_SET_MAX_VALUE_WIDTH ||
+			slots == 0 || count > slots || (file->Length() - DIGEST_SET_HEADER_BYTES) / (width + value_width) < slots + 1 ||
+			count * DIGEST_SET_LOAD_DEN > slots * DIGEST_SET_LOAD_NUM) {
+			*error = "The header of digest set " + path + " is corrupt";
+			return false;
+		}
+
+		mapped_ = std::move(file);
+		owned_.clear();
+		owned_.shrink_to_fit();
+		base_ = mapped_->Data();
+		length_ = mapped_->Length();
+		width_ = width;
+		value_width_ = value_width;
+		slot_bytes_ = width + value_width;
+		slots_ = slots;
+		count_ = count;
+		flags_ = load_le32(base + DIGEST_SET_FLAGS_OFFSET);
+		return true;
+	}
+
+	bool Save(const std::string &path, std::string *error) const {
+		if (!SaveFile(mapped_.get(), path, base_, length_)) {
+			*error = "Cannot write " + path + ": " + ReadOnlyFile::LastError();
+			return false;
+		}
+		return true;
+	}
+
+	uint32_t Width() const {
+		return width_;
+	}
+
+	uint32_t ValueWidth() const {
+		return value_width_;
+	}
+
+	uint64_t Count() const {
+		return count_;
+	}
+
+	/**
+	 * Adds `count` digests stored back to back, with their values if
+	 * `values` is non-null.  Sets inserted[i] to 1 if digest i was new; the
+	 * value of a digest already present is replaced only with `overwrite`.
+	 * Returns false if a mapped table turned out to have no empty slot.
+	 */
+	bool Insert(const uint8_t *digests, const uint8_t *values, size_t count, bool overwrite, uint8_t *inserted) {
+		for (size_t first = 0; first < count; first += DIGEST_SET_BATCH) {
+			const size_t batch = std::min(count - first, DIGEST_SET_BATCH);
+			if ((count_ + batch) * DIGEST_SET_LOAD_DEN > slots_ * DIGEST_SET_LOAD_NUM) {
+				Allocate(SlotsFor(std::max(count_ + batch, slots_ + slots_ / 2)));
+			}
+			Prefetch(digests + first * width_, batch);
+			for (size_t i = first; i < first + batch; i++) {
+				const uint8_t *digest = digests + i * width_;
+				bool found;
+				uint8_t *slot = Find(digest, &found);
+				if (!slot) {
+					store_le64(base_ + DIGEST_SET_COUNT_OFFSET, count_);
+					store_le32(base_ + DIGEST_SET_FLAGS_OFFSET, flags_);
+					return false;
+				}
+				if (!found) {
+					if (slot == ZeroSlot()) {
+						flags_ |= DIGEST_SET_HAS_ZERO;
+					} else {
+						memcpy(slot, digest, width_);
+					}
+					count_++;
+				}
+				if (value_width_ && values && (!found || overwrite)) {
+					memcpy(slot + width_, values + i * value_width_, value_width_);
+				}
+				inserted[i] = !found;
+			}
+		}
+		store_le64(base_ + DIGEST_SET_COUNT_OFFSET, count_);
+		store_le32(base_ + DIGEST_SET_FLAGS_OFFSET, flags_);
+		return true;
+	}
+
+	/**
+	 * Sets found[i] to 1 if digest i is present, and copies its value to
+	 * `values` if that is non-null (zeros for absent digests).
+	 */
+	void Lookup(const uint8_t *digests, size_t count, uint8_t *found, uint8_t *values) const {
+		for (size_t first = 0; first < count; first += DIGEST_SET_BATCH) {
+			const size_t batch = std::min(count - first, DIGEST_SET_BATCH);
+			Prefetch(digests + first * width_, batch);
+			for (size_t i = first; i < first + batch; i++) {
+				bool present;
+				const uint8_t *slot = Find(digests + i * width_, &present);
+				found[i] = present;
+				if (values && value_width_) {
+					if (present) {
+						memcpy(values + i * value_width_, slot + width_, value_width_);
+					} else {
+						memset(values + i * value_width_, 0, value_width_);
+					}
+				}
+			}
+		}
+	}
+
+ private:
+	static uint64_t SlotsFor(uint64_t capacity) {
+		return std::max(DIGEST_SET_MIN_SLOTS, (capacity * DIGEST_SET_LOAD_DEN + DIGEST_SET_LOAD_NUM - 1) / DIGEST_SET_LOAD_NUM);
+	}
+
+	uint8_t *Slot(uint64_t index) const {
+		return base_ + DIGEST_SET_HEADER_BYTES + index * slot_bytes_;
+	}
+
+	uint8_t *ZeroSlot() const {
+		return Slot(slots_);
+	}
+
+	bool IsZero(const uint8_t *digest) const {
+		if (load_le64(digest) != 0) {
+			return false;
+		}
+		for (size_t i = 8; i < width_; i++) {
+			if (digest[i]) {
+				return false;
+			}
+		}
+		return true;
+	}
+
+	void Prefetch(const uint8_t *digests, size_t count) const {
+#if defined(__GNUC__)
+		for (size_t i = 0; i < count; i++) {
+			__builtin_prefetch(Slot(load_le64(digests + i * width_) % slots_));
+		}
+#endif
+	}
+
+	/**
+	 * Returns the slot holding `digest`, or if it is absent the empty slot
+	 * it would go into, or null if it is absent and no slot is empty, which
+	 * only a corrupt file can cause.
+	 */
+	uint8_t *Find(const uint8_t *digest, bool *found) const {
+		if (IsZero(digest)) {
+			*found = (flags_ & DIGEST_SET_HAS_ZERO) != 0;
+			return ZeroSlot();
+		}
+		uint64_t index = load_le64(digest) % slots_;
+		for (uint64_t probes = 0; probes < slots_; probes++) {
+			uint8_t *slot = Slot(index);
+			if (memcmp(slot, digest, width_) == 0) {
+				*found = true;
+				return slot;
+			}
+			if (IsZero(slot)) {
+				*found = false;
+				return slot;
+			}
+			index = index + 1 == slots_ ? 0 : index + 1;
+		}
+		*found = false;
+		return nullptr;
+	}
+
+	/**
+	 * Moves every digest into a new heap table of `slots` slots.
+	 */
+	void Allocate(uint64_t slots) {
+		std::vector<uint8_t> table(DIGEST_SET_HEADER_BYTES + (slots + 1) * slot_bytes_);
+		uint8_t *base = table.data();
+		memcpy(base, DIGEST_SET_MAGIC, sizeof(DIGEST_SET_MAGIC));
+		store_le32(base + DIGEST_SET_VERSION_OFFSET, DIGEST_SET_VERSION);
+		store_le32(base + DIGEST_SET_WIDTH_OFFSET, width_);
+		store_le32(base + DIGEST_SET_VALUE_WIDTH_OFFSET, value_width_);
+		store_le64(base + DIGEST_SET_SLOTS_OFFSET, slots);
+
+		if (base_) {
+			DigestTable next;
+			next.base_ = base;
+			next.width_ = width_;
+			next.value_width_ = value_width_;
+			next.slot_bytes_ = slot_bytes_;
+			next.slots_ = slots;
+			next.flags_ = flags_;
+			for (uint64_t i = 0; i < slots_; i++) {
+				const uint8_t *slot = Slot(i);
+				if (!IsZero(slot)) {
+					bool found;
+					memcpy(next.Find(slot, &found), slot, slot_bytes_);
+				}
+			}
+			memcpy(next.ZeroSlot(), ZeroSlot(), slot_bytes_);
+		}
+		store_le64(base + DIGEST_SET_COUNT_OFFSET, count_);
+		store_le32(base + DIGEST_SET_FLAGS_OFFSET, flags_);
+
+		owned_.swap(table);
+		mapped_.reset();
+		base_ = owned_.data();
+		length_ = owned_.size();
+		slots_ = slots;
+	}
+
+	// The table lives in owned_ or, after Load and until it grows, in mapped_
+	std::vector<uint8_t> owned_;
+	std::unique_ptr<MappedFile> mapped_;
+	uint8_t *base_;
+	size_t length_;
+	uint32_t width_;
+	uint32_t value_width_;
+	size_t slot_bytes_;
+	uint64_t slots_;
+	uint64_t count_;
+	uint32_t flags_;
+};
+
+class DigestSet: public Nan::ObjectWrap {
+	DigestTable table;
+
+ public:
+	static NAN_MODULE_INIT(Init) {
+		v8::Local<v8::FunctionTemplate> tpl = Nan::New<v8::FunctionTemplate>(New);
+		tpl->SetClassName(Nan::New("DigestSet").ToLocalChecked());
+		tpl->InstanceTemplate()->SetInternalFieldCount(1);
+		Nan::SetPrototypeMethod(tpl, "insert", Insert);
+		Nan::SetPrototypeMethod(tpl, "lookup", Lookup);
+		Nan::SetPrototypeMethod(tpl, "size", Size);
+		Nan::SetPrototypeMethod(tpl, "width", Width);
+		Nan::SetPrototypeMethod(tpl, "valueWidth", ValueWidth);
+		Nan::SetPrototypeMethod(tpl, "save", Save);
+		Nan::Set(target, Nan::New("DigestSet").ToLocalChecked(), Nan::GetFunction(tpl).ToLocalChecked());
+	}
+
+	// new DigestSet(width, valueWidth, capacity) or new DigestSet(path, shared)
+	static NAN_METHOD(New) {
+		if (!info.IsConstructCall()) {
+			return Nan::ThrowError("Constructor must be called with new");
+		}
+
+		DigestSet *obj = new DigestSet();
+		obj->Wrap(info.This());
+		if (info.Length() >= 1 && info[0]->IsString()) {
+			std::string error;
+			if (!obj->table.Load(*Nan::Utf8String(info[0]), info.Length() > 1 && info[1]->IsTrue(), &error)) {
+				return Nan::ThrowError(error.c_str());
+			}
+		} else {
+			if (info.Length() < 3 || !info[0]->IsUint32() || !info[1]->IsUint32() || !info[2]->IsNumber()) {
+				return Nan::ThrowError(v8::Exception::TypeError(Nan::New<v8::String>("Expected a digest width, value width and capacity, or a path").ToLocalChecked()));
+			}
+			const char *error = obj->table.Create(
+				Nan::To<uint32_t>(info[0]).FromJust(),
+				Nan::To<uint32_t>(info[1]).FromJust(),
+				static_cast<uint64_t>(std::max(0.0, Nan::To<double>(info[2]).FromJust()))
+			);
+			if (error) {
+				return Nan::ThrowError(v8::Exception::RangeError(Nan::New<v8::String>(error).ToLocalChecked()));
+			}
+		}
+		info.GetReturnValue().Set(info.This());
+	}
+
+	// insert(digests, values, overwrite): a Buffer of 1 for every new digest, 0 otherwise
+	static NAN_METHOD(Insert) {
+		DigestSet *obj = Nan::ObjectWrap::Unwrap<DigestSet>(info.This());
+		size_t count;
+		if (!obj->CountDigests(info, &count)) {
+			return;
+		}
+		const uint8_t *values = nullptr;
+		if (info.Length() > 1 && !info[1]->IsNull() && !info[1]->IsUndefined()) {
+			if (!node::Buffer::HasInstance(info[1]) || node::Buffer::Length(info[1]) != count * obj->table.ValueWidth()) {
+				return Nan::ThrowError(v8::Exception::TypeError(Nan::New<v8::String>("Values must be a Buffer of valueWidth bytes per digest").ToLocalChecked()));
+			}
+			values = reinterpret_cast<const uint8_t*>(node::Buffer::Data(info[1]));
+		}
+
+		v8::Local<v8::Object> inserted = Nan::NewBuffer(static_cast<uint32_t>(count)).ToLocalChecked();
+		const bool inserted_all = obj->table.Insert(
+			reinterpret_cast<const uint8_t*>(node::Buffer::Data(info[0])),
+			values,
+			count,
+			info.Length() > 2 && info[2]->IsTrue(),
+			reinterpret_cast<uint8_t*>(node::Buffer::Data(inserted))
+		);
+		if (!inserted_all) {
+			return Nan::ThrowError("The digest set is corrupt: it has no empty slot");
+		}
+		info.GetReturnValue().Set(inserted);
+	}
+
+	// lookup(digests, values): a Buffer of 1 for every digest present, 0
+	// otherwise; their values are copied to the values Buffer if given
+	static NAN_METHOD(Lookup) {
+		DigestSet *obj = Nan::ObjectWrap::Unwrap<DigestSet>(info.This());
+		size_t count;
+		if (!obj->CountDigests(info, &count)) {
+			return;
+		}
+		uint8_t *values = nullptr;
+		if (info.Length() > 1 && !info[1]->IsNull() && !info[1]->IsUndefined()) {
+			if (!node::Buffer::HasInstance(info[1]) || node::Buffer::Length(info[1]) != count * obj->table.ValueWidth()) {
+				return Nan::ThrowError(v8::Exception::TypeError(Nan::New<v8::String>("Values must be a Buffer of valueWidth bytes per digest").ToLocalChecked()));
+			}
+			values = reinterpret_cast<uint8_t*>(node::Buffer::Data(info[1]));
+		}
+
+		v8::Local<v8::Object> found = Nan::NewBuffer(static_cast<uint32_t>(count)).ToLocalChecked();
+		obj->table.Lookup(reinterpret_cast<const uint8_t*>(node::Buffer::Data(info[0])), count, reinterpret_cast<uint8_t*>(node::Buffer::Data(found)), values);
+		info.GetReturnValue().Set(found);
+	}
+
+	static NAN_METHOD(Size) {
+		DigestSet *obj = Nan::ObjectWrap::Unwrap<DigestSet>(info.This());
+		info.GetReturnValue().Set(Nan::New<v8::Number>(static_cast<double>(obj->table.Count())));
+	}
+
+	static NAN_METHOD(Width) {
+		DigestSet *obj = Nan::ObjectWrap::Unwrap<DigestSet>(info.This());
+		info.GetReturnValue().Set(obj->table.Width());
+	}
+
+	static NAN_METHOD(ValueWidth) {
+		DigestSet *obj = Nan::ObjectWrap::Unwrap<DigestSet>(info.This());
+		info.GetReturnValue().Set(obj->table.ValueWidth());
+	}
+
+	// save(path): writes the table in the format that new DigestSet(path) maps
+	static NAN_METHOD(Save) {
+		DigestSet *obj = Nan::ObjectWrap::Unwrap<DigestSet>(info.This());
+		if (info.Length() < 1 || !info[0]->IsString()) {
+			return Nan::ThrowError(v8::Exception::TypeError(Nan::New<v8::String>("Path must be a string").ToLocalChecked()));
+		}
+		std::string error;
+		if (!obj->table.Save(*Nan::Utf8String(info[0]), &error)) {
+			return Nan::ThrowError(error.c_str());
+		}
+	}
+
+ private:
+	bool CountDigests(const Nan::FunctionCallbackInfo<v8::Value> &info, size_t *count) const {
+		if (info.Length() < 1 || !node::Buffer::HasInstance(info[0]) || node::Buffer::Length(info[0]) % table.Width() != 0) {
+			Nan::ThrowError(v8::Exception::TypeError(Nan::New<v8::String>("Digests must be a Buffer holding a whole number of digests").ToLocalChecked()));
+			return false;
+		}
+		*count = node::Buffer::Length(info[0]) / table.Width();
+		return true;
+	}
+};
+
+NAN_MODULE_INIT(InitDigestSet) {
+	DigestSet::Init(target);
+}
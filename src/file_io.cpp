@@ -0,0 +1,332 @@
+#include "file_io.h"
+
+#include <atomic>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+// Numbers the temporary files WriteWholeFile writes before renaming them
+static std::atomic<unsigned> temporary_files(0);
+
+static std::string TemporaryPath(const std::string &path, unsigned long pid) {
+	return path + ".tmp-" + std::to_string(pid) + "-" + std::to_string(temporary_files.fetch_add(1));
+}
+
+#ifdef _WIN32
+
+ReadOnlyFile::ReadOnlyFile() : handle_(INVALID_HANDLE_VALUE) {}
+
+ReadOnlyFile::~ReadOnlyFile() {
+	Close();
+}
+
+std::string ReadOnlyFile::LastError() {
+	return "Windows error " + std::to_string(GetLastError());
+}
+
+bool ReadOnlyFile::Open(const std::string &path) {
+	Close();
+	int wide_length = MultiByteToWideChar(CP_UTF8, 0, path.c_str(), -1, nullptr, 0);
+	std::wstring wide(wide_length, L'\0');
+	MultiByteToWideChar(CP_UTF8, 0, path.c_str(), -1, &wide[0], wide_length);
+	handle_ = CreateFileW(wide.c_str(), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE,
+		nullptr, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+	if (handle_ == INVALID_HANDLE_VALUE) {
+		return false;
+	}
+	return true;
+}
+
+void ReadOnlyFile::Close() {
+	if (handle_ != INVALID_HANDLE_VALUE) {
+		CloseHandle(handle_);
+		handle_ = INVALID_HANDLE_VALUE;
+	}
+}
+
+int64_t ReadOnlyFile::Size() {
+	LARGE_INTEGER size;
+	if (!GetFileSizeEx(handle_, &size)) {
+		return -1;
+	}
+	return size.QuadPart;
+}
+
+int64_t ReadOnlyFile::ReadAt(void *buffer, size_t length, uint64_t offset) const {
+	size_t total = 0;
+	while (total < length) {
+		OVERLAPPED overlapped = {};
+		overlapped.Offset = static_cast<DWORD>(offset + total);
+		overlapped.OffsetHigh = static_cast<DWORD>((offset + total) >> 32);
+		DWORD want = length - total > 0x40000000 ? 0x40000000 : static_cast<DWORD>(length - total);
+		DWORD got = 0;
+		if (!ReadFile(handle_, static_cast<char*>(buffer) + total, want, &got, &overlapped)) {
+			if (GetLastError() == ERROR_HANDLE_EOF) {
+				break;
+			}
+			return -1;
+		}
+		if (got == 0) {
+			break;
+		}
+		total += got;
+	}
+	return static_cast<int64_t>(total);
+}
+
+MappedFile::MappedFile() : data_(nullptr), length_(0), shared_(false), device_(0), inode_(0) {}
+
+MappedFile::~MappedFile() {
+	Close();
+}
+
+bool MappedFile::Open(const std::string &path, bool shared) {
+	Close();
+	int wide_length = MultiByteToWideChar(CP_UTF8, 0, path.c_str(), -1, nullptr, 0);
+	std::wstring wide(wide_length, L'\0');
+	MultiByteToWideChar(CP_UTF8, 0, path.c_str(), -1, &wide[0], wide_length);
+	HANDLE file = CreateFileW(wide.c_str(), shared ? GENERIC_READ | GENERIC_WRITE : GENERIC_READ,
+		FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+	if (file == INVALID_HANDLE_VALUE) {
+		return false;
+	}
+	LARGE_INTEGER size;
+	BY_HANDLE_FILE_INFORMATION info;
+	HANDLE mapping = nullptr;
+	if (GetFileSizeEx(file, &size) && GetFileInformationByHandle(file, &info)) {
+		mapping = CreateFileMappingW(file, nullptr, shared ? PAGE_READWRITE : PAGE_WRITECOPY, 0, 0, nullptr);
+	}
+	CloseHandle(file);
+	if (!mapping) {
+		return false;
+	}
+	void *view = MapViewOfFile(mapping, shared ? FILE_MAP_WRITE : FILE_MAP_COPY, 0, 0, 0);
+	CloseHandle(mapping);
+	if (!view) {
+		return false;
+	}
+	data_ = static_cast<uint8_t*>(view);
+	length_ = static_cast<size_t>(size.QuadPart);
+	shared_ = shared;
+	device_ = info.dwVolumeSerialNumber;
+	inode_ = (static_cast<uint64_t>(info.nFileIndexHigh) << 32) | info.nFileIndexLow;
+	return true;
+}
+
+bool MappedFile::IsFile(const std::string &path) const {
+	int wide_length = MultiByteToWideChar(CP_UTF8, 0, path.c_str(), -1, nullptr, 0);
+	std::wstring wide(wide_length, L'\0');
+	MultiByteToWideChar(CP_UTF8, 0, path.c_str(), -1, &wide[0], wide_length);
+	HANDLE file = CreateFileW(wide.c_str(), 0, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE,
+		nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+	if (file == INVALID_HANDLE_VALUE) {
+		return false;
+	}
+	BY_HANDLE_FILE_INFORMATION info;
+	const bool same = GetFileInformationByHandle(file, &info) && info.dwVolumeSerialNumber == device_ &&
+		((static_cast<uint64_t>(info.nFileIndexHigh) << 32) | info.nFileIndexLow) == inode_;
+	CloseHandle(file);
+	return data_ && same;
+}
+
+bool MappedFile::Sync() {
+	return FlushViewOfFile(data_, length_) != 0;
+}
+
+void MappedFile::Close() {
+	if (data_) {
+		UnmapViewOfFile(data_);
+		data_ = nullptr;
+		length_ = 0;
+	}
+}
+
+static std::wstring WidePath(const std::string &path) {
+	int wide_length = MultiByteToWideChar(CP_UTF8, 0, path.c_str(), -1, nullptr, 0);
+	std::wstring wide(wide_length, L'\0');
+	MultiByteToWideChar(CP_UTF8, 0, path.c_str(), -1, &wide[0], wide_length);
+	return wide;
+}
+
+bool WriteWholeFile(const std::string &path, const void *data, size_t length) {
+	const std::wstring temporary = WidePath(TemporaryPath(path, GetCurrentProcessId()));
+	HANDLE file = CreateFileW(temporary.c_str(), GENERIC_WRITE, 0, nullptr, CREATE_NEW, FILE_ATTRIBUTE_NORMAL, nullptr);
+	if (file == INVALID_HANDLE_VALUE) {
+		return false;
+	}
+	size_t total = 0;
+	bool ok = true;
+	while (ok && total < length) {
+		DWORD want = length - total > 0x40000000 ? 0x40000000 : static_cast<DWORD>(length - total);
+		DWORD wrote = 0;
+		ok = WriteFile(file, static_cast<const char*>(data) + total, want, &wrote, nullptr) != 0;
+		total += wrote;
+	}
+	ok = CloseHandle(file) != 0 && ok;
+	if (ok) {
+		ok = MoveFileExW(temporary.c_str(), WidePath(path).c_str(), MOVEFILE_REPLACE_EXISTING) != 0;
+	}
+	if (!ok) {
+		DWORD saved = GetLastError();
+		DeleteFileW(temporary.c_str());
+		SetLastError(saved);
+	}
+	return ok;
+}
+
+#else
+
+ReadOnlyFile::ReadOnlyFile() : fd_(-1) {}
+
+ReadOnlyFile::~ReadOnlyFile() {
+	Close();
+}
+
+std::string ReadOnlyFile::LastError() {
+	return strerror(errno);
+}
+
+bool ReadOnlyFile::Open(const std::string &path) {
+	Close();
+	do {
+		fd_ = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+	} while (fd_ == -1 && errno == EINTR);
+	if (fd_ == -1) {
+		return false;
+	}
+	return true;
+}
+
+void ReadOnlyFile::Close() {
+	if (fd_ != -1) {
+		close(fd_);
+		fd_ = -1;
+	}
+}
+
+int64_t ReadOnlyFile::Size() {
+	struct stat st;
+	if (fstat(fd_, &st) != 0) {
+		return -1;
+	}
+	return st.st_size;
+}
+
+int64_t ReadOnlyFile::ReadAt(void *buffer, size_t length, uint64_t offset) const {
+	size_t total = 0;
+	while (total < length) {
+		ssize_t got = pread(fd_, static_cast<char*>(buffer) + total, length - total, static_cast<off_t>(offset + total));
+		if (got < 0) {
+			if (errno == EINTR) {
+				continue;
+			}
+			return -1;
+		}
+		if (got == 0) {
+			break;
+		}
+		total += static_cast<size_t>(got);
+	}
+	return static_cast<int64_t>(total);
+}
+
+MappedFile::MappedFile() : data_(nullptr), length_(0), shared_(false), device_(0), inode_(0) {}
+
+MappedFile::~MappedFile() {
+	Close();
+}
+
+bool MappedFile::Open(const std::string &path, bool shared) {
+	Close();
+	int fd;
+	do {
+		fd = open(path.c_str(), (shared ? O_RDWR : O_RDONLY) | O_CLOEXEC);
+	} while (fd == -1 && errno == EINTR);
+	if (fd == -1) {
+		return false;
+	}
+	struct stat st;
+	void *base = MAP_FAILED;
+	if (fstat(fd, &st) == 0) {
+		base = mmap(nullptr, static_cast<size_t>(st.st_size), PROT_READ | PROT_WRITE, shared ? MAP_SHARED : MAP_PRIVATE, fd, 0);
+	}
+	// The mapping keeps its own reference to the file
+	int saved = errno;
+	close(fd);
+	errno = saved;
+	if (base == MAP_FAILED) {
+		return false;
+	}
+	data_ = static_cast<uint8_t*>(base);
+	length_ = static_cast<size_t>(st.st_size);
+	shared_ = shared;
+	device_ = static_cast<uint64_t>(st.st_dev);
+	inode_ = static_cast<uint64_t>(st.st_ino);
+	return true;
+}
+
+bool MappedFile::IsFile(const std::string &path) const {
+	struct stat st;
+	return data_ && stat(path.c_str(), &st) == 0 &&
+		static_cast<uint64_t>(st.st_dev) == device_ && static_cast<uint64_t>(st.st_ino) == inode_;
+}
+
+bool MappedFile::Sync() {
+	return msync(data_, length_, MS_SYNC) == 0;
+}
+
+void MappedFile::Close() {
+	if (data_) {
+		munmap(data_, length_);
+		data_ = nullptr;
+		length_ = 0;
+	}
+}
+
+bool WriteWholeFile(const std::string &path, const void *data, size_t length) {
+	const std::string temporary = TemporaryPath(path, static_cast<unsigned long>(getpid()));
+	int fd;
+	do {
+		fd = open(temporary.c_str(), O_WRONLY | O_CREAT | O_EXCL | O_CLOEXEC, 0666);
+	} while (fd == -1 && errno == EINTR);
+	if (fd == -1) {
+		return false;
+	}
+	size_t total = 0;
+	bool ok = true;
+	while (ok && total < length) {
+		ssize_t wrote = write(fd, static_cast<const char*>(data) + total, length - total);
+		if (wrote < 0) {
+			ok = errno == EINTR;
+			continue;
+		}
+		total += static_cast<size_t>(wrote);
+	}
+	ok = close(fd) == 0 && ok;
+	if (ok) {
+		ok = rename(temporary.c_str(), path.c_str()) == 0;
+	}
+	if (!ok) {
+		int saved = errno;
+		unlink(temporary.c_str());
+		errno = saved;
+	}
+	return ok;
+}
+
+#endif
+
+bool SaveFile(MappedFile *mapped, const std::string &path, const void *data, size_t length) {
+	if (mapped && mapped->Shared() && mapped->IsFile(path)) {
+		return mapped->Sync();
+	}
+	return WriteWholeFile(path, data, length);
+}
@@ -0,0 +1,110 @@
+#ifndef NODE_BLAKE2_FILE_IO_H
+#define NODE_BLAKE2_FILE_IO_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+/**
+ * A file opened for positional reads, which several threads may issue at
+ * once.  Paths are UTF-8 on every platform.
+ */
+class ReadOnlyFile {
+ public:
+	ReadOnlyFile();
+	~ReadOnlyFile();
+
+	/** Opens `path`; returns false on failure. */
+	bool Open(const std::string &path);
+
+	void Close();
+
+	/** Size of the open file in bytes, or -1 on failure. */
+	int64_t Size();
+
+	/**
+	 * Reads up to `length` bytes at `offset`, stopping early only at end of
+	 * file.  Returns the number of bytes read, or -1 on failure.
+	 */
+	int64_t ReadAt(void *buffer, size_t length, uint64_t offset) const;
+
+	/**
+	 * Describes why the last call that failed on this thread failed, here
+	 * or in MappedFile or WriteWholeFile.
+	 */
+	static std::string LastError();
+
+ private:
+	ReadOnlyFile(const ReadOnlyFile&);
+	ReadOnlyFile &operator=(const ReadOnlyFile&);
+
+#ifdef _WIN32
+	void *handle_;
+#else
+	int fd_;
+#endif
+};
+
+/**
+ * A whole file mapped read-write into memory.  With `shared` set, writes go
+ * to the file and are seen by every process that maps it; otherwise pages
+ * are copied on write and the file is left untouched.
+ */
+class MappedFile {
+ public:
+	MappedFile();
+	~MappedFile();
+
+	/** Maps `path`; returns false on failure, including for an empty file. */
+	bool Open(const std::string &path, bool shared);
+
+	void Close();
+
+	/** Whether `path` names the file that is mapped. */
+	bool IsFile(const std::string &path) const;
+
+	/** Writes changes to a shared mapping back to the file now. */
+	bool Sync();
+
+	bool Shared() const {
+		return shared_;
+	}
+
+	uint8_t *Data() const {
+		return data_;
+	}
+
+	size_t Length() const {
+		return length_;
+	}
+
+ private:
+	MappedFile(const MappedFile&);
+	MappedFile &operator=(const MappedFile&);
+
+	uint8_t *data_;
+	size_t length_;
+	bool shared_;
+	// Identify the mapped file: device and inode, or volume and file index
+	uint64_t device_;
+	uint64_t inode_;
+};
+
+/**
+ * Replaces the contents of `path` with `length` bytes at `data`.  The bytes
+ * go to a new file in the same directory that is then renamed over `path`,
+ * so `data` may be a private mapping of `path` itself.  On failure,
+ * LastError() describes why.
+ */
+bool WriteWholeFile(const std::string &path, const void *data, size_t length);
+
+/**
+ * Saves `length` bytes at `data`, which `mapped` (if not null) maps, to
+ * `path`.  When `mapped` is a shared mapping of `path` itself the bytes
+ * already are the file and are only synced: renaming a new file over it
+ * would leave every other process mapping the old one.  Otherwise this is
+ * WriteWholeFile().
+ */
+bool SaveFile(MappedFile *mapped, const std::string &path, const void *data, size_t length);
+
+#endif
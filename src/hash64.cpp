@@ -0,0 +1,196 @@
+#include <node.h>
+#include <node_buffer.h>
+#include <v8.h>
+#include <nan.h>
+
+#include <algorithm>
+#include <cstring>
+#include <vector>
+
+#include "any_blake2.h"
+#include "blake2_addon.h"
+#include "blake2_lanes.h"
+#include "byte_order.h"
+#include "stats.h"
+#include "trace.h"
+
+/*
+ * Keyed 64-bit hashing of short values for hash tables and shard routing:
+ * the hash of a value is its 8-byte keyed BLAKE2s digest read as a
+ * little-endian integer.  Batches go through the multi-buffer kernel.
+ */
+
+static const size_t HASH64_BYTES = 8;
+
+// Messages handed to the lanes at once
+static const size_t HASH64_BATCH = 256;
+
+class Hasher64 {
+ public:
+	const char *Reset(const void *key, size_t key_length) {
+		any_blake2 h;
+		const char *error = any_blake2_init(&h, ANY_BLAKE2S, key, key_length, HASH64_BYTES);
+		if (error) {
+			return error;
+		}
+		// An empty value needs the key block as its final block, anything
+		// else starts from the state after the key block
+		initial_ = h.state.casted_blake2s_state;
+		post_key_ = initial_;
+		blake2s_absorb_pending(&post_key_);
+		return nullptr;
+	}
+
+	uint64_t One(const uint8_t *data, size_t length) const {
+		blake2s_state S = length ? post_key_ : initial_;
+		uint8_t digest[HASH64_BYTES];
+		StatsCountBytes(ANY_BLAKE2S, length);
+		StatsCountDigests(ANY_BLAKE2S, 1);
+		blake2s_update(&S, data, length);
+		blake2s_final(&S, digest, sizeof(digest));
+		return load_le64(digest);
+	}
+
+	/**
+	 * Hashes the values ending at each of `ends` in `data` into `out`.
+	 */
+	void Many(const uint8_t *data, const uint32_t *ends, size_t count, uint64_t *out) const {
+		TraceSpan span(TRACE_BATCH, ANY_BLAKE2S, count ? ends[count - 1] : 0);
+		if (!blake2_lanes_accelerated()) {
+			for (size_t i = 0; i < count; i++) {
+				const uint32_t start = i ? ends[i - 1] : 0;
+				out[i] = One(data + start, ends[i] - start);
+			}
+			return;
+		}
+
+		blake2s_message messages[HASH64_BATCH];
+		uint8_t digests[HASH64_BATCH][HASH64_BYTES];
+		for (size_t first = 0; first < count; first += HASH64_BATCH) {
+			const size_t batch = std::min(count - first, HASH64_BATCH);
+			for (size_t j = 0; j < batch; j++) {
+				const size_t i = first + j;
+				const uint32_t start = i ? ends[i - 1] : 0;
+				messages[j].in = data + start;
+				messages[j].inlen = ends[i] - start;
+				messages[j].S = messages[j].inlen ? &post_key_ : &initial_;
+				messages[j].out = digests[j];
+			}
+			blake2s_hash_many(messages, batch);
+			for (size_t j = 0; j < batch; j++) {
+				out[first + j] = load_le64(digests[j]);
+			}
+		}
+	}
+
+ private:
+	blake2s_state initial_;
+	blake2s_state post_key_;
+};
+
+class Hash64: public Nan::ObjectWrap {
+	Hasher64 hasher;
+
+ public:
+	static NAN_MODULE_INIT(Init) {
+		v8::Local<v8::FunctionTemplate> tpl = Nan::New<v8::FunctionTemplate>(New);
+		tpl->SetClassName(Nan::New("Hash64").ToLocalChecked());
+		tpl->InstanceTemplate()->SetInternalFieldCount(1);
+		Nan::SetPrototypeMethod(tpl, "one", One);
+		Nan::SetPrototypeMethod(tpl, "many", Many);
+		Nan::Set(target, Nan::New("Hash64").ToLocalChecked(), Nan::GetFunction(tpl).ToLocalChecked());
+	}
+
+	// new Hash64(key)
+	static NAN_METHOD(New) {
+		if (!info.IsConstructCall()) {
+			return Nan::ThrowError("Constructor must be called with new");
+		}
+		if (info.Length() < 1 || !node::Buffer::HasInstance(info[0])) {
+			return Nan::ThrowError(v8::Exception::TypeError(Nan::New<v8::String>("Key must be a Buffer").ToLocalChecked()));
+		}
+
+		Hash64 *obj = new Hash64();
+		obj->Wrap(info.This());
+		const char *error = obj->hasher.Reset(node::Buffer::Data(info[0]), node::Buffer::Length(info[0]));
+		if (error) {
+			return Nan::ThrowError(error);
+		}
+		info.GetReturnValue().Set(info.This());
+	}
+
+	// one(stringOrBuffer): returns a BigInt
+	static NAN_METHOD(One) {
+		Hash64 *obj = Nan::ObjectWrap::Unwrap<Hash64>(info.This());
+		uint64_t value;
+
+		if (info.Length() >= 1 && node::Buffer::HasInstance(info[0])) {
+			value = obj->hasher.One(reinterpret_cast<const uint8_t*>(node::Buffer::Data(info[0])), node::Buffer::Length(info[0]));
+		} else if (info.Length() >= 1 && info[0]->IsString()) {
+			Nan::Utf8String utf8(info[0]);
+			value = obj->hasher.One(reinterpret_cast<const uint8_t*>(*utf8), utf8.length());
+		} else {
+			return Nan::ThrowError(v8::Exception::TypeError(Nan::New<v8::String>("Value must be a string or a Buffer").ToLocalChecked()));
+		}
+		info.GetReturnValue().Set(v8::BigInt::NewFromUnsigned(info.GetIsolate(), value));
+	}
+
+	/**
+	 * many(array) or many(buffer, ends): hashes an array of strings and
+	 * Buffers, or the values packed in `buffer` that end at each of the
+	 * Uint32Array `ends`.  Returns a Buffer of native-endian 64-bit hashes.
+	 */
+	static NAN_METHOD(Many) {
+		static thread_local std::vector<uint8_t> packed;
+		static thread_local std::vector<uint32_t> packed_ends;
+		Hash64 *obj = Nan::ObjectWrap::Unwrap<Hash64>(info.This());
+
+		if (info.Length() >= 1 && info[0]->IsArray()) {
+			v8::Local<v8::Array> array = info[0].As<v8::Array>();
+			const uint32_t count = array->Length();
+			packed.clear();
+			packed_ends.resize(count);
+			for (uint32_t i = 0; i < count; i++) {
+				v8::Local<v8::Value> item = Nan::Get(array, i).ToLocalChecked();
+				if (node::Buffer::HasInstance(item)) {
+					const char *bytes = node::Buffer::Data(item);
+					packed.insert(packed.end(), bytes, bytes + node::Buffer::Length(item));
+				} else if (item->IsString()) {
+					Nan::Utf8String utf8(item);
+					packed.insert(packed.end(), *utf8, *utf8 + utf8.length());
+				} else {
+					return Nan::ThrowError(v8::Exception::TypeError(Nan::New<v8::String>("Values must be strings or Buffers").ToLocalChecked()));
+				}
+				if (packed.size() > UINT32_MAX) {
+					return Nan::ThrowError(v8::Exception::RangeError(Nan::New<v8::String>("Values must add up to less than 4 GiB").ToLocalChecked()));
+				}
+				packed_ends[i] = static_cast<uint32_t>(packed.size());
+			}
+			info.GetReturnValue().Set(HashesToBuffer(obj->hasher, packed.data(), packed_ends.data(), count));
+		} else if (info.Length() >= 2 && node::Buffer::HasInstance(info[0]) && info[1]->IsUint32Array()) {
+			const uint8_t *data = reinterpret_cast<const uint8_t*>(node::Buffer::Data(info[0]));
+			const size_t length = node::Buffer::Length(info[0]);
+			Nan::TypedArrayContents<uint32_t> ends(info[1]);
+			for (size_t i = 0; i < ends.length(); i++) {
+				if ((*ends)[i] > length || (i > 0 && (*ends)[i] < (*ends)[i - 1])) {
+					return Nan::ThrowError(v8::Exception::RangeError(Nan::New<v8::String>("Value ends must be ascending and within the buffer").ToLocalChecked()));
+				}
+			}
+			info.GetReturnValue().Set(HashesToBuffer(obj->hasher, data, *ends, ends.length()));
+		} else {
+			return Nan::ThrowError(v8::Exception::TypeError(Nan::New<v8::String>("Expected an array of values, or a Buffer and a Uint32Array of value ends").ToLocalChecked()));
+		}
+	}
+
+ private:
+	static v8::Local<v8::Object> HashesToBuffer(const Hasher64 &hasher, const uint8_t *data, const uint32_t *ends, size_t count) {
+		static thread_local std::vector<uint64_t> values;
+		values.resize(count);
+		hasher.Many(data, ends, count, values.data());
+		return Nan::CopyBuffer(reinterpret_cast<const char*>(values.data()), count * HASH64_BYTES).ToLocalChecked();
+	}
+};
+
+NAN_MODULE_INIT(InitHash64) {
+	Hash64::Init(target);
+}
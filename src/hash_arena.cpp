@@ -0,0 +1,245 @@
+#include <node.h>
+#include <node_buffer.h>
+#include <v8.h>
+#include <nan.h>
+
+#include <cstring>
+#include <memory>
+#include <vector>
+
+#include "any_blake2.h"
+#include "blake2_addon.h"
+#include "hash_arena.h"
+#include "trace.h"
+
+/*
+ * Streaming hash states kept in bulk.  A HashArena holds one pool per
+ * algorithm; each pool lays its states out back to back in slabs, every
+ * slot exactly as large as that algorithm's state plus an 8-byte header, and
+ * hands them out as integer handles (slot index * 4 + algorithm).  Freed
+ * slots are reused before the pool grows; slabs are returned when the
+ * arena is collected.
+ */
+
+// Slots per slab
+static const uint32_t ARENA_SLAB_SLOTS = 1024;
+
+// Slots per pool, so that every handle fits in a uint32
+static const uint32_t ARENA_MAX_SLOTS = uint32_t(1) << 30;
+
+ArenaPool::ArenaPool(any_blake2_algo algo)
+	: algo_(algo), words_(1 + (any_blake2_state_size(algo) + 7) / 8), slots_(0), live_(0) {
+	any_blake2 h;
+	any_blake2_init(&h, algo, nullptr, 0, -1);
+	update_ = h.update;
+	final_ = h.final;
+}
+
+bool ArenaPool::Allocate(const void *state, uint8_t outbytes, uint32_t *index) {
+	if (!free_.empty()) {
+		*index = free_.back();
+		free_.pop_back();
+	} else {
+		if (slots_ == ARENA_MAX_SLOTS) {
+			return false;
+		}
+		if (slots_ % ARENA_SLAB_SLOTS == 0) {
+			slabs_.emplace_back(new uint64_t[words_ * ARENA_SLAB_SLOTS]);
+		}
+		*index = slots_++;
+	}
+	ArenaSlot *slot = Slot(*index);
+	slot->outbytes = outbytes;
+	slot->status = ARENA_OPEN;
+	memcpy(State(slot), state, any_blake2_state_size(algo_));
+	live_++;
+	return true;
+}
+
+void ArenaPool::Free(uint32_t index) {
+	Slot(index)->status = ARENA_FREE;
+	free_.push_back(index);
+	live_--;
+}
+
+ArenaSlot *ArenaPool::Slot(uint32_t index) {
+	return reinterpret_cast<ArenaSlot*>(slabs_[index / ARENA_SLAB_SLOTS].get() + (index % ARENA_SLAB_SLOTS) * words_);
+}
+
+ArenaSlot *ArenaPool::Find(uint32_t index) {
+	if (index >= slots_) {
+		return nullptr;
+	}
+	ArenaSlot *slot = Slot(index);
+	return slot->status == ARENA_FREE ? nullptr : slot;
+}
+
+void ArenaPool::Update(ArenaSlot *slot, const void *data, size_t length) {
+	StatsCountBytes(algo_, length);
+	update_(State(slot), data, length);
+}
+
+int ArenaPool::Final(ArenaSlot *slot, uint8_t *out) {
+	StatsCountDigests(algo_, 1);
+	slot->status = ARENA_FINISHED;
+	return final_(State(slot), out, slot->outbytes);
+}
+
+// Marks HashArena objects in their second internal field
+static const int HASH_ARENA_TAG = 0;
+
+HashArena::HashArena()
+	: pools_{ArenaPool(ANY_BLAKE2B), ArenaPool(ANY_BLAKE2BP), ArenaPool(ANY_BLAKE2S), ArenaPool(ANY_BLAKE2SP)} {}
+
+NAN_MODULE_INIT(HashArena::Init) {
+	v8::Local<v8::FunctionTemplate> tpl = Nan::New<v8::FunctionTemplate>(New);
+	tpl->SetClassName(Nan::New("HashArena").ToLocalChecked());
+	tpl->InstanceTemplate()->SetInternalFieldCount(2);
+	Nan::SetPrototypeMethod(tpl, "create", Create);
+	Nan::SetPrototypeMethod(tpl, "update", Update);
+	Nan::SetPrototypeMethod(tpl, "digest", Digest);
+	Nan::SetPrototypeMethod(tpl, "copy", Copy);
+	Nan::SetPrototypeMethod(tpl, "free", Free);
+	Nan::SetPrototypeMethod(tpl, "size", Size);
+	Nan::Set(target, Nan::New("HashArena").ToLocalChecked(), Nan::GetFunction(tpl).ToLocalChecked());
+}
+
+HashArena *HashArena::FromValue(v8::Local<v8::Value> value) {
+	if (!value->IsObject()) {
+		return nullptr;
+	}
+	v8::Local<v8::Object> object = value.As<v8::Object>();
+	if (object->InternalFieldCount() != 2 || object->GetAlignedPointerFromInternalField(1) != &HASH_ARENA_TAG) {
+		return nullptr;
+	}
+	return Nan::ObjectWrap::Unwrap<HashArena>(object);
+}
+
+ArenaSlot *HashArena::Lookup(v8::Local<v8::Value> handle, ArenaPool **pool) {
+	if (!handle->IsUint32()) {
+		Nan::ThrowError(v8::Exception::TypeError(Nan::New<v8::String>("Handle must be an unsigned integer").ToLocalChecked()));
+		return nullptr;
+	}
+	const uint32_t value = Nan::To<uint32_t>(handle).FromJust();
+	*pool = &pools_[value % 4];
+	ArenaSlot *slot = (*pool)->Find(value / 4);
+	if (!slot) {
+		Nan::ThrowError(v8::Exception::RangeError(Nan::New<v8::String>("No such hash in this arena").ToLocalChecked()));
+	}
+	return slot;
+}
+
+ArenaSlot *HashArena::LookupOpen(v8::Local<v8::Value> handle, ArenaPool **pool) {
+	ArenaSlot *slot = Lookup(handle, pool);
+	if (slot && slot->status != ARENA_OPEN) {
+		Nan::ThrowError(v8::Exception::Error(Nan::New<v8::String>("Not initialized").ToLocalChecked()));
+		return nullptr;
+	}
+	return slot;
+}
+
+bool HashArena::Add(const void *state, any_blake2_algo algo, uint8_t outbytes, uint32_t *handle) {
+	uint32_t index;
+	if (!pools_[algo].Allocate(state, outbytes, &index)) {
+		Nan::ThrowError(v8::Exception::RangeError(Nan::New<v8::String>("Too many hashes in this arena").ToLocalChecked()));
+		return false;
+	}
+	*handle = index * 4 + algo;
+	return true;
+}
+
+NAN_METHOD(HashArena::New) {
+	if (!info.IsConstructCall()) {
+		return Nan::ThrowError("Constructor must be called with new");
+	}
+	HashArena *obj = new HashArena();
+	obj->Wrap(info.This());
+	info.This()->SetAlignedPointerInInternalField(1, const_cast<int*>(&HASH_ARENA_TAG));
+	info.GetReturnValue().Set(info.This());
+}
+
+// create(algorithm, key, digestLength): returns a handle
+NAN_METHOD(HashArena::Create) {
+	HashArena *obj = Nan::ObjectWrap::Unwrap<HashArena>(info.This());
+	any_blake2 h;
+	if (!HashFromArguments(info, 0, &h)) {
+		return;
+	}
+	uint32_t handle;
+	if (obj->Add(&h.state, h.algo, h.outbytes, &handle)) {
+		info.GetReturnValue().Set(handle);
+	}
+}
+
+// update(handle, buffer)
+NAN_METHOD(HashArena::Update) {
+	HashArena *obj = Nan::ObjectWrap::Unwrap<HashArena>(info.This());
+	ArenaPool *pool;
+	ArenaSlot *slot = obj->LookupOpen(info[0], &pool);
+	if (!slot) {
+		return;
+	}
+	if (info.Length() < 2 || !node::Buffer::HasInstance(info[1])) {
+		return Nan::ThrowError(v8::Exception::TypeError(Nan::New<v8::String>("Bad argument; need a Buffer").ToLocalChecked()));
+	}
+	const size_t length = node::Buffer::Length(info[1]);
+	StatsCountUpdate(length);
+	TraceSpan span(TRACE_UPDATE, pool->Algo(), length);
+	pool->Update(slot, node::Buffer::Data(info[1]), length);
+}
+
+// digest(handle): returns the digest; the handle stays taken until freed
+NAN_METHOD(HashArena::Digest) {
+	HashArena *obj = Nan::ObjectWrap::Unwrap<HashArena>(info.This());
+	ArenaPool *pool;
+	ArenaSlot *slot = obj->LookupOpen(info[0], &pool);
+	if (!slot) {
+		return;
+	}
+	TraceSpan span(TRACE_FINAL, pool->Algo());
+	uint8_t digest[BLAKE2B_OUTBYTES];
+	if (pool->Final(slot, digest) != 0) {
+		return Nan::ThrowError("blake2*_final failure");
+	}
+	info.GetReturnValue().Set(Nan::CopyBuffer(reinterpret_cast<const char*>(digest), slot->outbytes).ToLocalChecked());
+}
+
+// copy(handle): returns a new handle to a copy of the state
+NAN_METHOD(HashArena::Copy) {
+	HashArena *obj = Nan::ObjectWrap::Unwrap<HashArena>(info.This());
+	ArenaPool *pool;
+	ArenaSlot *slot = obj->LookupOpen(info[0], &pool);
+	if (!slot) {
+		return;
+	}
+	// Slabs never move, so the slot stays valid while the copy is added
+	uint32_t handle;
+	if (obj->Add(ArenaPool::State(slot), pool->Algo(), slot->outbytes, &handle)) {
+		StatsCountCopy();
+		info.GetReturnValue().Set(handle);
+	}
+}
+
+// free(handle)
+NAN_METHOD(HashArena::Free) {
+	HashArena *obj = Nan::ObjectWrap::Unwrap<HashArena>(info.This());
+	ArenaPool *pool;
+	if (!obj->Lookup(info[0], &pool)) {
+		return;
+	}
+	pool->Free(Nan::To<uint32_t>(info[0]).FromJust() / 4);
+}
+
+// size(): the number of handles taken
+NAN_METHOD(HashArena::Size) {
+	HashArena *obj = Nan::ObjectWrap::Unwrap<HashArena>(info.This());
+	double live = 0;
+	for (const ArenaPool &pool : obj->pools_) {
+		live += pool.Live();
+	}
+	info.GetReturnValue().Set(live);
+}
+
+NAN_MODULE_INIT(InitHashArena) {
+	HashArena::Init(target);
+}
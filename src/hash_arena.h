@@ -0,0 +1,110 @@
+#ifndef NODE_BLAKE2_HASH_ARENA_H
+#define NODE_BLAKE2_HASH_ARENA_H
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#include <nan.h>
+
+#include "any_blake2.h"
+
+enum ArenaSlotStatus : uint8_t {
+	ARENA_FREE,
+	ARENA_OPEN,
+	// Digested, but not yet freed
+	ARENA_FINISHED
+};
+
+/**
+ * The header of a slot; the algorithm's state follows it.
+ */
+struct ArenaSlot {
+	uint8_t outbytes;
+	ArenaSlotStatus status;
+	uint8_t reserved[6];
+};
+
+/**
+ * The states of one algorithm, in slabs of equally sized slots.
+ */
+class ArenaPool {
+ public:
+	explicit ArenaPool(any_blake2_algo algo);
+
+	any_blake2_algo Algo() const {
+		return algo_;
+	}
+
+	size_t Live() const {
+		return live_;
+	}
+
+	/**
+	 * Takes a slot for a copy of `state`.  Returns false if the pool is full.
+	 */
+	bool Allocate(const void *state, uint8_t outbytes, uint32_t *index);
+	void Free(uint32_t index);
+
+	/** The slot at `index`, or nullptr if it is not taken. */
+	ArenaSlot *Find(uint32_t index);
+
+	static void *State(ArenaSlot *slot) {
+		return slot + 1;
+	}
+
+	void Update(ArenaSlot *slot, const void *data, size_t length);
+
+	/** Writes the digest and marks the slot finished. */
+	int Final(ArenaSlot *slot, uint8_t *out);
+
+ private:
+	ArenaSlot *Slot(uint32_t index);
+
+	any_blake2_algo algo_;
+	int (*update_)(void*, const void*, size_t);
+	int (*final_)(void*, const void*, size_t);
+	// Slot size in 8-byte words, header included
+	size_t words_;
+	std::vector<std::unique_ptr<uint64_t[]>> slabs_;
+	std::vector<uint32_t> free_;
+	uint32_t slots_;
+	size_t live_;
+};
+
+/**
+ * Many streaming hashes behind one JS object, addressed by integer handles.
+ */
+class HashArena: public Nan::ObjectWrap {
+ public:
+	static NAN_MODULE_INIT(Init);
+
+	/** The arena behind a HashArena object, or nullptr. */
+	static HashArena *FromValue(v8::Local<v8::Value> value);
+
+	/**
+	 * The slot behind a handle, or nullptr with a JS exception thrown.
+	 * LookupOpen also requires it not to have been digested.
+	 */
+	ArenaSlot *Lookup(v8::Local<v8::Value> handle, ArenaPool **pool);
+	ArenaSlot *LookupOpen(v8::Local<v8::Value> handle, ArenaPool **pool);
+
+ private:
+	HashArena();
+
+	bool Add(const void *state, any_blake2_algo algo, uint8_t outbytes, uint32_t *handle);
+
+	static NAN_METHOD(New);
+	static NAN_METHOD(Create);
+	static NAN_METHOD(Update);
+	static NAN_METHOD(Digest);
+	static NAN_METHOD(Copy);
+	static NAN_METHOD(Free);
+	static NAN_METHOD(Size);
+
+	// Indexed by any_blake2_algo
+	ArenaPool pools_[4];
+};
+
+#endif
@@ -0,0 +1,253 @@
+#include <node.h>
+#include <node_buffer.h>
+#include <v8.h>
+#include <nan.h>
+
+#include <algorithm>
+#include <string>
+#include <vector>
+
+#include "any_blake2.h"
+#include "blake2_addon.h"
+#include "file_io.h"
+#include "stats.h"
+#include "trace.h"
+#include "tuning.h"
+
+/*
+ * Several digests of the same data in one pass.  The input is walked in
+ * tiles small enough to stay in L1 while every state absorbs them, so the
+ * data is read from memory (or disk) once however many digests are wanted.
+ */
+
+// Bytes read from a file at once
+static const size_t MULTI_HASH_READ = 1024 * 1024;
+
+class MultiHasher {
+ public:
+	void Add(const any_blake2 &h) {
+		states_.push_back(h);
+	}
+
+	size_t Count() const {
+		return states_.size();
+	}
+
+	// The algorithm of the first digest, for tracing
+	any_blake2_algo Algo() const {
+		return states_[0].algo;
+	}
+
+	void Update(const uint8_t *data, size_t length) {
+		const size_t tile_size = static_cast<size_t>(Tuned(TUNING_MULTI_HASH_TILE));
+		for (size_t at = 0; at < length; at += tile_size) {
+			const size_t tile = std::min(length - at, tile_size);
+			for (any_blake2 &h : states_) {
+				any_blake2_update(&h, data + at, tile);
+			}
+		}
+	}
+
+	/**
+	 * Finalizes every state and writes each digest to the matching entry of
+	 * `digests`.
+	 */
+	void Final(std::vector<std::vector<uint8_t>> *digests) {
+		digests->resize(states_.size());
+		for (size_t i = 0; i < states_.size(); i++) {
+			any_blake2 &h = states_[i];
+			(*digests)[i].resize(h.outbytes);
+			any_blake2_final(&h, (*digests)[i].data());
+		}
+	}
+
+ private:
+	std::vector<any_blake2> states_;
+};
+
+/**
+ * Fills `hasher` from an array of [algorithm, key, digestLength] specs.  On
+ * failure a JS exception has been thrown and false is returned.
+ */
+static bool HasherFromSpecs(v8::Local<v8::Value> value, MultiHasher *hasher) {
+	if (!value->IsArray() || value.As<v8::Array>()->Length() == 0) {
+		Nan::ThrowError(v8::Exception::TypeError(Nan::New<v8::String>("Specs must be a non-empty array").ToLocalChecked()));
+		return false;
+	}
+	v8::Local<v8::Array> specs = value.As<v8::Array>();
+	for (uint32_t i = 0; i < specs->Length(); i++) {
+		v8::Local<v8::Value> spec = Nan::Get(specs, i).ToLocalChecked();
+		if (!spec->IsArray()) {
+			Nan::ThrowError(v8::Exception::TypeError(Nan::New<v8::String>("Each spec must be an [algorithm, key, digestLength] array").ToLocalChecked()));
+			return false;
+		}
+		v8::Local<v8::Array> fields = spec.As<v8::Array>();
+		any_blake2 h;
+		if (!HashFromValues(Nan::Get(fields, 0).ToLocalChecked(), Nan::Get(fields, 1).ToLocalChecked(), Nan::Get(fields, 2).ToLocalChecked(), &h)) {
+			return false;
+		}
+		hasher->Add(h);
+	}
+	return true;
+}
+
+static v8::Local<v8::Array> DigestsToArray(const std::vector<std::vector<uint8_t>> &digests) {
+	v8::Local<v8::Array> array = Nan::New<v8::Array>(static_cast<int>(digests.size()));
+	for (size_t i = 0; i < digests.size(); i++) {
+		Nan::Set(array, static_cast<uint32_t>(i), Nan::CopyBuffer(reinterpret_cast<const char*>(digests[i].data()), digests[i].size()).ToLocalChecked());
+	}
+	return array;
+}
+
+class MultiHashWorker: public Nan::AsyncWorker {
+ public:
+	explicit MultiHashWorker(Nan::Callback *callback)
+		: Nan::AsyncWorker(callback, "blake2:hashMulti"), data_(nullptr), length_(0) {}
+
+	MultiHasher *Hasher() {
+		return &hasher_;
+	}
+
+	void SetBuffer(v8::Local<v8::Object> buffer) {
+		SaveToPersistent("source", buffer);
+		data_ = reinterpret_cast<const uint8_t*>(node::Buffer::Data(buffer));
+		length_ = node::Buffer::Length(buffer);
+	}
+
+	void SetPath(const std::string &path) {
+		path_ = path;
+	}
+
+	void Execute() override {
+		ticket_.Started();
+		TraceSpan span(data_ ? TRACE_ASYNC : TRACE_FILE, hasher_.Algo(), length_);
+		if (data_) {
+			hasher_.Update(data_, length_);
+		} else {
+			ReadOnlyFile file;
+			if (!file.Open(path_)) {
+				return SetErrorMessage(ReadOnlyFile::LastError().c_str());
+			}
+			std::vector<uint8_t> buffer(MULTI_HASH_READ);
+			for (uint64_t offset = 0;; ) {
+				int64_t got = file.ReadAt(buffer.data(), buffer.size(), offset);
+				if (got < 0) {
+					return SetErrorMessage(ReadOnlyFile::LastError().c_str());
+				}
+				if (got == 0) {
+					break;
+				}
+				hasher_.Update(buffer.data(), static_cast<size_t>(got));
+				span.AddBytes(static_cast<uint64_t>(got));
+				offset += static_cast<uint64_t>(got);
+			}
+		}
+		hasher_.Final(&digests_);
+	}
+
+	void HandleOKCallback() override {
+		Nan::HandleScope scope;
+		v8::Local<v8::Value> argv[] = {
+			Nan::Null(),
+			DigestsToArray(digests_)
+		};
+		callback->Call(2, argv, async_resource);
+	}
+
+ private:
+	StatsQueueTicket ticket_;
+	MultiHasher hasher_;
+	const uint8_t *data_;
+	size_t length_;
+	std::string path_;
+	std::vector<std::vector<uint8_t>> digests_;
+};
+
+// hashMulti(bufferOrPath, specs, callback)
+static NAN_METHOD(HashMulti) {
+	if (info.Length() < 3 || !info[2]->IsFunction()) {
+		return Nan::ThrowError(v8::Exception::TypeError(Nan::New<v8::String>("Last argument must be a callback").ToLocalChecked()));
+	}
+	if (!node::Buffer::HasInstance(info[0]) && !info[0]->IsString()) {
+		return Nan::ThrowError(v8::Exception::TypeError(Nan::New<v8::String>("Input must be a Buffer or a file path").ToLocalChecked()));
+	}
+
+	MultiHasher hasher;
+	if (!HasherFromSpecs(info[1], &hasher)) {
+		return;
+	}
+
+	Nan::Callback *callback = new Nan::Callback(info[2].As<v8::Function>());
+	MultiHashWorker *worker = new MultiHashWorker(callback);
+	*worker->Hasher() = hasher;
+	if (info[0]->IsString()) {
+		worker->SetPath(*Nan::Utf8String(info[0]));
+	} else {
+		worker->SetBuffer(info[0].As<v8::Object>());
+	}
+	Nan::AsyncQueueWorker(worker);
+}
+
+class MultiHash: public Nan::ObjectWrap {
+	bool initialized_;
+	MultiHasher hasher;
+
+	MultiHash() : initialized_(false) {}
+
+ public:
+	static NAN_MODULE_INIT(Init) {
+		v8::Local<v8::FunctionTemplate> tpl = Nan::New<v8::FunctionTemplate>(New);
+		tpl->SetClassName(Nan::New("MultiHash").ToLocalChecked());
+		tpl->InstanceTemplate()->SetInternalFieldCount(1);
+		Nan::SetPrototypeMethod(tpl, "update", Update);
+		Nan::SetPrototypeMethod(tpl, "digest", Digest);
+		Nan::Set(target, Nan::New("MultiHash").ToLocalChecked(), Nan::GetFunction(tpl).ToLocalChecked());
+	}
+
+	// new MultiHash(specs)
+	static NAN_METHOD(New) {
+		if (!info.IsConstructCall()) {
+			return Nan::ThrowError("Constructor must be called with new");
+		}
+
+		MultiHash *obj = new MultiHash();
+		obj->Wrap(info.This());
+		if (!HasherFromSpecs(info[0], &obj->hasher)) {
+			return;
+		}
+		obj->initialized_ = true;
+		info.GetReturnValue().Set(info.This());
+	}
+
+	static NAN_METHOD(Update) {
+		MultiHash *obj = Nan::ObjectWrap::Unwrap<MultiHash>(info.This());
+
+		if (!obj->initialized_) {
+			return Nan::ThrowError(v8::Exception::Error(Nan::New<v8::String>("Not initialized").ToLocalChecked()));
+		}
+		if (info.Length() < 1 || !node::Buffer::HasInstance(info[0])) {
+			return Nan::ThrowError(v8::Exception::TypeError(Nan::New<v8::String>("Bad argument; need a Buffer").ToLocalChecked()));
+		}
+		TraceSpan span(TRACE_UPDATE, obj->hasher.Algo(), node::Buffer::Length(info[0]));
+		obj->hasher.Update(reinterpret_cast<const uint8_t*>(node::Buffer::Data(info[0])), node::Buffer::Length(info[0]));
+		info.GetReturnValue().Set(info.This());
+	}
+
+	// digest(): an array with one Buffer per spec
+	static NAN_METHOD(Digest) {
+		MultiHash *obj = Nan::ObjectWrap::Unwrap<MultiHash>(info.This());
+
+		if (!obj->initialized_) {
+			return Nan::ThrowError(v8::Exception::Error(Nan::New<v8::String>("Not initialized").ToLocalChecked()));
+		}
+		obj->initialized_ = false;
+		std::vector<std::vector<uint8_t>> digests;
+		obj->hasher.Final(&digests);
+		info.GetReturnValue().Set(DigestsToArray(digests));
+	}
+};
+
+NAN_MODULE_INIT(InitMultiHash) {
+	MultiHash::Init(target);
+	Nan::SetMethod(target, "hashMulti", HashMulti);
+}
@@ -0,0 +1,264 @@
+#include <node.h>
+#include <node_buffer.h>
+#include <v8.h>
+#include <nan.h>
+
+#include <algorithm>
+#include <atomic>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "any_blake2.h"
+#include "blake2_addon.h"
+#include "blake2_lanes.h"
+#include "file_io.h"
+#include "stats.h"
+#include "thread_pool.h"
+#include "trace.h"
+#include "tuning.h"
+
+/*
+ * Fixed-size piece hashing: the input is cut into pieceSize pieces (the last
+ * one may be shorter) and the digests are returned back to back.  Pieces are
+ * spread over the thread pool; small ones are hashed several at a time with
+ * the multi-buffer kernel.
+ */
+
+static const size_t PIECES_READ_SIZE = 1024 * 1024;
+
+class PieceHasher {
+ public:
+	PieceHasher(const any_blake2 &initial, size_t piece_size)
+		: initial_(initial), post_key_(initial), piece_size_(piece_size), group_(1),
+		  parallel_min_bytes_(Tuned(TUNING_PIECES_PARALLEL_MIN_BYTES)) {
+		if (piece_size <= Tuned(TUNING_PIECES_LANES_MAX_SIZE) && blake2_lanes_accelerated()) {
+			if (initial.algo == ANY_BLAKE2B) {
+				group_ = BLAKE2B_LANES;
+				blake2b_absorb_pending(&post_key_.state.casted_blake2b_state);
+			} else if (initial.algo == ANY_BLAKE2S) {
+				group_ = BLAKE2S_LANES;
+				blake2s_absorb_pending(&post_key_.state.casted_blake2s_state);
+			}
+		}
+	}
+
+	any_blake2_algo Algo() const {
+		return initial_.algo;
+	}
+
+	uint64_t Count(uint64_t length) const {
+		return (length + piece_size_ - 1) / piece_size_;
+	}
+
+	/**
+	 * Hashes every piece of either `data` or `file` (`length` bytes) into
+	 * `out`.  Returns false and sets `error` if the file could not be read.
+	 */
+	bool Hash(const uint8_t *data, const ReadOnlyFile *file, uint64_t length, uint8_t *out, std::string *error) {
+		const uint64_t pieces = Count(length);
+		const size_t groups = static_cast<size_t>((pieces + group_ - 1) / group_);
+		std::atomic<bool> failed(false);
+		std::mutex error_mutex;
+
+		std::function<void(size_t)> task = [&](size_t group) {
+			if (failed.load(std::memory_order_relaxed)) {
+				return;
+			}
+			std::string group_error;
+			if (!HashGroup(data, file, length, group, out, &group_error)) {
+				std::lock_guard<std::mutex> lock(error_mutex);
+				if (!failed.exchange(true)) {
+					*error = group_error;
+				}
+			}
+		};
+
+		if (length < parallel_min_bytes_) {
+			for (size_t group = 0; group < groups; group++) {
+				task(group);
+			}
+		} else {
+			ThreadPool::Shared().ParallelFor(groups, task);
+		}
+		return !failed;
+	}
+
+ private:
+	/**
+	 * Reads exactly `length` bytes at `offset`; the file was measured
+	 * before hashing started, so fewer bytes mean it shrank since.
+	 */
+	static bool ReadExactly(const ReadOnlyFile *file, uint8_t *buffer, size_t length, uint64_t offset, std::string *error) {
+		const int64_t got = file->ReadAt(buffer, length, offset);
+		if (got < 0) {
+			*error = ReadOnlyFile::LastError();
+			return false;
+		}
+		if (got != static_cast<int64_t>(length)) {
+			*error = "File changed while reading";
+			return false;
+		}
+		return true;
+	}
+
+	bool HashGroup(const uint8_t *data, const ReadOnlyFile *file, uint64_t length, size_t group, uint8_t *out, std::string *error) {
+		static thread_local std::vector<uint8_t> scratch;
+
+		const uint64_t first = static_cast<uint64_t>(group) * group_;
+		const uint64_t start = first * piece_size_;
+		const uint64_t end = std::min(length, start + static_cast<uint64_t>(group_) * piece_size_);
+		const size_t pieces = static_cast<size_t>(Count(end - start));
+		const size_t outbytes = initial_.outbytes;
+		out += first * outbytes;
+
+		if (group_ == 1) {
+			return HashPiece(data, file, start, static_cast<size_t>(end - start), out, error);
+		}
+
+		// Same-length pieces go through the lanes; a short last piece does not
+		const uint8_t *base = data ? data + start : nullptr;
+		if (!base) {
+			scratch.resize(static_cast<size_t>(end - start));
+			if (!ReadExactly(file, scratch.data(), scratch.size(), start, error)) {
+				return false;
+			}
+			base = scratch.data();
+		}
+		size_t full = static_cast<size_t>((end - start) / piece_size_);
+		const uint8_t *in[BLAKE2S_LANES];
+		uint8_t *digests[BLAKE2S_LANES];
+		for (size_t i = 0; i < full; i++) {
+			in[i] = base + i * piece_size_;
+			digests[i] = out + i * outbytes;
+		}
+		if (full > 0) {
+			if (initial_.algo == ANY_BLAKE2B) {
+				blake2b_hash_lanes(&post_key_.state.casted_blake2b_state, in, piece_size_, digests, full);
+			} else {
+				blake2s_hash_lanes(&post_key_.state.casted_blake2s_state, in, piece_size_, digests, full);
+			}
+		}
+		if (full < pieces) {
+			any_blake2 h;
+			any_blake2_copy(&h, &initial_);
+			any_blake2_update(&h, base + full * piece_size_, static_cast<size_t>(end - start) - full * piece_size_);
+			any_blake2_final(&h, out + full * outbytes);
+		}
+		return true;
+	}
+
+	bool HashPiece(const uint8_t *data, const ReadOnlyFile *file, uint64_t start, size_t length, uint8_t *out, std::string *error) {
+		static thread_local std::vector<uint8_t> scratch;
+
+		any_blake2 h;
+		any_blake2_copy(&h, &initial_);
+		if (data) {
+			any_blake2_update(&h, data + start, length);
+		} else {
+			scratch.resize(std::min(length, PIECES_READ_SIZE));
+			for (size_t done = 0; done < length;) {
+				size_t want = std::min(length - done, scratch.size());
+				if (!ReadExactly(file, scratch.data(), want, start + done, error)) {
+					return false;
+				}
+				any_blake2_update(&h, scratch.data(), want);
+				done += want;
+			}
+		}
+		any_blake2_final(&h, out);
+		return true;
+	}
+
+	any_blake2 initial_;
+	any_blake2 post_key_;
+	size_t piece_size_;
+	size_t group_;
+	uint64_t parallel_min_bytes_;
+};
+
+class PiecesWorker: public Nan::AsyncWorker {
+ public:
+	PiecesWorker(Nan::Callback *callback, const any_blake2 &initial, size_t piece_size)
+		: Nan::AsyncWorker(callback, "blake2:hashPieces"), hasher_(initial, piece_size),
+		  outbytes_(initial.outbytes), data_(nullptr), length_(0) {}
+
+	void SetBuffer(v8::Local<v8::Object> buffer) {
+		SaveToPersistent("source", buffer);
+		data_ = reinterpret_cast<const uint8_t*>(node::Buffer::Data(buffer));
+		length_ = node::Buffer::Length(buffer);
+	}
+
+	void SetPath(const std::string &path) {
+		path_ = path;
+	}
+
+	void Execute() override {
+		ticket_.Started();
+		ReadOnlyFile file;
+		if (!data_) {
+			int64_t size;
+			if (!file.Open(path_) || (size = file.Size()) < 0) {
+				return SetErrorMessage(ReadOnlyFile::LastError().c_str());
+			}
+			length_ = static_cast<uint64_t>(size);
+		}
+
+		TraceSpan span(data_ ? TRACE_ASYNC : TRACE_FILE, hasher_.Algo(), length_);
+		digests_.resize(static_cast<size_t>(hasher_.Count(length_)) * outbytes_);
+		std::string error;
+		if (!hasher_.Hash(data_, &file, length_, digests_.data(), &error)) {
+			SetErrorMessage(error.c_str());
+		}
+	}
+
+	void HandleOKCallback() override {
+		Nan::HandleScope scope;
+		v8::Local<v8::Value> argv[] = {
+			Nan::Null(),
+			Nan::CopyBuffer(reinterpret_cast<const char*>(digests_.data()), digests_.size()).ToLocalChecked()
+		};
+		callback->Call(2, argv, async_resource);
+	}
+
+ private:
+	StatsQueueTicket ticket_;
+	PieceHasher hasher_;
+	size_t outbytes_;
+	const uint8_t *data_;
+	uint64_t length_;
+	std::string path_;
+	std::vector<uint8_t> digests_;
+};
+
+// hashPieces(bufferOrPath, pieceSize, algorithm, key, digestLength, callback)
+static NAN_METHOD(HashPieces) {
+	if (info.Length() < 6 || !info[5]->IsFunction()) {
+		return Nan::ThrowError(v8::Exception::TypeError(Nan::New<v8::String>("Last argument must be a callback").ToLocalChecked()));
+	}
+	if (!node::Buffer::HasInstance(info[0]) && !info[0]->IsString()) {
+		return Nan::ThrowError(v8::Exception::TypeError(Nan::New<v8::String>("Input must be a Buffer or a file path").ToLocalChecked()));
+	}
+	if (!info[1]->IsUint32() || Nan::To<uint32_t>(info[1]).FromJust() == 0) {
+		return Nan::ThrowError(v8::Exception::TypeError(Nan::New<v8::String>("pieceSize must be a positive integer").ToLocalChecked()));
+	}
+
+	any_blake2 initial;
+	if (!HashFromArguments(info, 2, &initial)) {
+		return;
+	}
+
+	Nan::Callback *callback = new Nan::Callback(info[5].As<v8::Function>());
+	PiecesWorker *worker = new PiecesWorker(callback, initial, Nan::To<uint32_t>(info[1]).FromJust());
+	if (info[0]->IsString()) {
+		worker->SetPath(*Nan::Utf8String(info[0]));
+	} else {
+		worker->SetBuffer(info[0].As<v8::Object>());
+	}
+	Nan::AsyncQueueWorker(worker);
+}
+
+NAN_MODULE_INIT(InitPieces) {
+	Nan::SetMethod(target, "hashPieces", HashPieces);
+}
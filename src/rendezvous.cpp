@@ -0,0 +1,342 @@
+#include <node.h>
+#include <node_buffer.h>
+#include <v8.h>
+#include <nan.h>
+
+#include <algorithm>
+#include <cstring>
+#include <memory>
+#include <vector>
+
+#include "any_blake2.h"
+#include "blake2_addon.h"
+#include "blake2_lanes.h"
+#include "byte_order.h"
+#include "stats.h"
+#include "thread_pool.h"
+#include "trace.h"
+#include "tuning.h"
+
+/*
+ * Rendezvous (highest random weight) hashing: an object goes to the nodes
+ * with the highest weights, where the weight of a node for an object is the
+ * 8-byte keyed BLAKE2s digest of (node id length u32 LE || node id || object
+ * key), read as a little-endian integer.  The key block and the node id are
+ * absorbed once per node, so every (object, node) pair is hashed from a
+ * shared prefix state, and the pairs are spread over the multi-buffer lanes.
+ */
+
+static const size_t RENDEZVOUS_WEIGHT_BYTES = 8;
+
+// (object, node) pairs handed to the lanes at once
+static const size_t RENDEZVOUS_BATCH = 256;
+
+class RendezvousSelector {
+ public:
+	const char *Reset(const void *key, size_t key_length, const std::vector<std::string> &nodes) {
+		any_blake2 h;
+		const char *error = any_blake2_init(&h, ANY_BLAKE2S, key, key_length, RENDEZVOUS_WEIGHT_BYTES);
+		if (error) {
+			return error;
+		}
+		prefixes_.resize(nodes.size());
+		for (size_t i = 0; i < nodes.size(); i++) {
+			uint8_t length[4];
+			store_le32(length, static_cast<uint32_t>(nodes[i].size()));
+			prefixes_[i] = h.state.casted_blake2s_state;
+			StatsCountBytes(ANY_BLAKE2S, sizeof(length) + nodes[i].size());
+			blake2s_update(&prefixes_[i], length, sizeof(length));
+			blake2s_update(&prefixes_[i], nodes[i].data(), nodes[i].size());
+		}
+		return nullptr;
+	}
+
+	size_t Nodes() const {
+		return prefixes_.size();
+	}
+
+	/**
+	 * Writes the indexes of the `k` nodes with the highest weights for each
+	 * object key ending at `ends` in `data` to `out`, k per key, best first.
+	 */
+	void Select(const uint8_t *data, const uint32_t *ends, size_t count, size_t k, uint32_t *out) const {
+		const size_t nodes = prefixes_.size();
+		// Several keys share a call when there are few nodes, so that the
+		// lanes stay busy
+		const size_t group = std::max<size_t>(1, RENDEZVOUS_BATCH / nodes);
+		std::vector<blake2s_message> messages(blake2_lanes_accelerated() ? group * nodes : 0);
+		std::vector<uint8_t> digests(group * nodes * RENDEZVOUS_WEIGHT_BYTES);
+		std::vector<uint64_t> weights(nodes);
+		std::vector<uint32_t> order(nodes);
+
+		for (size_t first = 0; first < count; first += group) {
+			const size_t keys = std::min(count - first, group);
+			for (size_t j = 0; j < keys; j++) {
+				const size_t i = first + j;
+				const uint32_t start = i ? ends[i - 1] : 0;
+				for (size_t n = 0; n < nodes; n++) {
+					uint8_t *digest = &digests[(j * nodes + n) * RENDEZVOUS_WEIGHT_BYTES];
+					if (messages.empty()) {
+						blake2s_state S = prefixes_[n];
+						StatsCountBytes(ANY_BLAKE2S, ends[i] - start);
+						StatsCountDigests(ANY_BLAKE2S, 1);
+						blake2s_update(&S, data + start, ends[i] - start);
+						blake2s_final(&S, digest, RENDEZVOUS_WEIGHT_BYTES);
+					} else {
+						blake2s_message &m = messages[j * nodes + n];
+						m.S = &prefixes_[n];
+						m.in = data + start;
+						m.inlen = ends[i] - start;
+						m.out = digest;
+					}
+				}
+			}
+			if (!messages.empty()) {
+				blake2s_hash_many(messages.data(), keys * nodes);
+			}
+
+			for (size_t j = 0; j < keys; j++) {
+				for (size_t n = 0; n < nodes; n++) {
+					weights[n] = load_le64(&digests[(j * nodes + n) * RENDEZVOUS_WEIGHT_BYTES]);
+					order[n] = static_cast<uint32_t>(n);
+				}
+				// Equal weights go to the node listed first
+				std::partial_sort(order.begin(), order.begin() + k, order.end(), [&weights](uint32_t a, uint32_t b) {
+					return weights[a] != weights[b] ? weights[a] > weights[b] : a < b;
+				});
+				std::copy(order.begin(), order.begin() + k, out + (first + j) * k);
+			}
+		}
+	}
+
+ private:
+	std::vector<blake2s_state> prefixes_;
+};
+
+/**
+ * Object key ends must be ascending and lie within a buffer of `length` bytes.
+ */
+static bool KeyEndsValid(const uint32_t *ends, size_t count, size_t length) {
+	uint32_t previous = 0;
+	for (size_t i = 0; i < count; i++) {
+		if (ends[i] < previous || ends[i] > length) {
+			return false;
+		}
+		previous = ends[i];
+	}
+	return true;
+}
+
+/**
+ * Appends a string or Buffer to `packed`; false if `value` is neither.
+ */
+static bool PackValue(v8::Local<v8::Value> value, std::vector<uint8_t> *packed) {
+	if (node::Buffer::HasInstance(value)) {
+		const char *bytes = node::Buffer::Data(value);
+		packed->insert(packed->end(), bytes, bytes + node::Buffer::Length(value));
+	} else if (value->IsString()) {
+		Nan::Utf8String utf8(value);
+		packed->insert(packed->end(), *utf8, *utf8 + utf8.length());
+	} else {
+		return false;
+	}
+	return true;
+}
+
+class RendezvousWorker: public Nan::AsyncWorker {
+ public:
+	RendezvousWorker(Nan::Callback *callback, std::shared_ptr<const RendezvousSelector> selector, size_t k)
+		: Nan::AsyncWorker(callback, "blake2:rendezvous"), selector_(selector), k_(k),
+		  data_(nullptr), ends_(nullptr), count_(0) {}
+
+	// Takes keys packed on the main thread
+	void SetPacked(std::vector<uint8_t> *packed, std::vector<uint32_t> *ends) {
+		packed_.swap(*packed);
+		packed_ends_.swap(*ends);
+		data_ = packed_.data();
+		ends_ = packed_ends_.data();
+		count_ = packed_ends_.size();
+	}
+
+	// Reads keys straight from a Buffer and its Uint32Array of key ends
+	void SetBuffer(v8::Local<v8::Object> buffer, v8::Local<v8::Value> ends) {
+		SaveToPersistent("source", buffer);
+		SaveToPersistent("ends", ends);
+		data_ = reinterpret_cast<const uint8_t*>(node::Buffer::Data(buffer));
+		Nan::TypedArrayContents<uint32_t> contents(ends);
+		ends_ = *contents;
+		count_ = contents.length();
+	}
+
+	void Execute() override {
+		ticket_.Started();
+		TraceSpan span(TRACE_ASYNC, ANY_BLAKE2S, count_ ? ends_[count_ - 1] : 0);
+		selected_.resize(count_ * k_);
+		const size_t task_keys = static_cast<size_t>(Tuned(TUNING_RENDEZVOUS_TASK_KEYS));
+		const size_t tasks = (count_ + task_keys - 1) / task_keys;
+		ThreadPool::Shared().ParallelFor(tasks, [this, task_keys](size_t task) {
+			const size_t first = task * task_keys;
+			const size_t keys = std::min(count_ - first, task_keys);
+			// Keys are relative to the end of the previous task's last key
+			const uint32_t base = first ? ends_[first - 1] : 0;
+			std::vector<uint32_t> ends(ends_ + first, ends_ + first + keys);
+			for (uint32_t &end : ends) {
+				end -= base;
+			}
+			selector_->Select(data_ + base, ends.data(), keys, k_, &selected_[first * k_]);
+		});
+	}
+
+	void HandleOKCallback() override {
+		Nan::HandleScope scope;
+		v8::Local<v8::Value> argv[] = {
+			Nan::Null(),
+			Nan::CopyBuffer(reinterpret_cast<const char*>(selected_.data()), selected_.size() * sizeof(uint32_t)).ToLocalChecked()
+		};
+		callback->Call(2, argv, async_resource);
+	}
+
+ private:
+	StatsQueueTicket ticket_;
+	std::shared_ptr<const RendezvousSelector> selector_;
+	size_t k_;
+	std::vector<uint8_t> packed_;
+	std::vector<uint32_t> packed_ends_;
+	const uint8_t *data_;
+	const uint32_t *ends_;
+	size_t count_;
+	std::vector<uint32_t> selected_;
+};
+
+class Rendezvous: public Nan::ObjectWrap {
+	// Shared with batch workers still running after the object is collected
+	std::shared_ptr<const RendezvousSelector> selector;
+
+ public:
+	static NAN_MODULE_INIT(Init) {
+		v8::Local<v8::FunctionTemplate> tpl = Nan::New<v8::FunctionTemplate>(New);
+		tpl->SetClassName(Nan::New("Rendezvous").ToLocalChecked());
+		tpl->InstanceTemplate()->SetInternalFieldCount(1);
+		Nan::SetPrototypeMethod(tpl, "select", Select);
+		Nan::SetPrototypeMethod(tpl, "selectMany", SelectMany);
+		Nan::Set(target, Nan::New("Rendezvous").ToLocalChecked(), Nan::GetFunction(tpl).ToLocalChecked());
+	}
+
+	// new Rendezvous(key, nodeIds)
+	static NAN_METHOD(New) {
+		if (!info.IsConstructCall()) {
+			return Nan::ThrowError("Constructor must be called with new");
+		}
+		if (info.Length() < 2 || !node::Buffer::HasInstance(info[0])) {
+			return Nan::ThrowError(v8::Exception::TypeError(Nan::New<v8::String>("Key must be a Buffer").ToLocalChecked()));
+		}
+		if (!info[1]->IsArray() || info[1].As<v8::Array>()->Length() == 0) {
+			return Nan::ThrowError(v8::Exception::TypeError(Nan::New<v8::String>("Nodes must be a non-empty array").ToLocalChecked()));
+		}
+
+		v8::Local<v8::Array> array = info[1].As<v8::Array>();
+		std::vector<std::string> nodes(array->Length());
+		for (uint32_t i = 0; i < array->Length(); i++) {
+			std::vector<uint8_t> id;
+			if (!PackValue(Nan::Get(array, i).ToLocalChecked(), &id)) {
+				return Nan::ThrowError(v8::Exception::TypeError(Nan::New<v8::String>("Node ids must be strings or Buffers").ToLocalChecked()));
+			}
+			nodes[i].assign(id.begin(), id.end());
+		}
+
+		Rendezvous *obj = new Rendezvous();
+		obj->Wrap(info.This());
+		std::shared_ptr<RendezvousSelector> selector = std::make_shared<RendezvousSelector>();
+		const char *error = selector->Reset(node::Buffer::Data(info[0]), node::Buffer::Length(info[0]), nodes);
+		if (error) {
+			return Nan::ThrowError(error);
+		}
+		obj->selector = selector;
+		info.GetReturnValue().Set(info.This());
+	}
+
+	// select(objectKey, k): Buffer of the k best native-endian u32 node indexes
+	static NAN_METHOD(Select) {
+		static thread_local std::vector<uint8_t> packed;
+		static thread_local std::vector<uint32_t> selected;
+		Rendezvous *obj = Nan::ObjectWrap::Unwrap<Rendezvous>(info.This());
+
+		packed.clear();
+		if (info.Length() < 1 || !PackValue(info[0], &packed)) {
+			return Nan::ThrowError(v8::Exception::TypeError(Nan::New<v8::String>("Object key must be a string or a Buffer").ToLocalChecked()));
+		}
+		size_t k;
+		if (!KFromArgument(obj, info[1], &k)) {
+			return;
+		}
+
+		const uint32_t end = static_cast<uint32_t>(packed.size());
+		TraceSpan span(TRACE_BATCH, ANY_BLAKE2S, end);
+		selected.resize(k);
+		obj->selector->Select(packed.data(), &end, 1, k, selected.data());
+		info.GetReturnValue().Set(Nan::CopyBuffer(reinterpret_cast<const char*>(selected.data()), k * sizeof(uint32_t)).ToLocalChecked());
+	}
+
+	/**
+	 * selectMany(array, null, k, callback) or selectMany(buffer, ends, k,
+	 * callback): the k best node indexes for every object key, as one
+	 * Buffer of k native-endian u32 entries per key.  Runs on the thread pool.
+	 */
+	static NAN_METHOD(SelectMany) {
+		Rendezvous *obj = Nan::ObjectWrap::Unwrap<Rendezvous>(info.This());
+
+		if (info.Length() < 4 || !info[3]->IsFunction()) {
+			return Nan::ThrowError(v8::Exception::TypeError(Nan::New<v8::String>("Last argument must be a callback").ToLocalChecked()));
+		}
+		size_t k;
+		if (!KFromArgument(obj, info[2], &k)) {
+			return;
+		}
+
+		std::vector<uint8_t> packed;
+		std::vector<uint32_t> packed_ends;
+		if (info[0]->IsArray()) {
+			v8::Local<v8::Array> array = info[0].As<v8::Array>();
+			packed_ends.resize(array->Length());
+			for (uint32_t i = 0; i < array->Length(); i++) {
+				if (!PackValue(Nan::Get(array, i).ToLocalChecked(), &packed)) {
+					return Nan::ThrowError(v8::Exception::TypeError(Nan::New<v8::String>("Object keys must be strings or Buffers").ToLocalChecked()));
+				}
+				if (packed.size() > UINT32_MAX) {
+					return Nan::ThrowError(v8::Exception::RangeError(Nan::New<v8::String>("Object keys must add up to less than 4 GiB").ToLocalChecked()));
+				}
+				packed_ends[i] = static_cast<uint32_t>(packed.size());
+			}
+		} else if (node::Buffer::HasInstance(info[0]) && info[1]->IsUint32Array()) {
+			Nan::TypedArrayContents<uint32_t> ends(info[1]);
+			if (!KeyEndsValid(*ends, ends.length(), node::Buffer::Length(info[0]))) {
+				return Nan::ThrowError(v8::Exception::RangeError(Nan::New<v8::String>("Object key ends must be ascending and within the buffer").ToLocalChecked()));
+			}
+		} else {
+			return Nan::ThrowError(v8::Exception::TypeError(Nan::New<v8::String>("Expected an array of object keys, or a Buffer and a Uint32Array of key ends").ToLocalChecked()));
+		}
+
+		Nan::Callback *callback = new Nan::Callback(info[3].As<v8::Function>());
+		RendezvousWorker *worker = new RendezvousWorker(callback, obj->selector, k);
+		if (info[0]->IsArray()) {
+			worker->SetPacked(&packed, &packed_ends);
+		} else {
+			worker->SetBuffer(info[0].As<v8::Object>(), info[1]);
+		}
+		Nan::AsyncQueueWorker(worker);
+	}
+
+ private:
+	static bool KFromArgument(Rendezvous *obj, v8::Local<v8::Value> value, size_t *k) {
+		if (!value->IsUint32() || Nan::To<uint32_t>(value).FromJust() == 0 || Nan::To<uint32_t>(value).FromJust() > obj->selector->Nodes()) {
+			Nan::ThrowError(v8::Exception::RangeError(Nan::New<v8::String>("k must be between 1 and the number of nodes").ToLocalChecked()));
+			return false;
+		}
+		*k = Nan::To<uint32_t>(value).FromJust();
+		return true;
+	}
+};
+
+NAN_MODULE_INIT(InitRendezvous) {
+	Rendezvous::Init(target);
+}
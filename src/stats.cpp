@@ -0,0 +1,142 @@
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <mutex>
+#include <vector>
+
+#include "stats.h"
+
+static bool StatsEnabledFromEnvironment() {
+	const char *env = getenv("BLAKE2_STATS");
+	return !(env && strcmp(env, "0") == 0);
+}
+
+const bool stats_enabled = StatsEnabledFromEnvironment();
+thread_local ThreadStats *stats_this_thread = nullptr;
+
+namespace {
+
+struct Registry {
+	std::mutex mutex;
+	std::vector<ThreadStats*> live;
+	// Counters of threads that have exited, and the totals at the last reset
+	StatsSnapshot retired;
+	StatsSnapshot baseline;
+	std::atomic<int64_t> async_queued;
+	std::atomic<int64_t> async_max_queued;
+	std::atomic<uint64_t> async_jobs;
+	std::atomic<uint64_t> async_wait_ns;
+};
+
+Registry &TheRegistry() {
+	// Never destroyed: threads may still exit after static destructors ran
+	static Registry *registry = new Registry();
+	return *registry;
+}
+
+void AddThread(StatsSnapshot *sum, const ThreadStats &stats) {
+	for (int i = 0; i < STATS_ALGOS; i++) {
+		sum->bytes[i] += stats.bytes[i].load(std::memory_order_relaxed);
+		sum->digests[i] += stats.digests[i].load(std::memory_order_relaxed);
+	}
+	for (int i = 0; i < STATS_UPDATE_BUCKETS; i++) {
+		sum->updates[i] += stats.updates[i].load(std::memory_order_relaxed);
+	}
+	sum->copies += stats.copies.load(std::memory_order_relaxed);
+}
+
+// Totals since load; the registry lock must be held
+void Totals(Registry &registry, StatsSnapshot *out) {
+	*out = registry.retired;
+	for (const ThreadStats *stats : registry.live) {
+		AddThread(out, *stats);
+	}
+	out->async_jobs = registry.async_jobs.load();
+	out->async_wait_ns = registry.async_wait_ns.load();
+}
+
+/**
+ * Folds a thread's counters into the retired totals when the thread exits
+ */
+struct ThreadStatsOwner {
+	ThreadStats *stats = nullptr;
+
+	~ThreadStatsOwner() {
+		if (!stats) {
+			return;
+		}
+		Registry &registry = TheRegistry();
+		std::lock_guard<std::mutex> lock(registry.mutex);
+		AddThread(&registry.retired, *stats);
+		registry.live.erase(std::find(registry.live.begin(), registry.live.end(), stats));
+		delete stats;
+		stats_this_thread = nullptr;
+	}
+};
+
+thread_local ThreadStatsOwner owner;
+
+uint64_t NowNs() {
+	return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+		std::chrono::steady_clock::now().time_since_epoch()).count());
+}
+
+}  // namespace
+
+ThreadStats *StatsRegisterThread() {
+	ThreadStats *stats = new ThreadStats();
+	Registry &registry = TheRegistry();
+	{
+		std::lock_guard<std::mutex> lock(registry.mutex);
+		registry.live.push_back(stats);
+	}
+	owner.stats = stats;
+	stats_this_thread = stats;
+	return stats;
+}
+
+void StatsRead(StatsSnapshot *out) {
+	Registry &registry = TheRegistry();
+	std::lock_guard<std::mutex> lock(registry.mutex);
+	Totals(registry, out);
+	const StatsSnapshot &base = registry.baseline;
+	for (int i = 0; i < STATS_ALGOS; i++) {
+		out->bytes[i] -= base.bytes[i];
+		out->digests[i] -= base.digests[i];
+	}
+	for (int i = 0; i < STATS_UPDATE_BUCKETS; i++) {
+		out->updates[i] -= base.updates[i];
+	}
+	out->copies -= base.copies;
+	out->async_jobs -= base.async_jobs;
+	out->async_wait_ns -= base.async_wait_ns;
+	out->async_queued = static_cast<uint64_t>(std::max<int64_t>(0, registry.async_queued.load()));
+	out->async_max_queued = static_cast<uint64_t>(std::max<int64_t>(0, registry.async_max_queued.load()));
+}
+
+void StatsReset() {
+	// Other threads keep counting into their own sets, so rather than zero
+	// them, remember where they stood
+	Registry &registry = TheRegistry();
+	std::lock_guard<std::mutex> lock(registry.mutex);
+	Totals(registry, &registry.baseline);
+	registry.async_max_queued.store(registry.async_queued.load());
+}
+
+uint64_t StatsQueued() {
+	Registry &registry = TheRegistry();
+	const int64_t queued = registry.async_queued.fetch_add(1) + 1;
+	int64_t max = registry.async_max_queued.load();
+	while (queued > max && !registry.async_max_queued.compare_exchange_weak(max, queued)) {}
+	return std::max<uint64_t>(1, NowNs());
+}
+
+void StatsDequeued(uint64_t queued_at, bool started) {
+	Registry &registry = TheRegistry();
+	registry.async_queued.fetch_sub(1);
+	if (started) {
+		registry.async_jobs.fetch_add(1);
+		registry.async_wait_ns.fetch_add(NowNs() - queued_at);
+	}
+}
@@ -0,0 +1,118 @@
+#ifndef NODE_BLAKE2_STATS_H
+#define NODE_BLAKE2_STATS_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+/*
+ * Counters behind blake2.stats().  Every thread that hashes gets its own
+ * set, which only that thread writes, so counting is a plain add with no
+ * locked instruction; stats() sums the sets under a lock.  Collection is
+ * switched off for the life of the process by BLAKE2_STATS=0, leaving one
+ * predictable branch on the hot path.
+ */
+
+enum {
+	// Indexed by any_blake2_algo
+	STATS_ALGOS = 4,
+	// Update sizes: <64, <512, <4 KiB, <64 KiB, <1 MiB, larger
+	STATS_UPDATE_BUCKETS = 6
+};
+
+struct ThreadStats {
+	std::atomic<uint64_t> bytes[STATS_ALGOS];
+	std::atomic<uint64_t> digests[STATS_ALGOS];
+	std::atomic<uint64_t> updates[STATS_UPDATE_BUCKETS];
+	std::atomic<uint64_t> copies;
+};
+
+/**
+ * Everything stats() reports, since load or the last StatsReset().  The
+ * async fields count jobs queued on the libuv threadpool: how many are
+ * waiting now and at most, how many have started, and their total wait.
+ */
+struct StatsSnapshot {
+	uint64_t bytes[STATS_ALGOS];
+	uint64_t digests[STATS_ALGOS];
+	uint64_t updates[STATS_UPDATE_BUCKETS];
+	uint64_t copies;
+	uint64_t async_queued;
+	uint64_t async_max_queued;
+	uint64_t async_jobs;
+	uint64_t async_wait_ns;
+};
+
+extern const bool stats_enabled;
+extern thread_local ThreadStats *stats_this_thread;
+
+ThreadStats *StatsRegisterThread();
+
+inline ThreadStats &StatsForThread() {
+	ThreadStats *stats = stats_this_thread;
+	return stats ? *stats : *StatsRegisterThread();
+}
+
+inline void StatsAdd(std::atomic<uint64_t> &counter, uint64_t n) {
+	// Only the owning thread writes; readers just need untorn values
+	counter.store(counter.load(std::memory_order_relaxed) + n, std::memory_order_relaxed);
+}
+
+inline void StatsCountBytes(int algo, size_t length) {
+	if (stats_enabled) {
+		StatsAdd(StatsForThread().bytes[algo], length);
+	}
+}
+
+inline void StatsCountDigests(int algo, size_t count) {
+	if (stats_enabled) {
+		StatsAdd(StatsForThread().digests[algo], count);
+	}
+}
+
+inline void StatsCountUpdate(size_t length) {
+	if (stats_enabled) {
+		const int bucket = length < 64 ? 0 : length < 512 ? 1 : length < 4096 ? 2 :
+			length < 65536 ? 3 : length < 1048576 ? 4 : 5;
+		StatsAdd(StatsForThread().updates[bucket], 1);
+	}
+}
+
+inline void StatsCountCopy() {
+	if (stats_enabled) {
+		StatsAdd(StatsForThread().copies, 1);
+	}
+}
+
+void StatsRead(StatsSnapshot *out);
+void StatsReset();
+
+uint64_t StatsQueued();
+void StatsDequeued(uint64_t queued_at, bool started);
+
+/**
+ * Held by an async job from the moment it is queued; Started() at the top
+ * of Execute() records how long it waited for a thread.
+ */
+class StatsQueueTicket {
+ public:
+	StatsQueueTicket() : queued_at_(stats_enabled ? StatsQueued() : 0) {}
+
+	~StatsQueueTicket() {
+		if (queued_at_) {
+			StatsDequeued(queued_at_, false);
+		}
+	}
+
+	void Started() {
+		if (queued_at_) {
+			StatsDequeued(queued_at_, true);
+			queued_at_ = 0;
+		}
+	}
+
+ private:
+	uint64_t queued_at_;
+};
+
+#endif
@@ -0,0 +1,83 @@
+#include <algorithm>
+#include <cstdlib>
+#include <thread>
+
+#include "thread_pool.h"
+
+ThreadPool &ThreadPool::Shared() {
+	// Never destroyed: detached workers may still be waiting at exit
+	static ThreadPool *pool = [] {
+		unsigned threads = std::thread::hardware_concurrency();
+		const char *env = getenv("BLAKE2_THREADS");
+		if (env && atoi(env) > 0) {
+			threads = static_cast<unsigned>(atoi(env));
+		}
+		return new ThreadPool(threads > 1 ? threads - 1 : 0);
+	}();
+	return *pool;
+}
+
+ThreadPool::ThreadPool(unsigned threads) : threads_(threads) {
+	for (unsigned i = 0; i < threads; i++) {
+		std::thread(&ThreadPool::Work, this).detach();
+	}
+}
+
+void ThreadPool::ParallelFor(size_t count, const std::function<void(size_t)> &fn) {
+	if (threads_ == 0 || count <= 1) {
+		for (size_t i = 0; i < count; i++) {
+			fn(i);
+		}
+		return;
+	}
+
+	Job job;
+	job.fn = &fn;
+	job.count = count;
+	job.next = 0;
+	job.refs = 0;
+	{
+		std::lock_guard<std::mutex> lock(mutex_);
+		queue_.push_back(&job);
+	}
+	work_cv_.notify_all();
+
+	Run(&job);
+
+	// Every index has been handed out; wait for the workers still running one
+	std::unique_lock<std::mutex> lock(mutex_);
+	Dequeue(&job);
+	done_cv_.wait(lock, [&job] { return job.refs == 0; });
+}
+
+void ThreadPool::Run(Job *job) {
+	size_t i;
+	while ((i = job->next.fetch_add(1)) < job->count) {
+		(*job->fn)(i);
+	}
+}
+
+void ThreadPool::Dequeue(Job *job) {
+	std::deque<Job*>::iterator it = std::find(queue_.begin(), queue_.end(), job);
+	if (it != queue_.end()) {
+		queue_.erase(it);
+	}
+}
+
+void ThreadPool::Work() {
+	std::unique_lock<std::mutex> lock(mutex_);
+	for (;;) {
+		work_cv_.wait(lock, [this] { return !queue_.empty(); });
+		Job *job = queue_.front();
+		job->refs++;
+		lock.unlock();
+
+		Run(job);
+
+		lock.lock();
+		Dequeue(job);
+		if (--job->refs == 0) {
+			done_cv_.notify_all();
+		}
+	}
+}
@@ -0,0 +1,53 @@
+#ifndef NODE_BLAKE2_THREAD_POOL_H
+#define NODE_BLAKE2_THREAD_POOL_H
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <mutex>
+
+/**
+ * Process-wide pool of threads used to spread one native job (the pieces of
+ * a buffer, the files of a tree) over all cores.  Jobs are submitted from
+ * libuv threadpool workers and never touch V8, so every isolate that loads
+ * the addon shares the same pool.  The size defaults to the number of CPUs
+ * and can be set with the BLAKE2_THREADS environment variable.
+ */
+class ThreadPool {
+ public:
+	static ThreadPool &Shared();
+
+	/** Number of threads that run a job, counting the submitting thread. */
+	unsigned Concurrency() const {
+		return static_cast<unsigned>(threads_) + 1;
+	}
+
+	/**
+	 * Calls fn(i) once for every i in [0, count), on the pool and on the
+	 * calling thread, and returns when all calls have finished.
+	 */
+	void ParallelFor(size_t count, const std::function<void(size_t)> &fn);
+
+ private:
+	struct Job {
+		const std::function<void(size_t)> *fn;
+		size_t count;
+		std::atomic<size_t> next;
+		unsigned refs;
+	};
+
+	explicit ThreadPool(unsigned threads);
+	void Work();
+	void Run(Job *job);
+	void Dequeue(Job *job);
+
+	size_t threads_;
+	std::mutex mutex_;
+	std::condition_variable work_cv_;
+	std::condition_variable done_cv_;
+	std::deque<Job*> queue_;
+};
+
+#endif
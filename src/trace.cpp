@@ -0,0 +1,108 @@
+#include <node.h>
+#include <v8.h>
+
+#include <algorithm>
+#include <chrono>
+
+#ifdef BLAKE2_USDT
+#define _SDT_HAS_SEMAPHORES 1
+#include <sys/sdt.h>
+#endif
+
+#include "trace.h"
+
+// trace_event_common.h phases and argument types
+static const char TRACE_PHASE_BEGIN = 'B';
+static const char TRACE_PHASE_END = 'E';
+static const uint8_t TRACE_VALUE_TYPE_UINT = 2;
+static const uint8_t TRACE_VALUE_TYPE_STRING = 6;
+
+static const char *const TRACE_NAMES[TRACE_KINDS] = {
+	"blake2.update",
+	"blake2.final",
+	"blake2.batch",
+	"blake2.file",
+	"blake2.async"
+};
+
+static const char *const ALGORITHM_NAMES[] = {
+	"blake2b",
+	"blake2bp",
+	"blake2s",
+	"blake2sp"
+};
+
+static const uint8_t trace_disabled = 0;
+const uint8_t *trace_category_enabled = &trace_disabled;
+
+#ifdef BLAKE2_USDT
+volatile unsigned short blake2_update_semaphore __attribute__((section(".probes")));
+volatile unsigned short blake2_final_semaphore __attribute__((section(".probes")));
+volatile unsigned short blake2_batch_semaphore __attribute__((section(".probes")));
+volatile unsigned short blake2_file_semaphore __attribute__((section(".probes")));
+volatile unsigned short blake2_async_semaphore __attribute__((section(".probes")));
+#endif
+
+void TraceInit() {
+	// Every worker thread loads the addon again; the controller is the
+	// process's, so the flag found first stays valid
+	if (trace_category_enabled != &trace_disabled) {
+		return;
+	}
+	v8::TracingController *controller = node::GetTracingController();
+	if (controller) {
+		trace_category_enabled = controller->GetCategoryGroupEnabled("node.blake2");
+	}
+}
+
+static uint64_t NowNs() {
+	return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+		std::chrono::steady_clock::now().time_since_epoch()).count());
+}
+
+void TraceSpan::Begin() {
+	start_ = std::max<uint64_t>(1, NowNs());
+	// Remember whether the begin event went out, so that no end event is
+	// emitted without one if tracing is switched on meanwhile
+	events_ = *trace_category_enabled != 0;
+	if (events_) {
+		const char *names[] = { "algorithm" };
+		const uint8_t types[] = { TRACE_VALUE_TYPE_STRING };
+		const uint64_t values[] = { reinterpret_cast<uint64_t>(ALGORITHM_NAMES[algo_]) };
+		node::GetTracingController()->AddTraceEvent(TRACE_PHASE_BEGIN, trace_category_enabled, TRACE_NAMES[kind_],
+			nullptr, 0, 0, 1, names, types, values, nullptr, 0);
+	}
+}
+
+void TraceSpan::End() {
+	const uint64_t ns = NowNs() - start_;
+	if (events_) {
+		const char *names[] = { "bytes" };
+		const uint8_t types[] = { TRACE_VALUE_TYPE_UINT };
+		const uint64_t values[] = { bytes_ };
+		node::GetTracingController()->AddTraceEvent(TRACE_PHASE_END, trace_category_enabled, TRACE_NAMES[kind_],
+			nullptr, 0, 0, 1, names, types, values, nullptr, 0);
+	}
+#ifdef BLAKE2_USDT
+	const char *algorithm = ALGORITHM_NAMES[algo_];
+	switch (kind_) {
+	case TRACE_UPDATE:
+		STAP_PROBE3(blake2, update, algorithm, bytes_, ns);
+		break;
+	case TRACE_FINAL:
+		STAP_PROBE3(blake2, final, algorithm, bytes_, ns);
+		break;
+	case TRACE_BATCH:
+		STAP_PROBE3(blake2, batch, algorithm, bytes_, ns);
+		break;
+	case TRACE_FILE:
+		STAP_PROBE3(blake2, file, algorithm, bytes_, ns);
+		break;
+	default:
+		STAP_PROBE3(blake2, async, algorithm, bytes_, ns);
+		break;
+	}
+#else
+	(void) ns;
+#endif
+}
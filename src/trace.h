@@ -0,0 +1,107 @@
+#ifndef NODE_BLAKE2_TRACE_H
+#define NODE_BLAKE2_TRACE_H
+
+#include <cstdint>
+
+/*
+ * Trace points around hashing work.  Each is emitted as a pair of Node
+ * trace_events in the node.blake2 category (node --trace-event-categories
+ * node.blake2, or the trace_events module) and, on Linux builds with
+ * <sys/sdt.h>, fires a USDT probe in the blake2 provider with the
+ * algorithm, the byte count and the duration in nanoseconds:
+ *
+ *   bpftrace -e 'usdt:./build/Release/blake2.node:blake2:update { @[str(arg0)] = hist(arg2); }'
+ *
+ * With neither enabled a trace point costs two loads and a branch.
+ */
+
+#if defined(__linux__) && defined(__has_include)
+#if __has_include(<sys/sdt.h>)
+#define BLAKE2_USDT 1
+#endif
+#endif
+
+enum TraceKind {
+	// Synchronous update and digest calls
+	TRACE_UPDATE,
+	TRACE_FINAL,
+	// Synchronous calls hashing many values at once
+	TRACE_BATCH,
+	// Jobs hashing files
+	TRACE_FILE,
+	// Jobs hashing buffers off the main thread
+	TRACE_ASYNC,
+	TRACE_KINDS
+};
+
+// Points at the node.blake2 category flag once TraceInit() has run
+extern const uint8_t *trace_category_enabled;
+
+#ifdef BLAKE2_USDT
+// Set by the kernel while a tracer is attached to the probe of each kind
+extern volatile unsigned short blake2_update_semaphore;
+extern volatile unsigned short blake2_final_semaphore;
+extern volatile unsigned short blake2_batch_semaphore;
+extern volatile unsigned short blake2_file_semaphore;
+extern volatile unsigned short blake2_async_semaphore;
+#endif
+
+inline bool TraceUsdtEnabled(TraceKind kind) {
+#ifdef BLAKE2_USDT
+	switch (kind) {
+	case TRACE_UPDATE:
+		return blake2_update_semaphore != 0;
+	case TRACE_FINAL:
+		return blake2_final_semaphore != 0;
+	case TRACE_BATCH:
+		return blake2_batch_semaphore != 0;
+	case TRACE_FILE:
+		return blake2_file_semaphore != 0;
+	default:
+		return blake2_async_semaphore != 0;
+	}
+#else
+	return false;
+#endif
+}
+
+/**
+ * Looks up the trace category; called when the addon is loaded.
+ */
+void TraceInit();
+
+/**
+ * Traces the work done during its lifetime.  `algo` is an any_blake2_algo;
+ * the byte count can be given up front or filled in as it becomes known.
+ */
+class TraceSpan {
+ public:
+	TraceSpan(TraceKind kind, int algo, uint64_t bytes = 0)
+		: kind_(kind), algo_(algo), bytes_(bytes), start_(0), events_(false) {
+		if (*trace_category_enabled || TraceUsdtEnabled(kind)) {
+			Begin();
+		}
+	}
+
+	~TraceSpan() {
+		if (start_) {
+			End();
+		}
+	}
+
+	void AddBytes(uint64_t bytes) {
+		bytes_ += bytes;
+	}
+
+ private:
+	void Begin();
+	void End();
+
+	TraceKind kind_;
+	int algo_;
+	uint64_t bytes_;
+	uint64_t start_;
+	bool events_;
+};
+
+#endif
@@ -0,0 +1,497 @@
+#include <node.h>
+#include <node_buffer.h>
+#include <v8.h>
+#include <nan.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <filesystem>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <system_error>
+#include <vector>
+
+#include "any_blake2.h"
+#include "blake2_addon.h"
+#include "byte_order.h"
+#include "digest_cache.h"
+#include "file_io.h"
+#include "stats.h"
+#include "thread_pool.h"
+#include "trace.h"
+
+/*
+ * Directory tree hashing.  The tree is walked one level at a time with every
+ * directory of a level listed on the thread pool, then every file is hashed
+ * on the pool, and finally the sorted entries are folded into a root digest:
+ *
+ *   root = H("blake2-tree-v1\0" || for each entry in byte order of path:
+ *            path || "\0" || mode (u32 LE) || size (u64 LE) || digest)
+ *
+ * using the same algorithm, key and digest length as the file digests.
+ * Regular files are hashed by content, symbolic links by their target.
+ * Directories only contribute through the files below them.
+ *
+ * With a digest cache, a regular file whose (dev, inode, size, mtime, ctime)
+ * match a cached record under the same parameters is not read at all.
+ */
+
+namespace fs = std::filesystem;
+
+static const char TREE_FORMAT_TAG[] = "blake2-tree-v1";
+
+static const size_t TREE_READ_SIZE = 1024 * 1024;
+
+static const uint32_t TREE_MODE_FILE = 0100000;
+static const uint32_t TREE_MODE_SYMLINK = 0120000;
+
+static std::string PathToUtf8(const fs::path &path) {
+#ifdef _WIN32
+	auto utf8 = path.u8string();
+	return std::string(utf8.begin(), utf8.end());
+#else
+	return path.string();
+#endif
+}
+
+static fs::path Utf8ToPath(const std::string &utf8) {
+#ifdef _WIN32
+	return fs::u8path(utf8);
+#else
+	return fs::path(utf8);
+#endif
+}
+
+/**
+ * Matches a '/'-separated relative path against a glob: '*' and '?' stay
+ * within one path segment, '**' crosses segments ('**' followed by '/' also
+ * matches no segment at all), and [...] is a character class.
+ */
+static bool GlobMatch(const char *p, const char *s) {
+	while (*p) {
+		if (p[0] == '*' && p[1] == '*') {
+			const char *rest = p + 2;
+			if (*rest == '/' && GlobMatch(rest + 1, s)) {
+				return true;
+			}
+			for (const char *t = s;; t++) {
+				if (GlobMatch(rest, t)) {
+					return true;
+				}
+				if (!*t) {
+					return false;
+				}
+			}
+		} else if (*p == '*') {
+			for (const char *t = s;; t++) {
+				if (GlobMatch(p + 1, t)) {
+					return true;
+				}
+				if (!*t || *t == '/') {
+					return false;
+				}
+			}
+		} else if (*p == '?') {
+			if (!*s || *s == '/') {
+				return false;
+			}
+			p++;
+			s++;
+		} else if (*p == '[') {
+			const char *q = p + 1;
+			bool negate = *q == '!' || *q == '^';
+			if (negate) {
+				q++;
+			}
+			bool matched = false;
+			bool first = true;
+			for (; *q && (first || *q != ']'); q++, first = false) {
+				if (q[1] == '-' && q[2] && q[2] != ']') {
+					matched |= *s >= q[0] && *s <= q[2];
+					q += 2;
+				} else {
+					matched |= *s == *q;
+				}
+			}
+			if (!*q) {
+				// Unterminated class: treat '[' literally
+				if (*s != '[') {
+					return false;
+				}
+				p++;
+				s++;
+				continue;
+			}
+			if (!*s || *s == '/' || matched == negate) {
+				return false;
+			}
+			p = q + 1;
+			s++;
+		} else {
+			if (*p != *s) {
+				return false;
+			}
+			p++;
+			s++;
+		}
+	}
+	return !*s;
+}
+
+/**
+ * A pattern without a '/' is matched against the last path segment,
+ * anything else against the whole relative path.
+ */
+static bool GlobsMatch(const std::vector<std::string> &globs, const std::string &path) {
+	const size_t slash = path.rfind('/');
+	const char *name = path.c_str() + (slash == std::string::npos ? 0 : slash + 1);
+	for (const std::string &glob : globs) {
+		if (GlobMatch(glob.c_str(), glob.find('/') == std::string::npos ? name : path.c_str())) {
+			return true;
+		}
+	}
+	return false;
+}
+
+struct TreeEntry {
+	std::string path;
+	uint32_t mode;
+	uint64_t size;
+	uint8_t digest[BLAKE2B_OUTBYTES];
+	bool symlink;
+};
+
+class TreeHasher {
+ public:
+	TreeHasher(const any_blake2 &initial, const std::vector<std::string> &include, const std::vector<std::string> &exclude,
+			const std::shared_ptr<DigestCache> &cache)
+		: initial_(initial), include_(include), exclude_(exclude), cache_(cache),
+		  params_(cache ? DigestCache::Params(initial) : 0), failed_(false), cached_(0) {}
+
+	/**
+	 * Walks and hashes the tree at `root`.  Returns false and sets Error()
+	 * if any directory or file could not be read.
+	 */
+	bool Hash(const std::string &root) {
+		root_ = Utf8ToPath(root);
+		std::error_code ec;
+		if (!fs::is_directory(root_, ec)) {
+			error_ = root + ": " + (ec ? ec.message() : "not a directory");
+			return false;
+		}
+
+		if (cache_ && !(snapshot_ = cache_->Snapshot(&error_))) {
+			return false;
+		}
+
+		Walk();
+		if (failed_) {
+			return false;
+		}
+
+		std::sort(entries_.begin(), entries_.end(), [](const TreeEntry &a, const TreeEntry &b) {
+			return a.path < b.path;
+		});
+		ThreadPool::Shared().ParallelFor(entries_.size(), [this](size_t i) {
+			if (!failed_.load(std::memory_order_relaxed)) {
+				HashEntry(&entries_[i]);
+			}
+		});
+		if (failed_) {
+			return false;
+		}
+
+		Combine();
+		return !cache_ || cache_->Append(fresh_, &error_);
+	}
+
+	const std::vector<TreeEntry> &Entries() const {
+		return entries_;
+	}
+
+	const uint8_t *Root() const {
+		return root_digest_;
+	}
+
+	const std::string &Error() const {
+		return error_;
+	}
+
+	/** Number of files whose digest came from the cache. */
+	uint64_t Cached() const {
+		return cached_;
+	}
+
+ private:
+	void Fail(const std::string &message) {
+		std::lock_guard<std::mutex> lock(mutex_);
+		if (!failed_.exchange(true)) {
+			error_ = message;
+		}
+	}
+
+	void Walk() {
+		std::vector<std::string> level(1, std::string());
+		while (!level.empty() && !failed_) {
+			std::vector<std::string> next;
+			ThreadPool::Shared().ParallelFor(level.size(), [&](size_t i) {
+				std::vector<std::string> subdirs;
+				std::vector<TreeEntry> files;
+				List(level[i], &subdirs, &files);
+
+				std::lock_guard<std::mutex> lock(mutex_);
+				next.insert(next.end(), subdirs.begin(), subdirs.end());
+				for (TreeEntry &file : files) {
+					entries_.push_back(std::move(file));
+				}
+			});
+			level.swap(next);
+		}
+	}
+
+	void List(const std::string &relative, std::vector<std::string> *subdirs, std::vector<TreeEntry> *files) {
+		std::error_code ec;
+		fs::path dir = relative.empty() ? root_ : root_ / Utf8ToPath(relative);
+		fs::directory_iterator it(dir, ec);
+		for (; !ec && it != fs::directory_iterator(); it.increment(ec)) {
+			const fs::directory_entry &entry = *it;
+			std::string path = PathToUtf8(entry.path().filename());
+			if (!relative.empty()) {
+				path = relative + "/" + path;
+			}
+			if (!exclude_.empty() && GlobsMatch(exclude_, path)) {
+				continue;
+			}
+
+			fs::file_status status = entry.symlink_status(ec);
+			if (ec) {
+				break;
+			}
+			if (fs::is_directory(status)) {
+				subdirs->push_back(path);
+				continue;
+			}
+			if (!fs::is_regular_file(status) && !fs::is_symlink(status)) {
+				continue;
+			}
+			if (!include_.empty() && !GlobsMatch(include_, path)) {
+				continue;
+			}
+
+			TreeEntry file;
+			file.path = path;
+			file.symlink = fs::is_symlink(status);
+			file.mode = (file.symlink ? TREE_MODE_SYMLINK : TREE_MODE_FILE) |
+				(static_cast<uint32_t>(status.permissions()) & 07777);
+			file.size = 0;
+			files->push_back(std::move(file));
+		}
+		if (ec) {
+			Fail(PathToUtf8(dir) + ": " + ec.message());
+		}
+	}
+
+	void HashEntry(TreeEntry *entry) {
+		static thread_local std::vector<uint8_t> scratch;
+
+		any_blake2 h;
+		any_blake2_copy(&h, &initial_);
+		fs::path path = root_ / Utf8ToPath(entry->path);
+
+		if (entry->symlink) {
+			std::error_code ec;
+			std::string target = PathToUtf8(fs::read_symlink(path, ec));
+			if (ec) {
+				return Fail(entry->path + ": " + ec.message());
+			}
+			entry->size = target.size();
+			any_blake2_update(&h, target.data(), target.size());
+		} else {
+			DigestCacheKey key;
+			const bool keyed = cache_ && DigestCache::Stat(PathToUtf8(path), &key);
+			if (keyed) {
+				key.params = params_;
+				if (const uint8_t *digest = snapshot_->Find(key)) {
+					memcpy(entry->digest, digest, h.outbytes);
+					entry->size = key.size;
+					cached_++;
+					return;
+				}
+			}
+
+			ReadOnlyFile file;
+			if (!file.Open(PathToUtf8(path))) {
+				return Fail(entry->path + ": " + ReadOnlyFile::LastError());
+			}
+			scratch.resize(TREE_READ_SIZE);
+			uint64_t offset = 0;
+			int64_t n;
+			while ((n = file.ReadAt(scratch.data(), scratch.size(), offset)) > 0) {
+				any_blake2_update(&h, scratch.data(), static_cast<size_t>(n));
+				offset += n;
+			}
+			if (n < 0) {
+				return Fail(entry->path + ": " + ReadOnlyFile::LastError());
+			}
+			entry->size = offset;
+			any_blake2_final(&h, entry->digest);
+
+			// Only remember digests of files that did not change while read
+			DigestCacheKey after;
+			if (keyed && key.size == offset && !snapshot_->Racy(key) && DigestCache::Stat(PathToUtf8(path), &after)) {
+				after.params = params_;
+				if (after == key) {
+					DigestCacheRecord record = {key, {0}};
+					memcpy(record.digest, entry->digest, h.outbytes);
+					std::lock_guard<std::mutex> lock(mutex_);
+					fresh_.push_back(record);
+				}
+			}
+			return;
+		}
+		any_blake2_final(&h, entry->digest);
+	}
+
+	void Combine() {
+		any_blake2 h;
+		any_blake2_copy(&h, &initial_);
+		any_blake2_update(&h, TREE_FORMAT_TAG, sizeof(TREE_FORMAT_TAG));
+		for (const TreeEntry &entry : entries_) {
+			uint8_t fields[12];
+			store_le32(fields, entry.mode);
+			store_le64(fields + 4, entry.size);
+			any_blake2_update(&h, entry.path.c_str(), entry.path.size() + 1);
+			any_blake2_update(&h, fields, sizeof(fields));
+			any_blake2_update(&h, entry.digest, h.outbytes);
+		}
+		any_blake2_final(&h, root_digest_);
+	}
+
+	any_blake2 initial_;
+	std::vector<std::string> include_;
+	std::vector<std::string> exclude_;
+	fs::path root_;
+	std::shared_ptr<DigestCache> cache_;
+	std::shared_ptr<const DigestCacheSnapshot> snapshot_;
+	uint64_t params_;
+
+	std::mutex mutex_;
+	std::atomic<bool> failed_;
+	std::string error_;
+	std::vector<TreeEntry> entries_;
+	std::vector<DigestCacheRecord> fresh_;
+	std::atomic<uint64_t> cached_;
+	uint8_t root_digest_[BLAKE2B_OUTBYTES];
+};
+
+class TreeWorker: public Nan::AsyncWorker {
+ public:
+	TreeWorker(Nan::Callback *callback, const std::string &root, const any_blake2 &initial,
+			const std::vector<std::string> &include, const std::vector<std::string> &exclude, bool with_files,
+			const std::shared_ptr<DigestCache> &cache)
+		: Nan::AsyncWorker(callback, "blake2:hashTree"), root_(root), hasher_(initial, include, exclude, cache),
+		  algo_(initial.algo), outbytes_(initial.outbytes), with_files_(with_files), with_cache_(cache != nullptr) {}
+
+	void Execute() override {
+		ticket_.Started();
+		TraceSpan span(TRACE_FILE, algo_);
+		if (!hasher_.Hash(root_)) {
+			return SetErrorMessage(hasher_.Error().c_str());
+		}
+		for (const TreeEntry &entry : hasher_.Entries()) {
+			span.AddBytes(entry.size);
+		}
+	}
+
+	void HandleOKCallback() override {
+		Nan::HandleScope scope;
+		v8::Local<v8::Value> argv[] = {
+			Nan::Null(),
+			Nan::CopyBuffer(reinterpret_cast<const char*>(hasher_.Root()), outbytes_).ToLocalChecked(),
+			Nan::Undefined(),
+			Nan::Undefined(),
+			Nan::Undefined()
+		};
+
+		if (with_files_) {
+			// paths[i] and one (mode u32, size u64, digest) record per file
+			const std::vector<TreeEntry> &entries = hasher_.Entries();
+			const size_t record_length = 12 + outbytes_;
+			v8::Local<v8::Array> paths = Nan::New<v8::Array>(static_cast<int>(entries.size()));
+			v8::Local<v8::Object> records = Nan::NewBuffer(static_cast<uint32_t>(entries.size() * record_length)).ToLocalChecked();
+			uint8_t *record = reinterpret_cast<uint8_t*>(node::Buffer::Data(records));
+			for (size_t i = 0; i < entries.size(); i++, record += record_length) {
+				Nan::Set(paths, static_cast<uint32_t>(i), Nan::New(entries[i].path).ToLocalChecked());
+				store_le32(record, entries[i].mode);
+				store_le64(record + 4, entries[i].size);
+				memcpy(record + 12, entries[i].digest, outbytes_);
+			}
+			argv[2] = paths;
+			argv[3] = records;
+		}
+		if (with_cache_) {
+			argv[4] = Nan::New<v8::Number>(static_cast<double>(hasher_.Cached()));
+		}
+		callback->Call(5, argv, async_resource);
+	}
+
+ private:
+	StatsQueueTicket ticket_;
+	std::string root_;
+	TreeHasher hasher_;
+	any_blake2_algo algo_;
+	size_t outbytes_;
+	bool with_files_;
+	bool with_cache_;
+};
+
+static bool StringsFromArray(v8::Local<v8::Value> value, std::vector<std::string> *strings) {
+	if (value->IsUndefined() || value->IsNull()) {
+		return true;
+	}
+	if (!value->IsArray()) {
+		return false;
+	}
+	v8::Local<v8::Array> array = value.As<v8::Array>();
+	for (uint32_t i = 0; i < array->Length(); i++) {
+		v8::Local<v8::Value> item = Nan::Get(array, i).ToLocalChecked();
+		if (!item->IsString()) {
+			return false;
+		}
+		strings->push_back(*Nan::Utf8String(item));
+	}
+	return true;
+}
+
+// hashTree(root, algorithm, key, digestLength, include, exclude, withFiles, cache, callback)
+static NAN_METHOD(HashTree) {
+	if (info.Length() < 9 || !info[0]->IsString() || !info[8]->IsFunction()) {
+		return Nan::ThrowError(v8::Exception::TypeError(Nan::New<v8::String>("Expected a directory and a callback").ToLocalChecked()));
+	}
+
+	any_blake2 initial;
+	if (!HashFromArguments(info, 1, &initial)) {
+		return;
+	}
+
+	std::vector<std::string> include;
+	std::vector<std::string> exclude;
+	if (!StringsFromArray(info[4], &include) || !StringsFromArray(info[5], &exclude)) {
+		return Nan::ThrowError(v8::Exception::TypeError(Nan::New<v8::String>("include and exclude must be arrays of glob strings").ToLocalChecked()));
+	}
+
+	std::shared_ptr<DigestCache> cache;
+	if (!info[7]->IsNull() && !info[7]->IsUndefined() && !(cache = DigestCacheFromValue(info[7]))) {
+		return Nan::ThrowError(v8::Exception::TypeError(Nan::New<v8::String>("cache must be an open DigestCache").ToLocalChecked()));
+	}
+
+	Nan::Callback *callback = new Nan::Callback(info[8].As<v8::Function>());
+	Nan::AsyncQueueWorker(new TreeWorker(callback, *Nan::Utf8String(info[0]), initial, include, exclude, info[6]->IsTrue(), cache));
+}
+
+NAN_MODULE_INIT(InitTree) {
+	Nan::SetMethod(target, "hashTree", HashTree);
+}
@@ -0,0 +1,86 @@
+#include <cmath>
+
+#include <nan.h>
+
+#include "blake2_addon.h"
+#include "tuning.h"
+
+static const uint64_t TUNING_DEFAULTS[TUNING_PARAMS] = {
+	512,
+	16 * 1024,
+	256 * 1024,
+	1024 * 1024,
+	4096
+};
+
+// Zero turns coalescing, the multi-buffer kernel or the single-threaded path
+// off; a tile or a task needs some work in it
+static const uint64_t TUNING_MINIMUMS[TUNING_PARAMS] = {
+	0,
+	64,
+	0,
+	0,
+	1
+};
+
+// No threshold is useful beyond this, and it keeps values exact in a double
+static const uint64_t TUNING_MAX_VALUE = uint64_t(1) << 48;
+
+std::atomic<uint64_t> tuning_values[TUNING_PARAMS] = {
+	{TUNING_DEFAULTS[TUNING_COALESCE_BELOW]},
+	{TUNING_DEFAULTS[TUNING_MULTI_HASH_TILE]},
+	{TUNING_DEFAULTS[TUNING_PIECES_LANES_MAX_SIZE]},
+	{TUNING_DEFAULTS[TUNING_PIECES_PARALLEL_MIN_BYTES]},
+	{TUNING_DEFAULTS[TUNING_RENDEZVOUS_TASK_KEYS]}
+};
+
+static v8::Local<v8::Array> ValuesToArray(const uint64_t *values) {
+	v8::Local<v8::Array> array = Nan::New<v8::Array>(TUNING_PARAMS);
+	for (int i = 0; i < TUNING_PARAMS; i++) {
+		Nan::Set(array, static_cast<uint32_t>(i), Nan::New<v8::Number>(static_cast<double>(values[i])));
+	}
+	return array;
+}
+
+/**
+ * getTuning(): [current, defaults], each with one value per TuningParam
+ */
+static NAN_METHOD(GetTuning) {
+	uint64_t current[TUNING_PARAMS];
+	for (int i = 0; i < TUNING_PARAMS; i++) {
+		current[i] = Tuned(static_cast<TuningParam>(i));
+	}
+	v8::Local<v8::Array> result = Nan::New<v8::Array>(2);
+	Nan::Set(result, 0, ValuesToArray(current));
+	Nan::Set(result, 1, ValuesToArray(TUNING_DEFAULTS));
+	info.GetReturnValue().Set(result);
+}
+
+/**
+ * setTuning(values): installs one value per TuningParam; all of them are
+ * checked before any is changed
+ */
+static NAN_METHOD(SetTuning) {
+	if (info.Length() < 1 || !info[0]->IsArray() || v8::Local<v8::Array>::Cast(info[0])->Length() != TUNING_PARAMS) {
+		return Nan::ThrowError(v8::Exception::TypeError(Nan::New<v8::String>("Bad argument; need an array of tuning values").ToLocalChecked()));
+	}
+	v8::Local<v8::Array> array = v8::Local<v8::Array>::Cast(info[0]);
+	uint64_t values[TUNING_PARAMS];
+	for (int i = 0; i < TUNING_PARAMS; i++) {
+		v8::Local<v8::Value> value = Nan::Get(array, static_cast<uint32_t>(i)).ToLocalChecked();
+		const double number = value->IsNumber() ? Nan::To<double>(value).FromJust() : NAN;
+		if (!(number >= static_cast<double>(TUNING_MINIMUMS[i]) && number <= static_cast<double>(TUNING_MAX_VALUE)) ||
+				std::floor(number) != number) {
+			return Nan::ThrowError(v8::Exception::RangeError(Nan::New<v8::String>("Tuning value out of range").ToLocalChecked()));
+		}
+		values[i] = static_cast<uint64_t>(number);
+	}
+	for (int i = 0; i < TUNING_PARAMS; i++) {
+		tuning_values[i].store(values[i], std::memory_order_relaxed);
+	}
+}
+
+NAN_MODULE_INIT(InitTuning) {
+	Nan::SetMethod(target, "getTuning", GetTuning);
+	Nan::SetMethod(target, "setTuning", SetTuning);
+}
@@ -0,0 +1,35 @@
+#ifndef NODE_BLAKE2_TUNING_H
+#define NODE_BLAKE2_TUNING_H
+
+#include <atomic>
+#include <cstdint>
+
+/*
+ * The sizes at which the addon switches strategy.  They start out as
+ * defaults that suit most machines; blake2.calibrate() measures better ones
+ * and installs them with setTuning().  The profile is shared by every thread
+ * and isolate in the process, and a job reads each value once when it
+ * starts, so a profile installed meanwhile only affects later jobs.
+ */
+
+enum TuningParam {
+	// updateMany copies chunks shorter than this into one staging buffer
+	TUNING_COALESCE_BELOW,
+	// Bytes every state of a multi-hash absorbs before the next one
+	TUNING_MULTI_HASH_TILE,
+	// Largest piece hashed with the multi-buffer kernel
+	TUNING_PIECES_LANES_MAX_SIZE,
+	// Pieces inputs smaller than this are hashed on the calling thread alone
+	TUNING_PIECES_PARALLEL_MIN_BYTES,
+	// Object keys per thread pool task in a rendezvous batch
+	TUNING_RENDEZVOUS_TASK_KEYS,
+	TUNING_PARAMS
+};
+
+extern std::atomic<uint64_t> tuning_values[TUNING_PARAMS];
+
+inline uint64_t Tuned(TuningParam param) {
+	return tuning_values[param].load(std::memory_order_relaxed);
+}
+
+#endif
@@ -0,0 +1,66 @@
+"use strict";
+
+const blake2 = require('../index');
+const assert = require('assert');
+
+describe('HashArena', function() {
+	it('hashes like createHash for every algorithm, key and digest length', function() {
+		const arena = blake2.createHashArena();
+		const data = Buffer.from('The quick brown fox jumps over the lazy dog');
+		for (const algo of ['blake2b', 'blake2bp', 'blake2s', 'blake2sp']) {
+			for (const options of [{}, {digestLength: 16}, {key: Buffer.alloc(16, 7)}]) {
+				const expected = options.key ?
+					blake2.createKeyedHash(algo, options.key).update(data).digest('hex') :
+					blake2.createHash(algo, options).update(data).digest('hex');
+				const handle = arena.create(algo, options);
+				arena.update(handle, data.subarray(0, 10)).update(handle, data.subarray(10));
+				assert.equal(arena.digest(handle, 'hex'), expected);
+				arena.free(handle);
+			}
+		}
+		assert.equal(arena.size, 0);
+	});
+
+	it('keeps many interleaved hashes apart and reuses freed handles', function() {
+		const arena = blake2.createHashArena();
+		const handles = [];
+		for (let i = 0; i < 5000; i++) {
+			handles.push(arena.create(i % 2 ? 'blake2s' : 'blake2b'));
+		}
+		assert.equal(arena.size, 5000);
+		for (let round = 0; round < 3; round++) {
+			handles.forEach((handle, i) => arena.update(handle, Buffer.from([i & 0xff, round])));
+		}
+		handles.forEach(function(handle, i) {
+			const expected = blake2.createHash(i % 2 ? 'blake2s' : 'blake2b')
+				.update(Buffer.from([i & 0xff, 0, i & 0xff, 1, i & 0xff, 2])).digest();
+			assert.deepEqual(arena.digest(handle), expected);
+		});
+		arena.free(handles[123]);
+		assert.equal(arena.create('blake2s'), handles[123]);
+	});
+
+	it('copies hashes', function() {
+		const arena = blake2.createHashArena();
+		const handle = arena.create('blake2sp');
+		arena.update(handle, Buffer.from('abc'));
+		const copy = arena.copy(handle);
+		arena.update(copy, Buffer.from('def'));
+		assert.deepEqual(arena.digest(handle), blake2.createHash('blake2sp').update(Buffer.from('abc')).digest());
+		assert.deepEqual(arena.digest(copy), blake2.createHash('blake2sp').update(Buffer.from('abcdef')).digest());
+	});
+
+	it('rejects freed, digested and unknown handles', function() {
+		const arena = blake2.createHashArena();
+		const handle = arena.create('blake2b');
+		arena.digest(handle);
+		assert.throws(() => arena.update(handle, Buffer.alloc(1)), /Not initialized/);
+		assert.throws(() => arena.digest(handle), /Not initialized/);
+		arena.free(handle);
+		assert.throws(() => arena.free(handle), RangeError);
+		assert.throws(() => arena.update(handle, Buffer.alloc(1)), RangeError);
+		assert.throws(() => arena.digest(12345), RangeError);
+		assert.throws(() => arena.digest(-1), TypeError);
+		assert.throws(() => arena.create('md5'), /Algorithm must be/);
+	});
+});
@@ -0,0 +1,87 @@
+"use strict";
+
+const blake2 = require('../index');
+const assert = require('assert');
+const crypto = require('crypto');
+const fs = require('fs');
+
+const CRYPTO_NAMES = {blake2b: 'blake2b512', blake2s: 'blake2s256'};
+
+function unkeyedVectors(algo) {
+	const content = fs.readFileSync(`${__dirname}/test-vectors/unkeyed/${algo}-test.txt`, 'ascii');
+	return content.replace(/^\n+/, "").replace(/ok\n$/, "").split('\n\n').map(function(part) {
+		const lines = part.split('\n');
+		return {
+			input: Buffer.from(lines[0].replace(/^in:\s+/, ""), "hex"),
+			hash: Buffer.from(lines[1].replace(/^hash:\s+/, ""), "hex")
+		};
+	});
+}
+
+describe('backends', function() {
+	afterEach(function() {
+		blake2.resetTuning();
+	});
+
+	for (const algo of Object.keys(CRYPTO_NAMES)) {
+		describe(algo, function() {
+			before(function() {
+				if (!crypto.getHashes().includes(CRYPTO_NAMES[algo])) {
+					this.skip();
+				}
+			});
+
+			it('gives the same results on node:crypto for all unkeyed test vectors', function() {
+				for (const v of unkeyedVectors(algo)) {
+					assert.deepEqual(blake2.createHash(algo, {backend: 'crypto'}).update(v.input).digest(), v.hash);
+					const hasher = blake2.createHasher(algo, {backend: 'crypto'}).update(v.input);
+					assert.deepEqual(hasher.copy().digest(), v.hash);
+					assert.deepEqual(hasher.digest(), v.hash);
+				}
+			});
+
+			it('uses the backend the tuning profile chooses for the size class', function() {
+				if (!blake2.stats().enabled) {
+					this.skip();
+				}
+				const data = Buffer.alloc(100000, 1);
+				blake2.setTuning({backends: {[algo]: {large: 'crypto'}}});
+				blake2.resetStats();
+				const large = blake2.createHash(algo).update(data).digest();
+				assert.equal(blake2.stats().bytes[algo], 0);
+				const small = blake2.createHasher(algo).update(data.subarray(0, 10)).digest();
+				assert.equal(blake2.stats().bytes[algo], 10);
+				blake2.createHasher(algo, {sizeHint: data.length}).update(data).digest();
+				assert.equal(blake2.stats().bytes[algo], 10);
+				assert.deepEqual(large, crypto.createHash(CRYPTO_NAMES[algo]).update(data).digest());
+				assert.deepEqual(small, crypto.createHash(CRYPTO_NAMES[algo]).update(data.subarray(0, 10)).digest());
+			});
+
+			it('stays native for keys, short digests, checkpoints and offload', function() {
+				if (!blake2.stats().enabled) {
+					this.skip();
+				}
+				blake2.setTuning({backends: {[algo]: {small: 'crypto', medium: 'crypto', large: 'crypto'}}});
+				blake2.resetStats();
+				blake2.createKeyedHash(algo, Buffer.alloc(16)).update(Buffer.alloc(1)).digest();
+				blake2.createHash(algo, {digestLength: 16}).update(Buffer.alloc(1)).digest();
+				blake2.createHash(algo, {checkpointEvery: 1024}).update(Buffer.alloc(1)).digest();
+				blake2.createHasher(algo, {key: Buffer.alloc(16)}).update(Buffer.alloc(1)).digest();
+				assert.equal(blake2.stats().bytes[algo], 4);
+			});
+
+			it('refuses the crypto backend where it cannot stand in', function() {
+				assert.throws(() => blake2.createHasher(algo, {backend: 'crypto', key: Buffer.alloc(16)}), TypeError);
+				assert.throws(() => blake2.createHash(algo, {backend: 'crypto', digestLength: 16}), TypeError);
+				assert.throws(() => blake2.createHash(algo, {backend: 'openssl'}), TypeError);
+			});
+		});
+	}
+
+	it('rejects bad backend choices', function() {
+		assert.throws(() => blake2.setTuning({backends: {blake2bp: {large: 'crypto'}}}), TypeError);
+		assert.throws(() => blake2.setTuning({backends: {blake2b: {huge: 'crypto'}}}), TypeError);
+		assert.throws(() => blake2.setTuning({backends: {blake2b: {large: 'openssl'}}}), TypeError);
+		assert.equal(blake2.getTuning().backends.blake2b.large, 'native');
+	});
+});
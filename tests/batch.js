@@ -0,0 +1,131 @@
+"use strict";
+
+const blake2 = require('../index');
+const assert = require('assert');
+const crypto = require('crypto');
+
+// Lengths around the block sizes, so that buffered bytes, whole blocks and
+// leftovers all meet
+const LENGTHS = [0, 1, 63, 64, 65, 127, 128, 129, 200, 256, 1000];
+
+function input(i, round) {
+	const length = LENGTHS[(i + round) % LENGTHS.length];
+	return Buffer.alloc(length, (i * 31 + round) & 0xff);
+}
+
+describe('updateBatch', function() {
+	it('updates Hash, KeyedHash and Hasher objects like update()', function() {
+		const algorithms = ['blake2b', 'blake2bp', 'blake2s', 'blake2sp'];
+		const make = [
+			algo => blake2.createHash(algo),
+			algo => blake2.createHash(algo, {digestLength: 20}),
+			algo => blake2.createKeyedHash(algo, Buffer.alloc(16, 3)),
+			algo => blake2.createHasher(algo),
+			algo => blake2.createHasher(algo, {key: Buffer.alloc(8, 5)})
+		];
+		const batched = [];
+		const serial = [];
+		for (let i = 0; i < 40; i++) {
+			const algo = algorithms[i % algorithms.length];
+			batched.push(make[i % make.length](algo));
+			serial.push(make[i % make.length](algo));
+		}
+		for (let round = 0; round < 6; round++) {
+			blake2.updateBatch(batched.map((hash, i) => [hash, input(i, round)]));
+			serial.forEach((hash, i) => hash.update(input(i, round)));
+		}
+		batched.forEach(function(hash, i) {
+			assert.equal(hash.digest('hex'), serial[i].digest('hex'));
+		});
+	});
+
+	it('applies entries for the same hash in order', function() {
+		const hash = blake2.createHash('blake2b');
+		const hasher = blake2.createHasher('blake2s');
+		const entries = [];
+		for (let round = 0; round < 5; round++) {
+			entries.push([hash, input(round, 0)], [hasher, input(round, 1)]);
+		}
+		blake2.updateBatch(entries);
+		const expectedHash = blake2.createHash('blake2b');
+		const expectedHasher = blake2.createHasher('blake2s');
+		for (let round = 0; round < 5; round++) {
+			expectedHash.update(input(round, 0));
+			expectedHasher.update(input(round, 1));
+		}
+		assert.equal(hash.digest('hex'), expectedHash.digest('hex'));
+		assert.equal(hasher.digest('hex'), expectedHasher.digest('hex'));
+	});
+
+	it('falls back to update() for hashes it cannot batch', function() {
+		const offloaded = blake2.createHash('blake2b', {offload: true});
+		const checkpointed = blake2.createHash('blake2b', {checkpointEvery: 128});
+		const plain = blake2.createHash('blake2s');
+		const data = Buffer.alloc(300, 9);
+		blake2.updateBatch([[offloaded, data], [checkpointed, data], [plain, data]]);
+		const expected = algo => blake2.createHash(algo).update(data).digest('hex');
+		assert.equal(checkpointed.digest('hex'), expected('blake2b'));
+		assert.equal(plain.digest('hex'), expected('blake2s'));
+		return offloaded.digest('hex').then(digest => assert.equal(digest, expected('blake2b')));
+	});
+
+	it('changes no hash updated on its own when a later entry is bad', function() {
+		const hashes = [blake2.createHash('blake2b', {checkpointEvery: 128})];
+		if (crypto.getHashes().includes('blake2b512')) {
+			hashes.push(blake2.createHasher('blake2b', {backend: 'crypto'}));
+		}
+		const finished = blake2.createHash('blake2s');
+		finished.digest();
+		const data = Buffer.alloc(300, 9);
+		for (const bad of [[hashes[0], 'not a buffer'], [finished, data]]) {
+			assert.throws(() => blake2.updateBatch(hashes.map(hash => [hash, data]).concat([bad])));
+		}
+		const checkpointed = blake2.createHash('blake2b', {checkpointEvery: 128});
+		checkpointed.digest();
+		assert.throws(() => blake2.updateBatch(hashes.map(hash => [hash, data]).concat([[checkpointed, data]])), /Not initialized/);
+		for (const hash of hashes) {
+			assert.equal(hash.digest('hex'), blake2.createHash('blake2b').digest('hex'));
+		}
+	});
+
+	it('updates arena handles', function() {
+		const arena = blake2.createHashArena();
+		const handles = [];
+		const serial = [];
+		for (let i = 0; i < 100; i++) {
+			const algo = i % 3 ? 'blake2b' : 'blake2s';
+			handles.push(arena.create(algo));
+			serial.push(blake2.createHash(algo));
+		}
+		for (let round = 0; round < 4; round++) {
+			// Every handle twice per batch
+			const entries = handles.map((handle, i) => [handle, input(i, round)]);
+			arena.updateBatch(entries.concat(handles.map((handle, i) => [handle, input(i + 1, round)])));
+			serial.forEach(function(hash, i) {
+				hash.update(input(i, round));
+				hash.update(input(i + 1, round));
+			});
+		}
+		handles.forEach(function(handle, i) {
+			assert.equal(arena.digest(handle, 'hex'), serial[i].digest('hex'));
+		});
+	});
+
+	it('rejects bad entries before updating anything', function() {
+		const hash = blake2.createHash('blake2b', {backend: 'native'});
+		const data = Buffer.from('abc');
+		assert.throws(() => blake2.updateBatch(hash), TypeError);
+		assert.throws(() => blake2.updateBatch([[hash]]), TypeError);
+		assert.throws(() => blake2.updateBatch([[{}, data]]), TypeError);
+		assert.throws(() => blake2.updateBatch([[hash, data], [hash, 'abc']]), TypeError);
+		assert.equal(hash.digest('hex'), blake2.createHash('blake2b').digest('hex'));
+
+		const arena = blake2.createHashArena();
+		const handle = arena.create('blake2s');
+		const done = arena.create('blake2s');
+		arena.digest(done);
+		assert.throws(() => arena.updateBatch([[handle, data], [done, data]]), /Not initialized/);
+		assert.throws(() => arena.updateBatch([[handle, data], [handle + 400, data]]), RangeError);
+		assert.equal(arena.digest(handle, 'hex'), blake2.createHash('blake2s').digest('hex'));
+	});
+});
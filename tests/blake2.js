@@ -3,6 +3,7 @@
 const blake2 = require('../index');
 const binding = require('../build/Release/blake2');
 const assert = require('assert');
+const crypto = require('crypto');
 const fs = require('fs');
 const os = require('os');
 
@@ -369,6 +370,120 @@ describe('blake2', function() {
 			}
 		}
 	});
+
+	it('emits a checkpoint digest every checkpointEvery bytes', function() {
+		const data = Buffer.alloc(10000, 'checkpoint');
+		for (const algo of ['blake2b', 'blake2s', 'blake2bp', 'blake2sp']) {
+			const key = Buffer.from('checkpoint key');
+			const hash = blake2.createKeyedHash(algo, key, {checkpointEvery: 1000, digestLength: 20});
+			const checkpoints = [];
+			hash.on('checkpoint', (offset, digest) => checkpoints.push([offset, Buffer.from(digest)]));
+			// Writes that start and end between boundaries
+			for (let i = 0; i < data.length; i += 777) {
+				hash.update(data.slice(i, i + 777));
+			}
+			assert.deepEqual(checkpoints.map(c => c[0]), [1000, 2000, 3000, 4000, 5000, 6000, 7000, 8000, 9000, 10000]);
+			for (const [offset, digest] of checkpoints) {
+				const expected = blake2.createKeyedHash(algo, key, {digestLength: 20}).update(data.slice(0, offset)).digest();
+				assert.deepEqual(digest, expected);
+			}
+			assert.deepEqual(hash.digest(), checkpoints[9][1]);
+		}
+	});
+
+	it('keeps emitting checkpoints from a copy', function() {
+		const hash = blake2.createHash('blake2b', {checkpointEvery: 64});
+		hash.update(Buffer.alloc(100));
+		const copy = hash.copy();
+		const offsets = [];
+		copy.on('checkpoint', offset => offsets.push(offset));
+		copy.update(Buffer.alloc(100));
+		assert.deepEqual(offsets, [128, 192]);
+	});
+
+	it('emits checkpoints when piped', function(done) {
+		const hash = blake2.createHash('blake2s', {checkpointEvery: 4096});
+		const offsets = [];
+		hash.on('checkpoint', offset => offsets.push(offset));
+		hash.on('readable', function() {
+			const digest = hash.read();
+			if (digest) {
+				assert.deepEqual(offsets, [4096, 8192, 12288]);
+				assert.deepEqual(digest, blake2.createHash('blake2s').update(Buffer.alloc(12300, 1)).digest());
+				done();
+			}
+		});
+		hash.write(Buffer.alloc(5000, 1));
+		hash.end(Buffer.alloc(7300, 1));
+	});
+
+	it('absorbs offloaded updates in order and resolves the digest', function() {
+		const data = crypto.randomBytes(1000000);
+		const hash = blake2.createKeyedHash('blake2bp', Buffer.from('offload'), {offload: true, digestLength: 48});
+		for (let i = 0; i < data.length; i += 65536) {
+			hash.update(data.slice(i, i + 65536));
+		}
+		assert.throws(() => hash.copy(), /pending/);
+		return hash.digest('hex').then(digest => {
+			const expected = blake2.createKeyedHash('blake2bp', Buffer.from('offload'), {digestLength: 48}).update(data).digest('hex');
+			assert.equal(digest, expected);
+		});
+	});
+
+	it('applies backpressure beyond the offload budget when piped', function(done) {
+		const data = crypto.randomBytes(300000);
+		const hash = blake2.createHash('blake2s', {offload: true, offloadBudget: 50000, highWaterMark: 100000});
+		// Without backpressure every write would complete at once and the
+		// writable side would never fill up
+		let blocked = 0;
+		hash.on('data', function(digest) {
+			assert(blocked > 0);
+			assert.deepEqual(digest, blake2.createHash('blake2s').update(data).digest());
+			done();
+		});
+		for (let i = 0; i < data.length; i += 20000) {
+			if (!hash.write(data.slice(i, i + 20000))) {
+				blocked++;
+			}
+		}
+		hash.end();
+	});
+
+	it('hashes corked writes of mixed sizes in one call', function(done) {
+		const chunks = [];
+		for (let i = 0; i < 400; i++) {
+			chunks.push(crypto.randomBytes(i % 10 === 0 ? 3000 : i % 700));
+		}
+		const hash = blake2.createKeyedHash('blake2s', Buffer.from('writev'));
+		let calls = 0;
+		const updateMany = hash._handle.updateMany;
+		hash._handle.updateMany = function(buffers) {
+			calls++;
+			return updateMany.call(this, buffers);
+		};
+		hash.on('data', function(digest) {
+			assert.equal(calls, 1);
+			assert.deepEqual(digest, blake2.createKeyedHash('blake2s', Buffer.from('writev')).update(Buffer.concat(chunks)).digest());
+			done();
+		});
+		hash.cork();
+		chunks.forEach(chunk => hash.write(chunk));
+		process.nextTick(() => {
+			hash.uncork();
+			hash.end();
+		});
+	});
+
+	it('rejects checkpoint intervals that are not positive integers', function() {
+		for (const every of [NaN, Infinity, 1.5, -64, 2 ** 53 + 2]) {
+			assert.throws(() => blake2.createHash('blake2b', {checkpointEvery: every}), /positive integer/);
+		}
+		assert.throws(() => new binding.Hash('blake2b', null, -1).setCheckpointEvery(NaN), /positive integer/);
+	});
+
+	it('rejects checkpoints with offload', function() {
+		assert.throws(() => blake2.createHash('blake2b', {offload: true, checkpointEvery: 64}), /cannot be combined/);
+	});
 });
 
 describe('binding', function() {
@@ -0,0 +1,134 @@
+"use strict";
+
+const blake2 = require('../index');
+const assert = require('assert');
+const crypto = require('crypto');
+const fs = require('fs');
+const os = require('os');
+const path = require('path');
+const {Worker} = require('worker_threads');
+
+function values(prefix, count) {
+	const result = [];
+	for (let i = 0; i < count; i++) {
+		result.push(prefix + i);
+	}
+	return result;
+}
+
+describe('bloom filter', function() {
+	it('has no false negatives and about the requested false positives', function() {
+		const filter = blake2.createBloomFilter({capacity: 20000, errorRate: 0.01});
+		const added = values('in:', 20000);
+		filter.add(added);
+		assert.equal(filter.count, 20000);
+		assert(filter.hasMany(added).every(found => found === 1));
+		const positives = filter.hasMany(values('out:', 20000)).reduce((sum, found) => sum + found, 0);
+		assert(positives < 20000 * 0.02, `${positives} false positives`);
+		assert(filter.has('in:1234'));
+		assert(filter.has(Buffer.from('in:1234')));
+	});
+
+	it('uses the optimal number of probes for the error rate', function() {
+		const storage = blake2.createBloomFilter({capacity: 20000, errorRate: 0.01}).storage;
+		// -log2(0.01) = 6.64; the header holds the probe count at offset 12
+		assert.equal(Buffer.from(storage.buffer, storage.byteOffset, storage.length).readUInt32LE(12), 7);
+	});
+
+	it('takes values packed into one Buffer', function() {
+		const filter = blake2.createBloomFilter({capacity: 100, salt: Buffer.alloc(16, 7)});
+		const same = blake2.createBloomFilter({capacity: 100, salt: Buffer.alloc(16, 7)});
+		const buffers = ['', 'a', 'x'.repeat(100)].map(v => Buffer.from(v));
+		const ends = new Uint32Array([0, 1, 101]);
+		filter.add(Buffer.concat(buffers), ends);
+		same.add(['', 'a', 'x'.repeat(100)]);
+		assert.deepEqual(Buffer.from(filter.storage), Buffer.from(same.storage));
+		assert(filter.has(''));
+	});
+
+	it('takes digests directly', function() {
+		const filter = blake2.createBloomFilter({capacity: 1000});
+		const digests = values('d', 1000).map(v => blake2.createHash('blake2b', {digestLength: 32}).update(Buffer.from(v)).digest());
+		filter.addDigests(digests);
+		assert(filter.hasDigests(Buffer.concat(digests), 32).every(found => found === 1));
+		assert.throws(() => filter.addDigests(Buffer.alloc(8), 8), /at least 16 bytes/);
+	});
+
+	it('is shared with worker threads without copying', function() {
+		this.timeout(30000);
+		const filter = blake2.createBloomFilter({capacity: 10000});
+		assert(filter.storage.buffer instanceof SharedArrayBuffer);
+		const workers = [0, 1, 2, 3].map(i => new Promise((resolve, reject) => {
+			const worker = new Worker('./tests/worker/bloom-worker.js', {
+				workerData: {storage: filter.storage, prefix: `worker${i}:`, count: 2000}
+			});
+			worker.on('message', resolve);
+			worker.on('error', reject);
+		}));
+		return Promise.all(workers).then(results => {
+			assert.deepEqual(results, [true, true, true, true]);
+			assert.equal(filter.count, 8000);
+			for (let i = 0; i < 4; i++) {
+				assert(filter.hasMany(values(`worker${i}:`, 2000)).every(found => found === 1));
+			}
+		});
+	});
+
+	it('saves and maps the filter back', function() {
+		if (process.platform === 'win32') {
+			// A mapped file cannot be deleted until it is garbage collected
+			this.skip();
+		}
+		const file = path.join(os.tmpdir(), 'blake2-bloom-' + crypto.randomBytes(6).toString('hex'));
+		try {
+			const filter = blake2.createBloomFilter({capacity: 1000});
+			filter.add(values('saved:', 1000));
+			filter.save(file);
+
+			const loaded = blake2.loadBloomFilter(file);
+			assert.equal(loaded.count, 1000);
+			assert(loaded.hasMany(values('saved:', 1000)).every(found => found === 1));
+			loaded.add('private');
+			assert.equal(blake2.loadBloomFilter(file).count, 1000);
+
+			blake2.loadBloomFilter(file, {shared: true}).add('written');
+			assert.equal(blake2.loadBloomFilter(file).count, 1001);
+		} finally {
+			fs.unlinkSync(file);
+		}
+	});
+
+	it('saves a mapped filter back to its own file', function() {
+		if (process.platform === 'win32') {
+			this.skip();
+		}
+		const file = path.join(os.tmpdir(), 'blake2-bloom-' + crypto.randomBytes(6).toString('hex'));
+		try {
+			blake2.createBloomFilter({capacity: 1000}).add(values('saved:', 100)).save(file);
+
+			const loaded = blake2.loadBloomFilter(file);
+			loaded.add(values('more:', 100));
+			loaded.save(file);
+			assert.equal(loaded.count, 200);
+			loaded.add('after');
+			assert(loaded.has('after'));
+			assert(loaded.hasMany(values('more:', 100)).every(found => found === 1));
+
+			const reloaded = blake2.loadBloomFilter(file, {shared: true});
+			assert.equal(reloaded.count, 200);
+			assert(reloaded.hasMany(values('more:', 100)).every(found => found === 1));
+			reloaded.add('shared');
+			reloaded.save(file);
+			assert(reloaded.has('shared'));
+			assert.equal(blake2.loadBloomFilter(file).count, 201);
+		} finally {
+			fs.unlinkSync(file);
+		}
+	});
+
+	it('rejects storage that is not a filter', function() {
+		assert.throws(() => new blake2.BloomFilter(new Uint8Array(1024)), /Not a Bloom filter/);
+		assert.throws(() => new blake2.BloomFilter('storage'), /Uint8Array/);
+		assert.throws(() => blake2.loadBloomFilter('/does/not/exist'), /Cannot map/);
+	});
+});
@@ -0,0 +1,68 @@
+"use strict";
+
+const blake2 = require('../index');
+const assert = require('assert');
+const crypto = require('crypto');
+
+function expectedLinks(algorithm, options, records) {
+	let link = Buffer.alloc(options.digestLength || (algorithm.startsWith('blake2b') ? 64 : 32));
+	return records.map(function(record) {
+		const hash = options.key ?
+			blake2.createKeyedHash(algorithm, options.key, options) :
+			blake2.createHash(algorithm, options);
+		link = hash.update(link).update(record).digest();
+		return link;
+	});
+}
+
+describe('HashChain', function() {
+	const records = [];
+	for (let i = 0; i < 200; i++) {
+		records.push(crypto.randomBytes(i % 7 === 0 ? 0 : i * 3));
+	}
+
+	it('links each record to the previous link', function() {
+		for (const algorithm of ['blake2b', 'blake2s', 'blake2bp', 'blake2sp']) {
+			for (const options of [{}, {key: Buffer.from('log key')}, {key: Buffer.from('log key'), digestLength: 16}]) {
+				const expected = expectedLinks(algorithm, options, records);
+				const chain = blake2.createHashChain(algorithm, options);
+				assert.deepEqual(chain.append(records.slice(0, 50), true), Buffer.concat(expected.slice(0, 50)));
+				assert.deepEqual(chain.append(records.slice(50)), expected[199]);
+				assert.deepEqual(chain.link, expected[199]);
+			}
+		}
+	});
+
+	it('takes packed records and a starting link', function() {
+		const options = {key: Buffer.from('log key'), digestLength: 32};
+		const expected = expectedLinks('blake2b', options, records);
+		const chain = blake2.createHashChain('blake2b', Object.assign({link: expected[99]}, options));
+		const packed = Buffer.concat(records.slice(100));
+		const ends = new Uint32Array(100);
+		let end = 0;
+		for (let i = 0; i < 100; i++) {
+			end += records[100 + i].length;
+			ends[i] = end;
+		}
+		assert.deepEqual(chain.append(packed, ends, true), Buffer.concat(expected.slice(100)));
+	});
+
+	it('verifies a segment', function() {
+		const options = {key: Buffer.from('log key')};
+		const expected = expectedLinks('blake2s', options, records);
+		const chain = blake2.createHashChain('blake2s', options);
+		const links = Buffer.concat(expected.slice(10, 30));
+		assert.equal(chain.verify(expected[9], records.slice(10, 30), links), -1);
+		links[32 * 7] ^= 1;
+		assert.equal(chain.verify(expected[9], records.slice(10, 30), links), 7);
+		// verify does not advance the chain
+		assert.deepEqual(chain.link, Buffer.alloc(32));
+	});
+
+	it('rejects bad record ends', function() {
+		const chain = blake2.createHashChain('blake2b');
+		assert.throws(() => chain.append(Buffer.alloc(10), [5, 10]), /Uint32Array/);
+		assert.throws(() => chain.append(Buffer.alloc(10), new Uint32Array([5, 11])), /within the buffer/);
+		assert.throws(() => chain.append(Buffer.alloc(10), new Uint32Array([5, 4])), /ascending/);
+	});
+});
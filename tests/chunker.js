@@ -0,0 +1,94 @@
+"use strict";
+
+const blake2 = require('../index');
+const assert = require('assert');
+const crypto = require('crypto');
+const fs = require('fs');
+const os = require('os');
+
+function blake2b(buf, digestLength) {
+	return blake2.createHash('blake2b', {digestLength}).update(buf).digest();
+}
+
+function chunkAll(data, options, pieceSize) {
+	const chunker = blake2.createChunker(options);
+	const records = [];
+	for (let i = 0; i < data.length; i += pieceSize) {
+		records.push(chunker._handle.update(data.slice(i, i + pieceSize)));
+	}
+	records.push(chunker._handle.final());
+	return Buffer.concat(records);
+}
+
+describe('chunker', function() {
+	this.timeout(10000);
+	const data = crypto.randomBytes(1024 * 1024);
+	const options = {minSize: 2048, avgSize: 8192, maxSize: 32768, digestLength: 32};
+
+	it('emits contiguous chunks whose digests match the chunk contents', function() {
+		const chunks = blake2.parseChunkRecords(chunkAll(data, options, data.length), 32);
+		let offset = 0;
+		for (const [i, chunk] of chunks.entries()) {
+			assert.equal(chunk.offset, offset);
+			assert(chunk.length <= options.maxSize);
+			if (i !== chunks.length - 1) {
+				assert(chunk.length >= options.minSize);
+			}
+			assert.deepEqual(chunk.digest, blake2b(data.slice(offset, offset + chunk.length), 32));
+			offset += chunk.length;
+		}
+		assert.equal(offset, data.length);
+		assert(chunks.length > 1);
+	});
+
+	it('finds the same boundaries however the input is split', function() {
+		const whole = chunkAll(data, options, data.length);
+		assert.deepEqual(chunkAll(data, options, 1000), whole);
+		assert.deepEqual(chunkAll(data, options, 65536 + 7), whole);
+	});
+
+	it('keeps boundaries after an insertion near the start', function() {
+		const shifted = Buffer.concat([Buffer.from('inserted'), data]);
+		const before = blake2.parseChunkRecords(chunkAll(data, options, data.length), 32);
+		const after = blake2.parseChunkRecords(chunkAll(shifted, options, shifted.length), 32);
+		const digests = new Set(before.map(c => c.digest.toString('hex')));
+		const shared = after.filter(c => digests.has(c.digest.toString('hex')));
+		assert(shared.length >= before.length - 3);
+	});
+
+	it('works with .pipe() and chunkFile()', function(done) {
+		const tempfname = `${os.tmpdir()}/blake2-chunker-test`;
+		fs.writeFileSync(tempfname, data);
+
+		const parts = [];
+		const chunker = blake2.createChunker(options);
+		chunker.on('data', part => parts.push(part));
+		chunker.on('end', function() {
+			const piped = Buffer.concat(parts);
+			assert.deepEqual(piped, chunkAll(data, options, data.length));
+			blake2.chunkFile(tempfname, options).then(function(records) {
+				assert.deepEqual(records, piped);
+				fs.unlinkSync(tempfname);
+				done();
+			}).catch(done);
+		});
+		fs.createReadStream(tempfname).pipe(chunker);
+	});
+
+	it('emits no records for empty input', function() {
+		assert.equal(chunkAll(Buffer.alloc(0), options, 1).length, 0);
+	});
+
+	it('rejects inconsistent chunk sizes', function() {
+		assert.throws(function() {
+			blake2.createChunker({minSize: 4096, avgSize: 2048});
+		}, /minSize <= avgSize <= maxSize/);
+	});
+
+	it('rejects a missing file', function() {
+		return blake2.chunkFile(`${os.tmpdir()}/blake2-does-not-exist`).then(
+			() => assert.fail('should have failed'),
+			err => assert(err instanceof Error)
+		);
+	});
+});
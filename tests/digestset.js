@@ -0,0 +1,158 @@
+"use strict";
+
+const blake2 = require('../index');
+const assert = require('assert');
+const crypto = require('crypto');
+const fs = require('fs');
+const os = require('os');
+const path = require('path');
+
+function digest(i) {
+	return blake2.createHash('blake2b', {digestLength: 32}).update(Buffer.from(`object ${i}`)).digest();
+}
+
+describe('digest set', function() {
+	const digests = [];
+	for (let i = 0; i < 5000; i++) {
+		digests.push(digest(i));
+	}
+
+	it('deduplicates digests exactly', function() {
+		const set = blake2.createDigestSet();
+		const inserted = set.add(digests.concat(digests.slice(0, 100)));
+		assert.equal(set.size, 5000);
+		assert.equal(inserted.reduce((sum, isNew) => sum + isNew, 0), 5000);
+		assert(inserted.subarray(5000).every(isNew => isNew === 0));
+		assert(set.hasMany(Buffer.concat(digests)).every(found => found === 1));
+		assert(!set.has(digest(5000)));
+	});
+
+	it('handles the all-zero digest and shared prefixes', function() {
+		const set = blake2.createDigestSet({width: 16, capacity: 4});
+		const zero = Buffer.alloc(16);
+		const prefix = Buffer.alloc(16);
+		prefix[15] = 1;
+		assert(!set.has(zero));
+		assert.deepEqual(Array.from(set.add([zero, prefix, zero])), [1, 1, 0]);
+		assert(set.has(zero) && set.has(prefix));
+		assert.equal(set.size, 2);
+	});
+
+	it('maps digests to fixed-width values', function() {
+		const map = blake2.createDigestSet({valueWidth: 8, capacity: digests.length});
+		const values = digests.map((d, i) => {
+			const value = Buffer.alloc(8);
+			value.writeUInt32LE(i, 0);
+			return value;
+		});
+		map.add(digests, values);
+		assert.equal(map.get(digests[1234]).readUInt32LE(0), 1234);
+		assert.equal(map.get(digest(9999)), undefined);
+
+		assert(!map.set(digests[1234], Buffer.alloc(8, 0xff)));
+		assert.deepEqual(map.get(digests[1234]), Buffer.alloc(8, 0xff));
+		map.add([digests[1]], [Buffer.alloc(8)]);
+		assert.equal(map.get(digests[1]).readUInt32LE(0), 1);
+
+		const {found, values: got} = map.getMany([digests[2], digest(9999)]);
+		assert.deepEqual(Array.from(found), [1, 0]);
+		assert.equal(got.readUInt32LE(0), 2);
+		assert.deepEqual(got.slice(8), Buffer.alloc(8));
+	});
+
+	it('saves and maps the set back', function() {
+		if (process.platform === 'win32') {
+			// A mapped file cannot be deleted until it is garbage collected
+			this.skip();
+		}
+		const file = path.join(os.tmpdir(), 'blake2-digestset-' + crypto.randomBytes(6).toString('hex'));
+		try {
+			const set = blake2.createDigestSet({valueWidth: 4});
+			set.add(digests, digests.map(d => d.slice(0, 4)));
+			set.save(file);
+
+			const loaded = blake2.loadDigestSet(file);
+			assert.equal(loaded.size, 5000);
+			assert.equal(loaded.valueWidth, 4);
+			assert.deepEqual(loaded.get(digests[77]), digests[77].slice(0, 4));
+			// Growing past the mapped file moves the set to memory
+			for (let i = 5000; i < 20000; i++) {
+				loaded.add(digest(i), Buffer.alloc(4));
+			}
+			assert.equal(loaded.size, 20000);
+			assert(loaded.hasMany(digests).every(found => found === 1));
+			assert.equal(blake2.loadDigestSet(file).size, 5000);
+		} finally {
+			fs.unlinkSync(file);
+		}
+	});
+
+	it('saves a mapped set back to its own file', function() {
+		if (process.platform === 'win32') {
+			this.skip();
+		}
+		const file = path.join(os.tmpdir(), 'blake2-digestset-' + crypto.randomBytes(6).toString('hex'));
+		try {
+			// Room to spare, so that the additions stay in the mapping
+			const set = blake2.createDigestSet({capacity: 1000});
+			set.add(digests.slice(0, 100));
+			set.save(file);
+			for (const shared of [false, true]) {
+				const loaded = blake2.loadDigestSet(file, {shared});
+				const added = shared ? 120 : 110;
+				loaded.add(digests.slice(added - 10, added));
+				loaded.save(file);
+				assert.equal(loaded.size, added);
+				assert(loaded.hasMany(digests.slice(0, added)).every(found => found === 1));
+				loaded.add(digests[4000]);
+				assert(loaded.has(digests[4000]));
+
+				const reloaded = blake2.loadDigestSet(file);
+				assert.equal(reloaded.size, added + (shared ? 1 : 0));
+				assert(reloaded.hasMany(digests.slice(0, added)).every(found => found === 1));
+			}
+		} finally {
+			fs.unlinkSync(file);
+		}
+	});
+
+	it('rejects overfull and truncated files', function() {
+		if (process.platform === 'win32') {
+			this.skip();
+		}
+		const file = path.join(os.tmpdir(), 'blake2-digestset-' + crypto.randomBytes(6).toString('hex'));
+		try {
+			const set = blake2.createDigestSet({width: 16, capacity: 4});
+			set.add(digests.slice(0, 3).map(d => d.slice(0, 16)));
+			set.save(file);
+			const saved = fs.readFileSync(file);
+			const slots = saved.readUInt32LE(24);
+
+			const full = Buffer.from(saved);
+			full.writeUInt32LE(slots, 32);
+			fs.writeFileSync(file, full);
+			assert.throws(() => blake2.loadDigestSet(file), /corrupt/);
+
+			fs.writeFileSync(file, saved.subarray(0, saved.length - 16));
+			assert.throws(() => blake2.loadDigestSet(file), /corrupt/);
+
+			// A header that undercounts: no slot is empty, so probing must stop
+			const taken = Buffer.from(saved);
+			taken.fill(0xab, 64, 64 + slots * 16);
+			fs.writeFileSync(file, taken);
+			const loaded = blake2.loadDigestSet(file);
+			const missing = digest(9999).slice(0, 16);
+			assert(!loaded.has(missing));
+			assert.throws(() => loaded.add(missing), /corrupt/);
+		} finally {
+			fs.unlinkSync(file);
+		}
+	});
+
+	it('rejects bad arguments', function() {
+		assert.throws(() => blake2.createDigestSet({width: 4}), /between 8 and 64/);
+		assert.throws(() => blake2.createDigestSet().add(Buffer.alloc(31)), /whole number of digests/);
+		assert.throws(() => blake2.createDigestSet({valueWidth: 8}).add(Buffer.alloc(32), Buffer.alloc(4)), /valueWidth bytes/);
+		assert.throws(() => blake2.loadDigestSet(path.join(__dirname, 'blake2.js')), /not a digest set/);
+	});
+});
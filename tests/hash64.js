@@ -0,0 +1,58 @@
+"use strict";
+
+const blake2 = require('../index');
+const assert = require('assert');
+const crypto = require('crypto');
+
+function expected(key, value) {
+	const hash = blake2.createKeyedHash('blake2s', key, {digestLength: 8});
+	return hash.update(Buffer.from(value)).digest().readBigUInt64LE(0);
+}
+
+describe('hash64', function() {
+	const key = Buffer.from('shard routing key');
+	const values = [];
+	for (let i = 0; i < 1000; i++) {
+		values.push(i % 17 === 0 ? '' : crypto.randomBytes(i % 150).toString('base64').slice(0, i % 150) + 'é');
+	}
+
+	it('returns the 8-byte keyed blake2s digest as a BigInt', function() {
+		for (const value of ['', 'a', 'user:1234', 'x'.repeat(64), 'x'.repeat(65), '\u{1f600}']) {
+			assert.equal(blake2.hash64(key, value), expected(key, value));
+			assert.equal(blake2.hash64(key, Buffer.from(value)), expected(key, value));
+		}
+	});
+
+	it('hashes an array of strings into a BigUint64Array', function() {
+		const hashes = blake2.hash64Many(key, values);
+		assert(hashes instanceof BigUint64Array);
+		assert.equal(hashes.length, values.length);
+		for (let i = 0; i < values.length; i++) {
+			assert.equal(hashes[i], expected(key, values[i]));
+		}
+	});
+
+	it('hashes values packed into one Buffer', function() {
+		const buffers = values.map(v => Buffer.from(v));
+		const ends = new Uint32Array(buffers.length);
+		let end = 0;
+		buffers.forEach((b, i) => {
+			end += b.length;
+			ends[i] = end;
+		});
+		const hasher = blake2.createHash64(key);
+		assert.deepEqual(hasher.hashMany(Buffer.concat(buffers), ends), blake2.hash64Many(key, values));
+		assert.equal(hasher.hash(values[3]), expected(key, values[3]));
+	});
+
+	it('depends on the key', function() {
+		assert.notEqual(blake2.hash64(Buffer.from('key 1'), 'value'), blake2.hash64(Buffer.from('key 2'), 'value'));
+	});
+
+	it('rejects bad arguments', function() {
+		assert.throws(() => blake2.hash64('not a buffer', 'value'), /Key must be a Buffer/);
+		assert.throws(() => blake2.hash64(Buffer.alloc(33), 'value'), /32 bytes or smaller/);
+		assert.throws(() => blake2.hash64Many(key, [1, 2]), /strings or Buffers/);
+		assert.throws(() => blake2.hash64Many(key, Buffer.alloc(4), new Uint32Array([5])), /within the buffer/);
+	});
+});
@@ -0,0 +1,80 @@
+"use strict";
+
+const blake2 = require('../index');
+const assert = require('assert');
+const crypto = require('crypto');
+
+describe('Hasher', function() {
+	const key = Buffer.from('hasher key');
+
+	it('matches Hash for short and long inputs', function() {
+		for (const algo of ['blake2b', 'blake2bp', 'blake2s', 'blake2sp']) {
+			for (const length of [0, 1, 32, 64, 65, 1000]) {
+				const data = crypto.randomBytes(length);
+				const expected = blake2.createHash(algo).update(data).digest('hex');
+				assert.equal(blake2.createHasher(algo).update(data).digest('hex'), expected);
+				const keyed = blake2.createKeyedHash(algo, key, {digestLength: 16}).update(data).digest();
+				assert.deepEqual(blake2.createHasher(algo, {key, digestLength: 16}).update(data).digest(), keyed);
+			}
+		}
+	});
+
+	it('hashes every byte of typed arrays that are not Uint8Arrays', function() {
+		const views = [
+			new Float64Array([1.5, 2]),
+			new Uint16Array([1, 2, 3, 0xffff]),
+			new Uint32Array(new Uint32Array([7, 8, 9, 10]).buffer, 4, 2)
+		];
+		for (const view of views) {
+			const expected = blake2.createHash('blake2b').update(view).digest('hex');
+			assert.equal(blake2.createHasher('blake2b').update(view).digest('hex'), expected);
+			assert.equal(blake2.createHasher('blake2b').update(view).update(view).digest('hex'),
+				blake2.createHash('blake2b').update(view).update(view).digest('hex'));
+		}
+	});
+
+	it('keeps the order of mixed updates', function() {
+		const parts = [5, 100, 3, 64, 0, 2000, 7].map(n => crypto.randomBytes(n));
+		const hasher = blake2.createHasher('blake2s');
+		parts.forEach(part => hasher.update(part));
+		assert.deepEqual(hasher.digest(), blake2.createHash('blake2s').update(Buffer.concat(parts)).digest());
+	});
+
+	it('is not affected by changes to a buffer after update', function() {
+		const data = Buffer.from('short input');
+		const hasher = blake2.createHasher('blake2b').update(data);
+		data.fill(0);
+		assert.deepEqual(hasher.digest(), blake2.createHash('blake2b').update(Buffer.from('short input')).digest());
+	});
+
+	it('copies and resets', function() {
+		const hasher = blake2.createHasher('blake2b', {digestLength: 32}).update(Buffer.from('abc'));
+		const copy = hasher.copy();
+		copy.update(Buffer.from('def'));
+		assert.deepEqual(hasher.digest(), blake2.createHash('blake2b', {digestLength: 32}).update(Buffer.from('abc')).digest());
+		assert.deepEqual(copy.digest(), blake2.createHash('blake2b', {digestLength: 32}).update(Buffer.from('abcdef')).digest());
+		assert.throws(() => hasher.digest(), /Not initialized/);
+		assert.deepEqual(hasher.reset().update(Buffer.from('abc')).digest(), copy.reset().update(Buffer.from('abc')).digest());
+	});
+
+	it('upgrades to a stream on demand', function(done) {
+		const data = crypto.randomBytes(10000);
+		const hash = blake2.createHasher('blake2sp', {key}).update(data.slice(0, 10)).stream();
+		hash.on('data', function(digest) {
+			assert.deepEqual(digest, blake2.createKeyedHash('blake2sp', key).update(data).digest());
+			done();
+		});
+		hash.cork();
+		hash.write(data.slice(10, 20));
+		hash.write(data.slice(20, 5000));
+		process.nextTick(() => {
+			hash.uncork();
+			hash.end(data.slice(5000));
+		});
+	});
+
+	it('rejects bad input', function() {
+		assert.throws(() => blake2.createHasher('md5'), /Algorithm must be/);
+		assert.throws(() => blake2.createHasher('blake2b').update('string'), /need a Buffer/);
+	});
+});
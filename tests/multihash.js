@@ -0,0 +1,73 @@
+"use strict";
+
+const blake2 = require('../index');
+const assert = require('assert');
+const crypto = require('crypto');
+const fs = require('fs');
+const os = require('os');
+const path = require('path');
+
+describe('multi-hash', function() {
+	const key = Buffer.from('migration key');
+	const specs = [
+		'blake2b',
+		{algorithm: 'blake2s'},
+		{algorithm: 'blake2b', digestLength: 16},
+		{algorithm: 'blake2sp', key, digestLength: 20}
+	];
+	const data = crypto.randomBytes(100000);
+
+	function expected(input) {
+		return [
+			blake2.createHash('blake2b').update(input).digest(),
+			blake2.createHash('blake2s').update(input).digest(),
+			blake2.createHash('blake2b', {digestLength: 16}).update(input).digest(),
+			blake2.createKeyedHash('blake2sp', key, {digestLength: 20}).update(input).digest()
+		];
+	}
+
+	it('computes every digest over data given in pieces', function() {
+		const multi = blake2.createMultiHash(specs);
+		multi.update(data.slice(0, 1)).update(data.slice(1, 40000)).update(data.slice(40000));
+		assert.deepEqual(multi.digest(), expected(data));
+		assert.throws(() => multi.digest(), /Not initialized/);
+	});
+
+	it('encodes digests', function() {
+		const multi = blake2.createMultiHash(specs).update(Buffer.alloc(0));
+		assert.deepEqual(multi.digest('hex'), expected(Buffer.alloc(0)).map(d => d.toString('hex')));
+	});
+
+	it('works as a stream', function(done) {
+		const multi = blake2.createMultiHash(specs);
+		multi.on('data', function(digests) {
+			assert.deepEqual(digests, expected(data));
+			done();
+		});
+		multi.write(data.slice(0, 12345));
+		multi.end(data.slice(12345));
+	});
+
+	it('hashes a Buffer or a file in one call', function() {
+		const file = path.join(os.tmpdir(), 'blake2-multi-' + crypto.randomBytes(6).toString('hex'));
+		const big = crypto.randomBytes(3 * 1024 * 1024 + 17);
+		fs.writeFileSync(file, big);
+		return Promise.all([
+			blake2.hashMulti(data, specs),
+			blake2.hashMulti(file, specs)
+		]).then(([fromBuffer, fromFile]) => {
+			assert.deepEqual(fromBuffer, expected(data));
+			assert.deepEqual(fromFile, expected(big));
+		}).then(() => fs.unlinkSync(file), err => {
+			fs.unlinkSync(file);
+			throw err;
+		});
+	});
+
+	it('rejects bad specs', function() {
+		assert.throws(() => blake2.createMultiHash([]), /non-empty array/);
+		assert.throws(() => blake2.createMultiHash(['md5']), /Algorithm must be/);
+		assert.throws(() => blake2.createMultiHash([{algorithm: 'blake2s', digestLength: 33}]), /digestLength/);
+		return assert.rejects(blake2.hashMulti('/does/not/exist', specs), /no such file/i);
+	});
+});
@@ -0,0 +1,78 @@
+"use strict";
+
+const blake2 = require('../index');
+const assert = require('assert');
+const crypto = require('crypto');
+const fs = require('fs');
+const os = require('os');
+const stream = require('stream');
+
+function expectedPieces(data, pieceSize, algorithm, options) {
+	const digests = [];
+	for (let i = 0; i < data.length; i += pieceSize) {
+		const hash = options && options.key ?
+			blake2.createKeyedHash(algorithm, options.key, options) :
+			blake2.createHash(algorithm, options);
+		digests.push(hash.update(data.slice(i, i + pieceSize)).digest());
+	}
+	return Buffer.concat(digests);
+}
+
+describe('hashPieces', function() {
+	this.timeout(30000);
+	const data = crypto.randomBytes(3 * 1024 * 1024 + 1234);
+
+	it('hashes each piece of a Buffer', async function() {
+		for (const algorithm of ['blake2b', 'blake2s', 'blake2bp', 'blake2sp']) {
+			for (const pieceSize of [64, 1000, 16384, 262144, 1048576]) {
+				const digests = await blake2.hashPieces(data, pieceSize, algorithm);
+				assert.deepEqual(digests, expectedPieces(data, pieceSize, algorithm));
+			}
+		}
+	});
+
+	it('supports keys and digestLength', async function() {
+		const options = {key: Buffer.from('piece key'), digestLength: 20};
+		const digests = await blake2.hashPieces(data, 16384, 'blake2b', options);
+		assert.equal(digests.length, Math.ceil(data.length / 16384) * 20);
+		assert.deepEqual(digests, expectedPieces(data, 16384, 'blake2b', options));
+	});
+
+	it('hashes each piece of a file', async function() {
+		const tempfname = `${os.tmpdir()}/blake2-pieces-test`;
+		fs.writeFileSync(tempfname, data);
+		try {
+			for (const pieceSize of [4096, 262144, 4194304]) {
+				const digests = await blake2.hashPieces(tempfname, pieceSize, 'blake2b');
+				assert.deepEqual(digests, expectedPieces(data, pieceSize, 'blake2b'));
+			}
+		} finally {
+			fs.unlinkSync(tempfname);
+		}
+	});
+
+	it('hashes each piece of a stream larger than one batch', async function() {
+		const big = Buffer.alloc(40 * 1024 * 1024 + 5, 'abc');
+		let offset = 0;
+		const input = new stream.Readable({
+			read() {
+				const size = 1000003;
+				this.push(offset < big.length ? big.slice(offset, offset + size) : null);
+				offset += size;
+			}
+		});
+		const digests = await blake2.hashPieces(input, 1048576, 'blake2s');
+		assert.deepEqual(digests, expectedPieces(big, 1048576, 'blake2s'));
+	});
+
+	it('returns no digests for empty input', async function() {
+		assert.equal((await blake2.hashPieces(Buffer.alloc(0), 1024, 'blake2b')).length, 0);
+	});
+
+	it('rejects a bad pieceSize', function() {
+		return blake2.hashPieces(data, 0, 'blake2b').then(
+			() => assert.fail('should have failed'),
+			err => assert(/pieceSize/.test(err.message))
+		);
+	});
+});
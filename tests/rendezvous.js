@@ -0,0 +1,89 @@
+"use strict";
+
+const blake2 = require('../index');
+const assert = require('assert');
+
+function weight(key, node, objectKey) {
+	const length = Buffer.alloc(4);
+	length.writeUInt32LE(Buffer.byteLength(node), 0);
+	const hash = blake2.createKeyedHash('blake2s', key, {digestLength: 8});
+	return hash.update(length).update(Buffer.from(node)).update(Buffer.from(objectKey)).digest().readBigUInt64LE(0);
+}
+
+function expected(key, nodes, objectKey, k) {
+	const weights = nodes.map(node => weight(key, node, objectKey));
+	const order = nodes.map((node, i) => i);
+	order.sort((a, b) => weights[a] > weights[b] ? -1 : weights[a] < weights[b] ? 1 : a - b);
+	return order.slice(0, k);
+}
+
+describe('rendezvous', function() {
+	const key = Buffer.from('placement key');
+	const nodes = [];
+	for (let i = 0; i < 37; i++) {
+		nodes.push(i % 5 === 0 ? 'storage-node-with-a-rather-long-name-in-rack-' + i + '-'.repeat(40) : 'node-' + i);
+	}
+	const objectKeys = [];
+	for (let i = 0; i < 300; i++) {
+		objectKeys.push(i % 29 === 0 ? '' : 'object/' + i + '/' + 'x'.repeat(i % 90));
+	}
+
+	it('selects the nodes with the highest keyed weights', function() {
+		const rendezvous = blake2.createRendezvous(key, nodes);
+		for (const objectKey of objectKeys.slice(0, 50)) {
+			const best = expected(key, nodes, objectKey, 3).map(i => nodes[i]);
+			assert.deepEqual(rendezvous.select(objectKey, 3), best);
+			assert.deepEqual(rendezvous.select(Buffer.from(objectKey)), best.slice(0, 1));
+		}
+	});
+
+	it('selects for an array of object keys off the main thread', function() {
+		const rendezvous = blake2.createRendezvous(key, nodes);
+		return rendezvous.selectMany(objectKeys, 2).then(selected => {
+			assert(selected instanceof Uint32Array);
+			assert.equal(selected.length, objectKeys.length * 2);
+			objectKeys.forEach((objectKey, i) => {
+				assert.deepEqual(Array.from(selected.subarray(i * 2, i * 2 + 2)), expected(key, nodes, objectKey, 2));
+			});
+		});
+	});
+
+	it('selects for object keys packed into one Buffer', function() {
+		const rendezvous = blake2.createRendezvous(key, ['a', 'b', 'c']);
+		const buffers = objectKeys.map(k => Buffer.from(k));
+		const ends = new Uint32Array(buffers.length);
+		let end = 0;
+		buffers.forEach((b, i) => {
+			end += b.length;
+			ends[i] = end;
+		});
+		return Promise.all([
+			rendezvous.selectMany(Buffer.concat(buffers), ends),
+			rendezvous.selectMany(objectKeys)
+		]).then(([packed, array]) => {
+			assert.deepEqual(packed, array);
+			assert.equal(packed[7], expected(key, ['a', 'b', 'c'], objectKeys[7], 1)[0]);
+		});
+	});
+
+	it('moves only the keys of a removed node', function() {
+		const before = blake2.createRendezvous(key, nodes);
+		const after = blake2.createRendezvous(key, nodes.slice(1));
+		for (const objectKey of objectKeys) {
+			const node = before.select(objectKey)[0];
+			if (node !== nodes[0]) {
+				assert.equal(after.select(objectKey)[0], node);
+			}
+		}
+	});
+
+	it('rejects bad arguments', function() {
+		assert.throws(() => blake2.createRendezvous('not a buffer', nodes), /Key must be a Buffer/);
+		assert.throws(() => blake2.createRendezvous(key, []), /non-empty array/);
+		assert.throws(() => blake2.createRendezvous(key, [1]), /strings or Buffers/);
+		const rendezvous = blake2.createRendezvous(key, ['a', 'b']);
+		assert.throws(() => rendezvous.select('object', 3), /between 1 and the number of nodes/);
+		assert.throws(() => rendezvous.select(5), /string or a Buffer/);
+		return assert.rejects(rendezvous.selectMany(Buffer.alloc(4), new Uint32Array([5])), /within the buffer/);
+	});
+});
@@ -0,0 +1,69 @@
+"use strict";
+
+const blake2 = require('../index');
+const assert = require('assert');
+const childProcess = require('child_process');
+const path = require('path');
+
+describe('stats', function() {
+	beforeEach(function() {
+		if (!blake2.stats().enabled) {
+			this.skip();
+		}
+		blake2.resetStats();
+	});
+
+	it('counts bytes, updates, digests and copies', function() {
+		const hash = blake2.createHash('blake2s').update(Buffer.alloc(100)).update(Buffer.alloc(5000));
+		hash.copy().digest();
+		hash.digest();
+		blake2.createHash('blake2bp').update(Buffer.alloc(3)).digest();
+		const stats = blake2.stats();
+		assert.equal(stats.bytes.blake2s, 5100);
+		assert.equal(stats.bytes.blake2bp, 3);
+		assert.equal(stats.bytes.blake2b, 0);
+		assert.equal(stats.digests.blake2s, 2);
+		assert.equal(stats.digests.blake2bp, 1);
+		assert.deepEqual(stats.updates, {'<64': 1, '<512': 1, '<4096': 0, '<65536': 1, '<1048576': 0, '>=1048576': 0});
+		assert.equal(stats.copies, 1);
+	});
+
+	it('counts batches hashed on other threads and their async jobs', function() {
+		return blake2.hashPieces(Buffer.alloc(4096), 1024, 'blake2b', {digestLength: 32}).then(function() {
+			const stats = blake2.stats();
+			assert.equal(stats.bytes.blake2b, 4096);
+			assert.equal(stats.digests.blake2b, 4);
+			assert.equal(stats.async.jobs, 1);
+			assert.equal(stats.async.queued, 0);
+			assert(stats.async.maxQueued >= 1);
+			assert(stats.async.waitMs >= 0);
+		});
+	});
+
+	it('counts keyed 64-bit hashes, one at a time or in batches', function() {
+		const hasher = blake2.createHash64(Buffer.alloc(16, 1));
+		hasher.hash(Buffer.alloc(10));
+		hasher.hashMany([Buffer.alloc(20), Buffer.alloc(30)]);
+		const stats = blake2.stats();
+		// The key block is absorbed once, when the hasher is created
+		assert.equal(stats.bytes.blake2s, 60);
+		assert.equal(stats.digests.blake2s, 3);
+	});
+
+	it('starts again from zero after resetStats', function() {
+		blake2.createHash('blake2b').update(Buffer.alloc(10)).digest();
+		blake2.resetStats();
+		assert.equal(blake2.stats().bytes.blake2b, 0);
+	});
+
+	it('counts nothing with BLAKE2_STATS=0', function() {
+		const script = "const b = require(" + JSON.stringify(path.join(__dirname, '..')) + "); " +
+			"b.createHash('blake2b').update(Buffer.alloc(10)).digest(); " +
+			"process.stdout.write(JSON.stringify(b.stats()));";
+		const env = Object.assign({}, process.env, {BLAKE2_STATS: '0'});
+		const stats = JSON.parse(childProcess.execFileSync(process.execPath, ['-e', script], {env}));
+		assert.equal(stats.enabled, false);
+		assert.equal(stats.bytes.blake2b, 0);
+		assert.equal(stats.digests.blake2b, 0);
+	});
+});
@@ -0,0 +1,33 @@
+"use strict";
+
+const assert = require('assert');
+const childProcess = require('child_process');
+const fs = require('fs');
+const os = require('os');
+const path = require('path');
+
+describe('trace events', function() {
+	this.timeout(20000);
+
+	it('emits spans in the node.blake2 category with algorithm and byte count', function() {
+		const dir = fs.mkdtempSync(path.join(os.tmpdir(), 'blake2-trace-'));
+		const script = "const blake2 = require(" + JSON.stringify(path.join(__dirname, '..', 'index')) + ");" +
+			"blake2.createHash('blake2s').update(Buffer.alloc(1000)).digest();";
+		const result = childProcess.spawnSync(process.execPath, [
+			'--trace-event-categories', 'node.blake2',
+			'--trace-event-file-pattern', path.join(dir, 'trace.log'),
+			'-e', script
+		]);
+		assert.equal(result.status, 0, String(result.stderr));
+		const events = JSON.parse(fs.readFileSync(path.join(dir, 'trace.log'), 'utf8')).traceEvents
+			.filter(event => event.cat === 'node.blake2');
+		fs.rmSync(dir, {recursive: true, force: true});
+
+		const begin = events.find(event => event.name === 'blake2.update' && event.ph === 'B');
+		const end = events.find(event => event.name === 'blake2.update' && event.ph === 'E');
+		assert.equal(begin.args.algorithm, 'blake2s');
+		assert.equal(end.args.bytes, 1000);
+		assert(end.ts >= begin.ts);
+		assert(events.some(event => event.name === 'blake2.final' && event.ph === 'E'));
+	});
+});
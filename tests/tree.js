@@ -0,0 +1,128 @@
+"use strict";
+
+const blake2 = require('../index');
+const assert = require('assert');
+const fs = require('fs');
+const os = require('os');
+const path = require('path');
+
+function makeTree() {
+	const dir = fs.mkdtempSync(path.join(os.tmpdir(), 'blake2-tree-'));
+	const files = {
+		'a/x.txt': 'hello\n',
+		'a/b/y.o': 'object',
+		'a/b/c/deep.txt': 'deep',
+		'c/z.txt': 'zz',
+		'node_modules/m/index.js': 'module.exports = 1;',
+		'empty': ''
+	};
+	for (const [name, content] of Object.entries(files)) {
+		fs.mkdirSync(path.join(dir, path.dirname(name)), {recursive: true});
+		fs.writeFileSync(path.join(dir, name), content);
+	}
+	return dir;
+}
+
+/**
+ * The documented root digest format, computed in JS
+ */
+function expectedRoot(dir, names, digestLength) {
+	const hash = blake2.createHash('blake2b', {digestLength});
+	hash.update(Buffer.from('blake2-tree-v1\0', 'binary'));
+	for (const name of names.slice().sort()) {
+		const stat = fs.lstatSync(path.join(dir, name));
+		const content = fs.readFileSync(path.join(dir, name));
+		const fields = Buffer.alloc(12);
+		fields.writeUInt32LE(stat.mode, 0);
+		fields.writeUInt32LE(content.length, 4);
+		hash.update(Buffer.from(name + '\0'));
+		hash.update(fields);
+		hash.update(blake2.createHash('blake2b', {digestLength}).update(content).digest());
+	}
+	return hash.digest();
+}
+
+describe('hashTree', function() {
+	this.timeout(10000);
+	let dir;
+
+	before(function() {
+		dir = makeTree();
+	});
+
+	after(function() {
+		fs.rmSync(dir, {recursive: true, force: true});
+	});
+
+	it('returns the canonical root digest', async function() {
+		const result = await blake2.hashTree(dir, {digestLength: 32});
+		const names = ['a/x.txt', 'a/b/y.o', 'a/b/c/deep.txt', 'c/z.txt', 'node_modules/m/index.js', 'empty'];
+		assert.deepEqual(result.root, expectedRoot(dir, names, 32));
+		assert.equal(result.files, undefined);
+	});
+
+	it('applies include and exclude globs', async function() {
+		const result = await blake2.hashTree(dir, {
+			digestLength: 32,
+			include: ['**/*.txt', 'empty'],
+			exclude: ['node_modules', 'a/b/c/**']
+		});
+		assert.deepEqual(result.root, expectedRoot(dir, ['a/x.txt', 'c/z.txt', 'empty'], 32));
+	});
+
+	it('returns sorted per-file digests', async function() {
+		const result = await blake2.hashTree(dir, {files: true, exclude: ['*.o']});
+		assert.deepEqual(result.files.map(f => f.path), ['a/b/c/deep.txt', 'a/x.txt', 'c/z.txt', 'empty', 'node_modules/m/index.js']);
+		const x = result.files[1];
+		assert.equal(x.size, 6);
+		assert.deepEqual(x.digest, blake2.createHash('blake2b').update(Buffer.from('hello\n')).digest());
+	});
+
+	it('changes the root digest when a file changes', async function() {
+		const before = await blake2.hashTree(dir);
+		fs.writeFileSync(path.join(dir, 'c/z.txt'), 'changed');
+		const after = await blake2.hashTree(dir);
+		assert.notDeepEqual(after.root, before.root);
+		assert.deepEqual(await blake2.hashTree(dir), after);
+	});
+
+	it('serves unchanged files from a digest cache', async function() {
+		if (process.platform === 'win32') {
+			this.skip();
+		}
+		const cachePath = path.join(os.tmpdir(), `blake2-tree-cache-${process.pid}`);
+		const cache = blake2.openDigestCache(cachePath);
+		try {
+			// Files changed within the last second are never cached
+			await new Promise(resolve => setTimeout(resolve, 1100));
+			const cold = await blake2.hashTree(dir, {cache});
+			assert.equal(cold.cached, 0);
+			const warm = await blake2.hashTree(dir, {cache, files: true});
+			assert.equal(warm.cached, warm.files.length);
+			assert.deepEqual(warm.root, cold.root);
+			assert.deepEqual(warm.root, (await blake2.hashTree(dir)).root);
+
+			// Other parameters and changed files miss
+			assert.equal((await blake2.hashTree(dir, {cache, digestLength: 32})).cached, 0);
+			fs.writeFileSync(path.join(dir, 'a/x.txt'), 'hello again\n');
+			const changed = await blake2.hashTree(dir, {cache});
+			assert.equal(changed.cached, warm.files.length - 1);
+			assert.deepEqual(changed.root, (await blake2.hashTree(dir)).root);
+
+			// Another handle sees what this one stored
+			const other = blake2.openDigestCache(cachePath);
+			assert.equal((await blake2.hashTree(dir, {cache: other})).cached, warm.files.length - 1);
+			other.close();
+		} finally {
+			cache.close();
+			fs.unlinkSync(cachePath);
+		}
+	});
+
+	it('rejects a missing directory', function() {
+		return blake2.hashTree(path.join(dir, 'missing')).then(
+			() => assert.fail('should have failed'),
+			err => assert(err instanceof Error)
+		);
+	});
+});
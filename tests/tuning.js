@@ -0,0 +1,70 @@
+"use strict";
+
+const blake2 = require('../index');
+const assert = require('assert');
+const fs = require('fs');
+const os = require('os');
+const path = require('path');
+
+const NAMES = ['coalesceBelow', 'multiHashTile', 'piecesLanesMaxSize', 'piecesParallelMinBytes', 'rendezvousTaskKeys', 'deferBytes', 'offloadMin', 'backends'];
+
+describe('tuning', function() {
+	afterEach(function() {
+		blake2.resetTuning();
+	});
+
+	it('starts out with every value set', function() {
+		assert.deepEqual(Object.keys(blake2.getTuning()).sort(), NAMES.slice().sort());
+	});
+
+	it('installs partial profiles and rejects bad ones', function() {
+		const tuning = blake2.setTuning({multiHashTile: 4096, deferBytes: 0});
+		assert.equal(tuning.multiHashTile, 4096);
+		assert.equal(tuning.deferBytes, 0);
+		assert.equal(blake2.getTuning().multiHashTile, 4096);
+		assert.throws(() => blake2.setTuning({multiHashTile: 1}), RangeError);
+		assert.throws(() => blake2.setTuning({rendezvousTaskKeys: 1.5}), RangeError);
+		assert.throws(() => blake2.setTuning({offloadMin: -1}), RangeError);
+		assert.throws(() => blake2.setTuning({noSuchValue: 1}), TypeError);
+		assert.equal(blake2.getTuning().multiHashTile, 4096);
+	});
+
+	it('leaves digests unchanged whatever the thresholds', function() {
+		const data = Buffer.alloc(3 * 1024 * 1024 + 17, 0x5a);
+		const chunks = [1, 100, 700, 5000, 70000].map(n => data.subarray(0, n));
+
+		function digests() {
+			const multi = blake2.createMultiHash(['blake2b', 'blake2s']).update(data).digest();
+			const deferred = blake2.createHasher('blake2b').update(chunks[1]).digest();
+			return Promise.all([
+				multi,
+				deferred,
+				blake2.hashAsyncIterable(chunks, {algorithm: 'blake2s', offload: true}),
+				blake2.hashPieces(data, 65536, 'blake2s')
+			]);
+		}
+
+		return digests().then(function(expected) {
+			blake2.setTuning({coalesceBelow: 0, multiHashTile: 64, piecesLanesMaxSize: 0, piecesParallelMinBytes: 0, deferBytes: 0, offloadMin: 1});
+			return digests().then(function(actual) {
+				assert.deepEqual(actual, expected);
+				blake2.setTuning({coalesceBelow: 1 << 20, multiHashTile: 1 << 30, piecesLanesMaxSize: 1 << 30, piecesParallelMinBytes: 2 ** 48, deferBytes: 1 << 20, offloadMin: 1 << 30});
+				return digests();
+			}).then(function(actual) {
+				assert.deepEqual(actual, expected);
+			});
+		});
+	});
+
+	it('calibrates, installs and saves a profile', function() {
+		this.timeout(30000);
+		const file = path.join(os.tmpdir(), 'blake2-tuning-' + process.pid + '.json');
+		return blake2.calibrate({seconds: 0.5, save: file}).then(function(profile) {
+			assert.deepEqual(Object.keys(profile).sort(), NAMES.slice().sort());
+			assert.deepEqual(blake2.getTuning(), profile);
+			blake2.resetTuning();
+			assert.deepEqual(blake2.setTuning(file), profile);
+			fs.unlinkSync(file);
+		});
+	});
+});
@@ -0,0 +1,63 @@
+"use strict";
+
+const blake2 = require('../index');
+const assert = require('assert');
+const crypto = require('crypto');
+
+describe('web streams and async iterables', function() {
+	const chunks = [];
+	for (let i = 0; i < 200; i++) {
+		chunks.push(crypto.randomBytes(i % 9 === 0 ? 100000 : i % 4 === 0 ? 3000 : i % 40));
+	}
+	chunks.push('string chunk', new Uint16Array([1, 2, 3]));
+
+	function expected(algo, options) {
+		const hash = options && options.key ?
+			blake2.createKeyedHash(algo, options.key, options) :
+			blake2.createHash(algo, options);
+		for (const chunk of chunks) {
+			hash.update(typeof chunk === 'string' ? Buffer.from(chunk) : Buffer.from(chunk.buffer, chunk.byteOffset, chunk.byteLength));
+		}
+		return hash.digest();
+	}
+
+	async function* generate() {
+		for (const chunk of chunks) {
+			yield chunk;
+		}
+	}
+
+	it('hashes an async iterable', async function() {
+		assert.deepEqual(await blake2.hashAsyncIterable(generate()), expected('blake2b'));
+		const options = {algorithm: 'blake2s', key: Buffer.from('key'), digestLength: 16};
+		assert.deepEqual(await blake2.hashAsyncIterable(chunks, options), expected('blake2s', options));
+		assert.deepEqual(await blake2.hashAsyncIterable(generate(), {offload: true}), expected('blake2b'));
+	});
+
+	it('rejects chunks that are not bytes', function() {
+		return assert.rejects(blake2.hashAsyncIterable([Buffer.alloc(1), 5]), /strings, Buffers or typed arrays/);
+	});
+
+	it('hashes through a TransformStream', async function() {
+		if (typeof TransformStream !== 'function') {
+			this.skip();
+		}
+		for (const offload of [false, true]) {
+			const hash = blake2.createHashStream('blake2bp', {offload});
+			const writer = hash.writable.getWriter();
+			for (const chunk of chunks) {
+				if (typeof chunk === 'string' || chunk instanceof Uint16Array) {
+					await writer.write(chunk);
+					continue;
+				}
+				// Buffers may be reused once a write resolves
+				const reused = Buffer.from(chunk);
+				await writer.write(reused);
+				reused.fill(0);
+			}
+			writer.close();
+			const {value} = await hash.readable.getReader().read();
+			assert.deepEqual(value, expected('blake2bp'));
+		}
+	});
+});
@@ -0,0 +1,13 @@
+'use strict';
+
+const blake2 = require('../../index.js');
+const {workerData, parentPort} = require('worker_threads');
+
+const filter = new blake2.BloomFilter(workerData.storage);
+const values = [];
+for (let i = 0; i < workerData.count; i++) {
+	values.push(`${workerData.prefix}${i}`);
+}
+filter.add(values);
+
+parentPort.postMessage(Array.from(filter.hasMany(values)).every(found => found === 1));